@@ -1,5 +1,6 @@
 #pragma once
 #include "common/message.h"
+#include "agent/agent_session.h"
 #include "core/configuration.h"
 #include "provider/provider_manager.h"
 #include "stream/auralis_client.h"
@@ -15,37 +16,42 @@
 #include <db/GlobalDatabase.h>
 
 
+// Shared, per-agent configuration plus a pool of per-call sessions. The
+// config is an immutable snapshot; updates swap in a new one, which sessions
+// pick up the next time they are acquired.
 class Agent {
 public:
-    explicit Agent(const json& config = json::object()) : config_(config) {
-        this->whisper_client_ = std::make_unique<WhisperClient>();
-        this->auralis_client_ = std::make_unique<AuralisClient>();
-        this->connect_services();
-    }
-    
-    using SpeechCallback = std::function<void(const std::vector<int16_t>&)>;
-    // LLM RESPONSE
+    explicit Agent(const json& config = json::object()) :
+        config_(std::make_shared<const json>(config)) {}
+
+    // LLM RESPONSE for REST callers, on a session without STT/TTS streams
     std::string process_message(const std::string& text);
-    // WHISPER
-    void process_audio(const std::vector<int16_t>& audio_data);
-    // TTS
-    void generate_audio(const std::string& text);
-    void set_speech_callback(SpeechCallback callback);
-    
-    void connect_services();
-    
-    json get_config() const { return config_; }
-    void update_config(const json& config) { config_ = config; }
-    
+
+    // Session for a new call with STT/TTS connected; reused from the pool when possible
+    std::shared_ptr<AgentSession> acquire_session();
+    // Resets the session and keeps it for the next caller (up to "session_pool_size")
+    void release_session(const std::shared_ptr<AgentSession>& session);
+    size_t idle_sessions() const;
+
+    json get_config() const { return *config_snapshot(); }
+    std::shared_ptr<const json> config_snapshot() const {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        return config_;
+    }
+    void update_config(const json& config) {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        config_ = std::make_shared<const json>(config);
+    }
+
 protected:
-    SpeechCallback on_speech;
-    std::vector<Message> history_;
-    std::mutex history_mutex_;
-    json config_;
-    json metadata_;
-
-    std::unique_ptr<WhisperClient> whisper_client_;
-    std::unique_ptr<AuralisClient> auralis_client_;
+    mutable std::mutex config_mutex_;
+    std::shared_ptr<const json> config_;
+
+    mutable std::mutex pool_mutex_;
+    std::vector<std::shared_ptr<AgentSession>> idle_sessions_;
+
+    std::mutex rest_session_mutex_;
+    std::shared_ptr<AgentSession> rest_session_;
 };
 
 
@@ -0,0 +1,114 @@
+#pragma once
+#include "agent/conversation_history.h"
+#include "agent/turn_executor.h"
+#include "agent/turn_trace.h"
+#include "common/message.h"
+#include "provider/provider_manager.h"
+#include "stream/auralis_client.h"
+#include "stream/whisper_client.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Conversation state and STT/TTS bindings for a single caller. Sessions
+// reference the owning Agent's immutable config snapshot and are pooled by
+// the Agent, so the websocket connections survive across calls.
+class AgentSession : public std::enable_shared_from_this<AgentSession> {
+public:
+    using SpeechCallback = std::function<void(const std::vector<int16_t> &)>;
+
+    explicit AgentSession(std::shared_ptr<const json> config);
+
+    // LLM RESPONSE
+    std::string process_message(const std::string &text,
+        ProviderManager::ChunkCallback on_chunk = nullptr);
+    // WHISPER
+    void process_audio(const std::vector<int16_t> &audio_data);
+    // TTS; the audio plays only while `turn` is the current, uncancelled turn
+    void generate_audio(const std::string &text, uint64_t turn);
+    void set_speech_callback(SpeechCallback callback);
+    // Speaks a fixed prompt (e.g. a greeting) as its own interruptible turn
+    void speak(const std::string &text);
+
+    // LLM -> TTS, speaking each sentence as soon as it is generated
+    void respond(const std::string &text, const CancellationTokenPtr &token, uint64_t lease);
+    // Same as respond(), but as a continuation on the provider event loop.
+    // Returns false if the agent's provider can't run there.
+    bool respond_async(const std::string &text, const CancellationTokenPtr &token, uint64_t lease);
+    // Schedules respond() on the TurnExecutor (or respond_async() when the
+    // provider event loop is enabled), superseding any turn in flight.
+    // Dropped if the session has been reset since `lease`.
+    void submit_turn(const std::string &text, uint64_t lease);
+    // Barge-in: stops the in-flight LLM stream and drops its pending speech
+    void cancel_turn();
+
+    void connect_services();
+
+    // Drops the conversation and callbacks so the session can serve the next
+    // caller; the STT/TTS connections stay open.
+    void reset(std::shared_ptr<const json> config);
+    // Bumped by every reset(). Work started for an earlier caller carries an
+    // older value and must not touch the history or reach the new caller.
+    uint64_t lease() const { return lease_.load(); }
+
+    std::shared_ptr<const json> config() const;
+    void set_config(std::shared_ptr<const json> config);
+    // Queue class for this session's turns on a capped provider: Live for
+    // calls (the default), Batch for REST callers
+    void set_priority(FairLimiter::Priority priority) { priority_ = priority; }
+    // Per-turn latency marks; the call adds speech end and first playout
+    TurnTracer &tracer() { return tracer_; }
+
+protected:
+    CancellationTokenPtr begin_turn();
+    bool speech_allowed(uint64_t turn);
+    std::string run_request(const std::string &text, ProviderManager::ChunkCallback on_chunk, uint64_t lease,
+        const CancellationTokenPtr &token);
+    // Adds the user's message to the prompt for the provider; `user_seq`
+    // identifies it for complete_request()
+    PromptSnapshot begin_request(const std::string &text, json &metadata, uint64_t lease, uint64_t &user_seq);
+    // Records the answer right after the user's message and returns the
+    // text to speak. A cancelled turn leaves no trace in the history.
+    std::string complete_request(const ProviderManager::RequestResult &response, const json &config, uint64_t lease,
+        uint64_t user_seq, const CancellationTokenPtr &token);
+    // Tenant ("tenant", "tenant_weight" in the agent config), priority and
+    // deadline ("turn_timeout_ms" from now, 0 for none) of a provider request
+    ProviderManager::RequestContext request_context(const json &config, FairLimiter::Priority priority) const;
+    // Schedules summarization of older turns once the history exceeds the
+    // agent's "history.token_budget"
+    void maybe_compact_history(const json &config, uint64_t lease);
+    std::string summarize(const json &config, const ConversationHistory::Compaction &job);
+
+    mutable std::mutex config_mutex_;
+    std::shared_ptr<const json> config_;
+
+    ConversationHistory history_;
+    json metadata_;
+    std::mutex history_mutex_;
+    bool compacting_ = false;
+    FairLimiter::Priority priority_ = FairLimiter::Priority::Live;
+
+    std::mutex turn_mutex_;
+    CancellationTokenPtr current_turn_;
+    uint64_t turn_ids_ = 0;
+
+    std::mutex speech_mutex_;
+    SpeechCallback on_speech_;
+
+    bool services_connected_ = false;
+
+    std::atomic<uint64_t> lease_ { 0 };
+    // Lease of each segment sent to STT, oldest first; transcripts come back in order
+    std::mutex stt_mutex_;
+    std::deque<uint64_t> stt_leases_;
+
+    TurnTracer tracer_;
+
+    // Declared last so their threads are joined before the state above goes away
+    std::unique_ptr<WhisperClient> whisper_client_;
+    std::unique_ptr<AuralisClient> auralis_client_;
+};
@@ -0,0 +1,215 @@
+#pragma once
+#include "common/message.h"
+#include "common/prompt_log.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Conversation turns with an approximate token count, kept under a budget by
+// folding older turns into a rolling summary. Not thread-safe; the owning
+// session serializes access.
+class ConversationHistory {
+public:
+    // Older turns taken out for summarization. Applied only if the history
+    // still starts with them (a reset or another compaction makes it stale).
+    struct Compaction {
+        uint64_t first_seq = 0;
+        uint64_t end_seq = 0;
+        std::string previous_summary;
+        std::vector<Message> messages;
+
+        bool empty() const { return messages.empty(); }
+    };
+
+    // Rough BPE estimate without a vocabulary: ~4 ASCII or ~2.5 non-ASCII
+    // letters per token, one token per punctuation mark, plus role overhead.
+    static size_t estimate_tokens(const std::string &text)
+    {
+        size_t tokens = 0;
+        size_t ascii_run = 0;
+        size_t wide_run = 0;
+
+        auto close_word = [&]() {
+            tokens += (ascii_run + 3) / 4;
+            tokens += (wide_run * 2 + 4) / 5;
+            ascii_run = 0;
+            wide_run = 0;
+        };
+
+        for (size_t i = 0; i < text.size(); i++) {
+            const auto c = static_cast<unsigned char>(text[i]);
+            if (c < 0x80) {
+                if (std::isalnum(c)) {
+                    ascii_run++;
+                    continue;
+                }
+                close_word();
+                if (!std::isspace(c)) {
+                    tokens++;
+                }
+            } else if ((c & 0xC0) != 0x80) {
+                // Lead byte of a multi-byte code point
+                wide_run++;
+            }
+        }
+        close_word();
+        return tokens + MESSAGE_OVERHEAD_TOKENS;
+    }
+
+    // Returns the message's sequence number
+    uint64_t append(const std::string &role, const std::string &content)
+    {
+        Entry entry { Message(role, content), estimate_tokens(content), next_seq_++ };
+        const uint64_t seq = entry.seq;
+        total_tokens_ += entry.tokens;
+        entries_.push_back(std::move(entry));
+        log_->append(role, content);
+        return seq;
+    }
+
+    // Records the answer to the user message `user_seq`, directly after it.
+    // If other messages were appended in between, the pair is moved to the
+    // end so the history never interleaves two turns. Nothing is recorded
+    // if the user message is gone (cleared, truncated or summarized).
+    void complete_turn(uint64_t user_seq, const std::string &answer)
+    {
+        if (!entries_.empty() && entries_.back().seq == user_seq) {
+            append("assistant", answer);
+            return;
+        }
+        auto user = take(user_seq);
+        if (!user) {
+            return;
+        }
+        rebuild_prompt();
+        append(user->message.role, user->message.content);
+        append("assistant", answer);
+    }
+
+    // Drops the user message of a turn that was cancelled before it was
+    // answered. Usually the newest message (barge-in), which only shortens
+    // the prompt log, so its mirrors stay valid.
+    void discard_turn(uint64_t user_seq)
+    {
+        if (!entries_.empty() && entries_.back().seq == user_seq) {
+            total_tokens_ -= entries_.back().tokens;
+            entries_.pop_back();
+            log_->pop_back();
+            return;
+        }
+        if (take(user_seq)) {
+            rebuild_prompt();
+        }
+    }
+
+    // Messages to send to the provider: the summary (as a system message)
+    // followed by the retained turns. Extended in place on append and
+    // shortened in place when the newest message is discarded; replaced by a
+    // fresh log whenever earlier turns are dropped, moved or summarized.
+    const PromptLogPtr &prompt() const { return log_; }
+
+    size_t tokens() const { return total_tokens_ + summary_tokens_; }
+    size_t size() const { return entries_.size(); }
+    const std::string &summary() const { return summary_; }
+
+    // Everything except the newest keep_recent messages, for summarization.
+    Compaction begin_compaction(size_t keep_recent) const
+    {
+        Compaction job;
+        if (entries_.size() <= keep_recent) {
+            return job;
+        }
+        const size_t count = entries_.size() - keep_recent;
+        job.previous_summary = summary_;
+        job.first_seq = entries_.front().seq;
+        job.end_seq = entries_[count].seq;
+        job.messages.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            job.messages.push_back(entries_[i].message);
+        }
+        return job;
+    }
+
+    // Replaces the compacted turns with the new summary. Returns false if the
+    // history changed underneath the job.
+    bool complete_compaction(const Compaction &job, const std::string &summary)
+    {
+        if (job.empty() || entries_.empty() || entries_.front().seq != job.first_seq) {
+            return false;
+        }
+        while (!entries_.empty() && entries_.front().seq < job.end_seq) {
+            total_tokens_ -= entries_.front().tokens;
+            entries_.pop_front();
+        }
+        summary_ = summary;
+        summary_tokens_ = summary_.empty() ? 0 : estimate_tokens(summary_);
+        rebuild_prompt();
+        return true;
+    }
+
+    // Hard bound while a summary is pending: drops the oldest turns.
+    void truncate(size_t max_tokens)
+    {
+        bool dropped = false;
+        while (entries_.size() > 1 && tokens() > max_tokens) {
+            total_tokens_ -= entries_.front().tokens;
+            entries_.pop_front();
+            dropped = true;
+        }
+        if (dropped) {
+            rebuild_prompt();
+        }
+    }
+
+    void clear()
+    {
+        entries_.clear();
+        summary_.clear();
+        total_tokens_ = 0;
+        summary_tokens_ = 0;
+        rebuild_prompt();
+    }
+
+private:
+    struct Entry {
+        Message message;
+        size_t tokens;
+        uint64_t seq;
+    };
+
+    std::optional<Entry> take(uint64_t seq)
+    {
+        auto it = std::find_if(entries_.begin(), entries_.end(), [seq](const Entry &entry) { return entry.seq == seq; });
+        if (it == entries_.end()) {
+            return std::nullopt;
+        }
+        Entry entry = std::move(*it);
+        total_tokens_ -= entry.tokens;
+        entries_.erase(it);
+        return entry;
+    }
+
+    void rebuild_prompt()
+    {
+        log_ = std::make_shared<PromptLog>();
+        if (!summary_.empty()) {
+            log_->append("system", "Summary of the earlier conversation: " + summary_);
+        }
+        for (const auto &entry: entries_) {
+            log_->append(entry.message.role, entry.message.content);
+        }
+    }
+
+    static constexpr size_t MESSAGE_OVERHEAD_TOKENS = 4;
+
+    std::deque<Entry> entries_;
+    std::string summary_;
+    size_t total_tokens_ = 0;
+    size_t summary_tokens_ = 0;
+    uint64_t next_seq_ = 0;
+    PromptLogPtr log_ = std::make_shared<PromptLog>();
+};
@@ -0,0 +1,98 @@
+#pragma once
+#include <functional>
+#include <string>
+
+// Accumulates streamed LLM tokens and hands out speakable pieces as soon as a
+// sentence (or, for long runs, a clause) is complete, so TTS can start on the
+// first sentence while the rest of the answer is still being generated.
+class SentenceChunker {
+public:
+    using ChunkCallback = std::function<void(const std::string &)>;
+
+    explicit SentenceChunker(ChunkCallback callback,
+        size_t min_chunk_chars = 12,
+        size_t clause_split_chars = 80) :
+        callback_(std::move(callback)),
+        min_chunk_chars_(min_chunk_chars),
+        clause_split_chars_(clause_split_chars)
+    {
+    }
+
+    void feed(const std::string &token)
+    {
+        for (char c: token) {
+            // A terminator only ends a sentence once whitespace follows it,
+            // which keeps "3.14" or "v1.2" intact.
+            if (pending_break_ && is_space(c)) {
+                pending_break_ = false;
+                if (buffer_.size() >= min_chunk_chars_) {
+                    emit();
+                    continue;
+                }
+            } else if (!is_space(c)) {
+                pending_break_ = false;
+            }
+
+            buffer_ += c;
+
+            if (c == '\n') {
+                if (buffer_.size() >= min_chunk_chars_) {
+                    emit();
+                }
+            } else if (is_sentence_end()) {
+                pending_break_ = true;
+            } else if (c == ',' && buffer_.size() >= clause_split_chars_) {
+                pending_break_ = true;
+            }
+        }
+    }
+
+    // Emits whatever is left once the stream is finished.
+    void flush()
+    {
+        pending_break_ = false;
+        emit();
+    }
+
+    size_t emitted() const { return emitted_; }
+
+private:
+    static bool is_space(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    bool is_sentence_end() const
+    {
+        const char c = buffer_.back();
+        if (c == '.' || c == '!' || c == '?' || c == ';' || c == ':') {
+            return true;
+        }
+        // U+2026 HORIZONTAL ELLIPSIS
+        return buffer_.size() >= 3 && buffer_.compare(buffer_.size() - 3, 3, "\xE2\x80\xA6") == 0;
+    }
+
+    void emit()
+    {
+        size_t begin = 0;
+        size_t end = buffer_.size();
+        while (begin < end && is_space(buffer_[begin])) {
+            ++begin;
+        }
+        while (end > begin && is_space(buffer_[end - 1])) {
+            --end;
+        }
+        if (end > begin) {
+            callback_(buffer_.substr(begin, end - begin));
+            ++emitted_;
+        }
+        buffer_.clear();
+    }
+
+    ChunkCallback callback_;
+    size_t min_chunk_chars_;
+    size_t clause_split_chars_;
+    std::string buffer_;
+    bool pending_break_ = false;
+    size_t emitted_ = 0;
+};
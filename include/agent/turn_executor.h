@@ -0,0 +1,128 @@
+#pragma once
+#include "core/configuration.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Set when a turn is superseded (barge-in); checked by the LLM stream and TTS
+// output so a stale answer stops generating and never reaches the caller.
+class CancellationToken {
+public:
+    explicit CancellationToken(uint64_t id = 0) : id_(id) { }
+
+    // Turn number, to match output that arrives after the turn has ended
+    uint64_t id() const { return id_; }
+    void cancel() { cancelled_.store(true, std::memory_order_release); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+private:
+    const uint64_t id_;
+    std::atomic<bool> cancelled_ { false };
+};
+
+using CancellationTokenPtr = std::shared_ptr<CancellationToken>;
+
+// Bounded pool that runs agent turns (LLM + TTS) off the websocket threads.
+// Sized by AGENT_TURN_WORKERS / AGENT_TURN_QUEUE.
+class TurnExecutor {
+public:
+    using Task = std::function<void()>;
+
+    static TurnExecutor &getInstance()
+    {
+        static TurnExecutor instance(
+            AppConfig::getInstance().get<int>("AGENT_TURN_WORKERS", 4),
+            AppConfig::getInstance().get<int>("AGENT_TURN_QUEUE", 64));
+        return instance;
+    }
+
+    TurnExecutor(const TurnExecutor &) = delete;
+    TurnExecutor &operator=(const TurnExecutor &) = delete;
+
+    ~TurnExecutor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopped_ = true;
+        }
+        condition_.notify_all();
+        for (auto &worker: workers_) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    // Returns false when the queue is full or the executor is stopping
+    bool submit(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_ || tasks_.size() >= capacity_) {
+                return false;
+            }
+            tasks_.push_back(std::move(task));
+        }
+        condition_.notify_one();
+        return true;
+    }
+
+    size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return tasks_.size();
+    }
+
+    size_t active() const { return active_.load(std::memory_order_relaxed); }
+    size_t capacity() const { return capacity_; }
+    size_t workers() const { return workers_.size(); }
+
+private:
+    TurnExecutor(int workers, int capacity) :
+        capacity_(static_cast<size_t>(std::max(capacity, 1)))
+    {
+        for (int i = 0; i < std::max(workers, 1); i++) {
+            workers_.emplace_back(&TurnExecutor::worker_main, this);
+        }
+    }
+
+    void worker_main()
+    {
+        while (true) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this] { return stopped_ || !tasks_.empty(); });
+                if (stopped_ && tasks_.empty()) {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+
+            active_.fetch_add(1, std::memory_order_relaxed);
+            try {
+                task();
+            } catch (const std::exception &e) {
+                LOG_ERROR << "Agent turn failed: " << e.what();
+            }
+            active_.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::deque<Task> tasks_;
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> active_ { 0 };
+    bool stopped_ = false;
+};
@@ -0,0 +1,374 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <deps/json.hpp>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+using json = nlohmann::json;
+
+// Points in a turn, from the caller going quiet to the answer being heard
+enum class TurnMark {
+    SpeechEnd,     // VAD closed the segment
+    SttSent,       // audio handed to the STT socket
+    Transcript,    // STT answered
+    LlmStart,      // provider request issued
+    LlmFirstToken,
+    LlmLastToken,
+    TtsRequest,    // first sentence sent for synthesis
+    TtsFirstChunk, // first audio back from TTS
+    FirstPlayed,   // first non-silent frame pulled from MediaPort
+    Count,
+};
+
+// Intervals reported for every turn, each between two marks
+struct TurnStage {
+    const char *name;
+    TurnMark from;
+    TurnMark to;
+};
+
+inline constexpr std::array<TurnStage, 9> TURN_STAGES = { {
+    { "sttSend", TurnMark::SpeechEnd, TurnMark::SttSent },
+    { "stt", TurnMark::SttSent, TurnMark::Transcript },
+    { "queue", TurnMark::Transcript, TurnMark::LlmStart },
+    { "llmFirstToken", TurnMark::LlmStart, TurnMark::LlmFirstToken },
+    { "llmStream", TurnMark::LlmFirstToken, TurnMark::LlmLastToken },
+    { "firstSentence", TurnMark::LlmFirstToken, TurnMark::TtsRequest },
+    { "tts", TurnMark::TtsRequest, TurnMark::TtsFirstChunk },
+    { "playout", TurnMark::TtsFirstChunk, TurnMark::FirstPlayed },
+    { "total", TurnMark::SpeechEnd, TurnMark::FirstPlayed },
+} };
+
+inline const char *turn_mark_name(TurnMark mark)
+{
+    static constexpr const char *names[] = { "speechEnd", "sttSent", "transcript", "llmStart", "llmFirstToken",
+        "llmLastToken", "ttsRequest", "ttsFirstChunk", "firstPlayed" };
+    return names[static_cast<size_t>(mark)];
+}
+
+struct TurnTrace {
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t turn = 0;
+    std::string agent_id;
+    std::string provider;
+    int64_t started_at_ms = 0; // wall clock, for matching against logs
+    bool cancelled = false;    // barge-in, or superseded by the next turn
+    bool complete = false;
+    std::array<std::optional<Clock::time_point>, static_cast<size_t>(TurnMark::Count)> marks;
+
+    const std::optional<Clock::time_point> &at(TurnMark mark) const { return marks[static_cast<size_t>(mark)]; }
+
+    std::optional<double> stage_ms(const TurnStage &stage) const
+    {
+        const auto &from = at(stage.from);
+        const auto &to = at(stage.to);
+        if (!from || !to || *to < *from) {
+            return std::nullopt;
+        }
+        return std::chrono::duration<double, std::milli>(*to - *from).count();
+    }
+};
+
+inline void to_json(json &j, const TurnTrace &trace)
+{
+    const auto &origin = trace.at(TurnMark::SpeechEnd);
+    json marks = json::object();
+    for (size_t i = 0; i < trace.marks.size(); i++) {
+        const auto &mark = trace.marks[i];
+        marks[turn_mark_name(static_cast<TurnMark>(i))] = mark && origin
+            ? json(std::chrono::duration<double, std::milli>(*mark - *origin).count())
+            : json(nullptr);
+    }
+    json stages = json::object();
+    for (const auto &stage: TURN_STAGES) {
+        const auto ms = trace.stage_ms(stage);
+        stages[stage.name] = ms ? json(*ms) : json(nullptr);
+    }
+    j = json {
+        { "turn", trace.turn },
+        { "agentId", trace.agent_id },
+        { "provider", trace.provider },
+        { "startedAtMs", trace.started_at_ms },
+        { "cancelled", trace.cancelled },
+        { "complete", trace.complete },
+        { "marksMs", marks },
+        { "stagesMs", stages },
+    };
+}
+
+// Fixed-bucket latency histogram in milliseconds
+class LatencyHistogram {
+public:
+    static constexpr std::array<double, 14> BOUNDS_MS = { 10, 25, 50, 100, 200, 300, 500, 750, 1000, 1500, 2000, 3000, 5000, 10000 };
+
+    void record(double ms)
+    {
+        const auto bucket = std::lower_bound(BOUNDS_MS.begin(), BOUNDS_MS.end(), ms) - BOUNDS_MS.begin();
+        counts_[bucket]++;
+        count_++;
+        sum_ += ms;
+        max_ = std::max(max_, ms);
+    }
+
+    // Upper bound of the bucket holding the q-th value, capped at the maximum
+    double quantile(double q) const
+    {
+        if (count_ == 0) {
+            return 0;
+        }
+        const auto rank = static_cast<uint64_t>(q * (count_ - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return i < BOUNDS_MS.size() ? std::min(BOUNDS_MS[i], max_) : max_;
+            }
+        }
+        return max_;
+    }
+
+    json to_json() const
+    {
+        json buckets = json::array();
+        for (size_t i = 0; i < counts_.size(); i++) {
+            buckets.push_back({ { "leMs", i < BOUNDS_MS.size() ? json(BOUNDS_MS[i]) : json(nullptr) }, { "count", counts_[i] } });
+        }
+        return json {
+            { "count", count_ },
+            { "meanMs", count_ ? sum_ / count_ : 0.0 },
+            { "p50Ms", quantile(0.50) },
+            { "p95Ms", quantile(0.95) },
+            { "p99Ms", quantile(0.99) },
+            { "maxMs", max_ },
+            { "buckets", buckets },
+        };
+    }
+
+private:
+    std::array<uint64_t, BOUNDS_MS.size() + 1> counts_ {};
+    uint64_t count_ = 0;
+    double sum_ = 0;
+    double max_ = 0;
+};
+
+// Stage histograms for every finished turn, per agent and provider. Served
+// by GET /status/latency.
+class TurnLatencyStats {
+public:
+    static TurnLatencyStats &getInstance()
+    {
+        static TurnLatencyStats instance;
+        return instance;
+    }
+
+    void record(const TurnTrace &trace)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &entry = entries_[{ trace.agent_id, trace.provider }];
+        entry.turns++;
+        if (trace.cancelled) {
+            entry.cancelled++;
+        }
+        for (size_t i = 0; i < TURN_STAGES.size(); i++) {
+            if (const auto ms = trace.stage_ms(TURN_STAGES[i])) {
+                entry.stages[i].record(*ms);
+            }
+        }
+    }
+
+    // Optionally only one agent's entries
+    json snapshot(const std::string &agent_id = "") const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        json result = json::array();
+        for (const auto &[key, entry]: entries_) {
+            if (!agent_id.empty() && key.first != agent_id) {
+                continue;
+            }
+            json stages = json::object();
+            for (size_t i = 0; i < TURN_STAGES.size(); i++) {
+                stages[TURN_STAGES[i].name] = entry.stages[i].to_json();
+            }
+            result.push_back({
+                { "agentId", key.first },
+                { "provider", key.second },
+                { "turns", entry.turns },
+                { "cancelled", entry.cancelled },
+                { "stagesMs", stages },
+            });
+        }
+        return result;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+    }
+
+private:
+    TurnLatencyStats() = default;
+
+    struct Entry {
+        uint64_t turns = 0;
+        uint64_t cancelled = 0;
+        std::array<LatencyHistogram, TURN_STAGES.size()> stages;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<std::pair<std::string, std::string>, Entry> entries_;
+};
+
+// Timestamps for the turns of one session. Marks come from the media thread,
+// the STT/TTS sockets and the turn workers, so everything is under mutex_.
+//
+// A turn starts pending at speech end; STT answers in order, so the oldest
+// pending turn becomes the current one when its transcript arrives. The
+// current turn finishes once it has been heard and the LLM is done, or when
+// it is cancelled or superseded, and is then added to TurnLatencyStats.
+class TurnTracer {
+public:
+    static constexpr size_t MAX_PENDING = 8;
+    static constexpr size_t MAX_KEPT = 32;
+
+    void set_agent_id(std::string agent_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        agent_id_ = std::move(agent_id);
+    }
+
+    void speech_ended()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TurnTrace trace;
+        trace.turn = ++turns_;
+        trace.agent_id = agent_id_;
+        trace.started_at_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch())
+                                  .count();
+        set(trace, TurnMark::SpeechEnd);
+        pending_.push_back(std::move(trace));
+        // STT dropped segments without answering
+        while (pending_.size() > MAX_PENDING) {
+            finish(std::move(pending_.front()), true);
+            pending_.pop_front();
+        }
+    }
+
+    void stt_sent()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!pending_.empty() && !pending_.back().at(TurnMark::SttSent)) {
+            set(pending_.back(), TurnMark::SttSent);
+        }
+    }
+
+    void transcript_received()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_) {
+            finish(std::move(*current_), true);
+            current_.reset();
+        }
+        if (pending_.empty()) {
+            return;
+        }
+        current_ = std::move(pending_.front());
+        pending_.pop_front();
+        set(*current_, TurnMark::Transcript);
+    }
+
+    void llm_started(const std::string &provider)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_ && !current_->at(TurnMark::LlmStart)) {
+            current_->provider = provider;
+            set(*current_, TurnMark::LlmStart);
+        }
+    }
+
+    // First occurrence only; LlmLastToken and FirstPlayed may finish the turn
+    void mark(TurnMark mark)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!current_ || current_->at(mark)) {
+            return;
+        }
+        set(*current_, mark);
+        if (current_->at(TurnMark::FirstPlayed) && current_->at(TurnMark::LlmLastToken)) {
+            current_->complete = true;
+            finish(std::move(*current_), false);
+            current_.reset();
+        }
+    }
+
+    // Barge-in or a new turn: the current turn ends where it got to
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_) {
+            finish(std::move(*current_), true);
+            current_.reset();
+        }
+    }
+
+    // Finished turns, oldest first, then the one in progress
+    std::vector<TurnTrace> traces() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<TurnTrace> result(finished_.begin(), finished_.end());
+        if (current_) {
+            result.push_back(*current_);
+        }
+        return result;
+    }
+
+    // Ends whatever is in flight and forgets this session's turns
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (current_) {
+            finish(std::move(*current_), true);
+            current_.reset();
+        }
+        for (auto &trace: pending_) {
+            finish(std::move(trace), true);
+        }
+        pending_.clear();
+        finished_.clear();
+        agent_id_.clear();
+        turns_ = 0;
+    }
+
+private:
+    static void set(TurnTrace &trace, TurnMark mark)
+    {
+        trace.marks[static_cast<size_t>(mark)] = TurnTrace::Clock::now();
+    }
+
+    void finish(TurnTrace trace, bool cancelled)
+    {
+        trace.cancelled = cancelled;
+        TurnLatencyStats::getInstance().record(trace);
+        finished_.push_back(std::move(trace));
+        if (finished_.size() > MAX_KEPT) {
+            finished_.pop_front();
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::string agent_id_;
+    uint64_t turns_ = 0;
+    std::deque<TurnTrace> pending_;
+    std::optional<TurnTrace> current_;
+    std::deque<TurnTrace> finished_;
+};
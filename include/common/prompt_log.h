@@ -0,0 +1,122 @@
+#pragma once
+#include "common/message.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Provider-ready message list for one conversation. It grows at the end and
+// can only lose its newest messages (a cancelled turn); when the
+// conversation is compacted or reset the owner starts a new log (with a new
+// id). Anything that mirrored a prefix of it can therefore keep extending
+// its copy by the new tail instead of rebuilding the whole prompt.
+//
+// Every message gets a stamp, increasing along the log. A mirrored prefix is
+// intact as long as its last stamp is still at the same position, and a
+// snapshot's messages are those stamped no later than its newest one.
+class PromptLog {
+public:
+    PromptLog() :
+        id_(next_id()) { }
+
+    uint64_t id() const { return id_; }
+
+    // Returns the message's stamp
+    uint64_t append(const std::string &role, const std::string &content)
+    {
+        std::unique_lock lock(mutex_);
+        messages_.push_back({ Message(role, content), ++last_stamp_ });
+        return last_stamp_;
+    }
+
+    // Drops the newest message; its stamp is never reused
+    void pop_back()
+    {
+        std::unique_lock lock(mutex_);
+        if (!messages_.empty()) {
+            messages_.pop_back();
+        }
+    }
+
+    size_t size() const
+    {
+        std::shared_lock lock(mutex_);
+        return messages_.size();
+    }
+
+    // Stamp of the newest message, 0 when empty
+    uint64_t back_stamp() const
+    {
+        std::shared_lock lock(mutex_);
+        return messages_.empty() ? 0 : messages_.back().stamp;
+    }
+
+    // Visits messages [from, to) stamped no later than `until`, under a
+    // shared lock
+    template<typename Fn>
+    void for_each(size_t from, size_t to, uint64_t until, Fn &&fn) const
+    {
+        std::shared_lock lock(mutex_);
+        to = std::min(to, messages_.size());
+        for (size_t i = from; i < to && messages_[i].stamp <= until; i++) {
+            fn(messages_[i].message);
+        }
+    }
+
+    // Brings a copy of the log's first messages, whose stamps are in
+    // `stamps`, up to [0, to) stamped no later than `until`: copied messages
+    // no longer in the log are dropped from the end (drop(index)), then the
+    // missing ones added (add(message)).
+    template<typename Drop, typename Add>
+    void sync(std::vector<uint64_t> &stamps, size_t to, uint64_t until, Drop &&drop, Add &&add) const
+    {
+        std::shared_lock lock(mutex_);
+        while (!stamps.empty() && (stamps.size() > messages_.size() || messages_[stamps.size() - 1].stamp != stamps.back())) {
+            stamps.pop_back();
+            drop(stamps.size());
+        }
+        to = std::min(to, messages_.size());
+        for (size_t i = stamps.size(); i < to && messages_[i].stamp <= until; i++) {
+            stamps.push_back(messages_[i].stamp);
+            add(messages_[i].message);
+        }
+    }
+
+private:
+    struct Entry {
+        Message message;
+        uint64_t stamp;
+    };
+
+    static uint64_t next_id()
+    {
+        static std::atomic<uint64_t> counter { 0 };
+        return ++counter;
+    }
+
+    const uint64_t id_;
+    mutable std::shared_mutex mutex_;
+    std::vector<Entry> messages_;
+    uint64_t last_stamp_ = 0;
+};
+
+using PromptLogPtr = std::shared_ptr<PromptLog>;
+
+// The log as it was when a request was issued; later appends are ignored.
+// If the newest messages were dropped since, it reads what is left of them.
+struct PromptSnapshot {
+    std::shared_ptr<const PromptLog> log;
+    size_t size = 0;
+    uint64_t stamp = 0;
+
+    template<typename Fn>
+    void for_each(Fn &&fn) const
+    {
+        log->for_each(0, size, stamp, std::forward<Fn>(fn));
+    }
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Set when a provider request's result is no longer wanted, e.g. a hedged
+// attempt that lost the race. Providers check cancelled() between reads;
+// a blocking call registers an interrupt (closing its socket, waking its
+// wait) for the duration of the call, and cancel() runs it.
+class CancelSignal
+{
+public:
+    void cancel()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (cancelled_.exchange(true, std::memory_order_acq_rel))
+            return;
+        for (const auto &interrupt : interrupts_)
+            interrupt();
+    }
+
+    bool cancelled() const { return cancelled_.load(std::memory_order_acquire); }
+
+    // Registers `interrupt` until it goes out of scope. cancel() never runs
+    // it after the destructor returned, so it may reference the caller's
+    // stack (and a pooled connection that is about to be handed back).
+    class Interrupt
+    {
+    public:
+        Interrupt(CancelSignal *signal, std::function<void()> interrupt) : signal_(signal)
+        {
+            if (!signal_)
+                return;
+            std::lock_guard<std::mutex> lock(signal_->mutex_);
+            if (signal_->cancelled())
+            {
+                interrupt();
+                signal_ = nullptr;
+                return;
+            }
+            position_ = signal_->interrupts_.insert(signal_->interrupts_.end(), std::move(interrupt));
+        }
+        ~Interrupt()
+        {
+            if (!signal_)
+                return;
+            std::lock_guard<std::mutex> lock(signal_->mutex_);
+            signal_->interrupts_.erase(position_);
+        }
+        Interrupt(const Interrupt &) = delete;
+        Interrupt &operator=(const Interrupt &) = delete;
+
+    private:
+        CancelSignal *signal_;
+        std::list<std::function<void()>>::iterator position_;
+    };
+
+    // The signal of the provider call running on this thread, if any. Lets
+    // code reached through a Lua script (native_http, the execution budget)
+    // see it without every script passing it along.
+    static const std::shared_ptr<CancelSignal> &current() { return current_; }
+
+    class Bind
+    {
+    public:
+        explicit Bind(std::shared_ptr<CancelSignal> signal) : previous_(std::move(current_)) { current_ = std::move(signal); }
+        ~Bind() { current_ = std::move(previous_); }
+        Bind(const Bind &) = delete;
+        Bind &operator=(const Bind &) = delete;
+
+    private:
+        std::shared_ptr<CancelSignal> previous_;
+    };
+
+private:
+    std::mutex mutex_;
+    std::atomic<bool> cancelled_{false};
+    std::list<std::function<void()>> interrupts_;
+    static inline thread_local std::shared_ptr<CancelSignal> current_;
+};
@@ -0,0 +1,261 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <deps/json.hpp>
+#include "provider/native_provider.h"
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+
+// Record/replay of provider interactions, for benchmarks that shouldn't
+// depend on a live backend. In record mode every request goes to the
+// provider as usual and is appended to a JSON-lines file with its result
+// and the arrival time of each streamed chunk. In replay mode nothing is
+// sent: the recorded chunks are played back on their original schedule,
+// scaled by `speed` (0.5 = twice as fast, 0 = no delay).
+//
+// A replayed request gets the next recording of the same provider and
+// input (cycling when they run out), or else the provider's next
+// recording of any input, so generated benchmark traffic still finds one.
+//
+//   {"provider": "ollama", "input": "...", "total_ms": 812.4,
+//    "chunks": [[231.0, "Hello"], [260.2, " there"]],
+//    "result": {"success": true, "response": "...", "metadata": {...}, "error": ""}}
+class Cassette
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using ChunkCallback = std::function<bool(const std::string &)>;
+    using Live = std::function<ProviderResult(const ChunkCallback &)>;
+
+    enum class Mode
+    {
+        Record,
+        Replay
+    };
+
+    struct Stats
+    {
+        Mode mode;
+        size_t entries;
+        uint64_t recorded;
+        uint64_t replayed;
+        uint64_t misses;
+    };
+
+    Cassette(Mode mode, std::filesystem::path path, double speed)
+        : mode_(mode), path_(std::move(path)), speed_(speed)
+    {
+        if (mode_ == Mode::Replay)
+            load();
+    }
+
+    Mode mode() const { return mode_; }
+
+    ProviderResult run(const std::string &provider, const std::string &input, const ChunkCallback &on_chunk,
+                       const std::optional<Clock::time_point> &deadline, const Live &live)
+    {
+        return mode_ == Mode::Replay ? replay(provider, input, on_chunk, deadline) : record(provider, input, on_chunk, live);
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{
+            .mode = mode_,
+            .entries = entries_.size(),
+            .recorded = recorded_,
+            .replayed = replayed_,
+            .misses = misses_};
+    }
+
+private:
+    struct Entry
+    {
+        std::string provider;
+        std::string input;
+        std::vector<std::pair<double, std::string>> chunks;
+        double total_ms = 0;
+        ProviderResult result{false, "", json::object(), ""};
+    };
+
+    static std::string key(const std::string &provider, const std::string &input)
+    {
+        return provider + '\n' + input;
+    }
+
+    void load()
+    {
+        std::ifstream file(path_);
+        if (!file.is_open())
+        {
+            LOG_WARNING << "Provider cassette " << path_.string() << " not found; every replay will miss";
+            return;
+        }
+        std::string line;
+        while (std::getline(file, line))
+        {
+            auto record = json::parse(line, nullptr, false);
+            if (record.is_discarded() || !record.is_object())
+                continue;
+            Entry entry;
+            entry.provider = record.value("provider", "");
+            entry.input = record.value("input", "");
+            entry.total_ms = record.value("total_ms", 0.0);
+            for (const auto &chunk : record.value("chunks", json::array()))
+            {
+                if (chunk.is_array() && chunk.size() == 2)
+                    entry.chunks.emplace_back(chunk[0].get<double>(), chunk[1].get<std::string>());
+            }
+            const auto result = record.value("result", json::object());
+            entry.result = {
+                result.value("success", false),
+                result.value("response", ""),
+                result.value("metadata", json::object()),
+                result.value("error", "")};
+
+            const size_t index = entries_.size();
+            by_input_[key(entry.provider, entry.input)].indices.push_back(index);
+            by_provider_[entry.provider].indices.push_back(index);
+            entries_.push_back(std::move(entry));
+        }
+        LOG_INFO << "Loaded " << entries_.size() << " provider recordings from " << path_.string();
+    }
+
+    ProviderResult record(const std::string &provider, const std::string &input, const ChunkCallback &on_chunk, const Live &live)
+    {
+        const auto started = Clock::now();
+        json chunks = json::array();
+        ChunkCallback timed;
+        if (on_chunk)
+        {
+            timed = [&](const std::string &chunk)
+            {
+                chunks.push_back({elapsed_ms(started), chunk});
+                return on_chunk(chunk);
+            };
+        }
+        auto result = live(timed);
+
+        json record = {
+            {"provider", provider},
+            {"input", input},
+            {"total_ms", elapsed_ms(started)},
+            {"chunks", std::move(chunks)},
+            {"result", {
+                {"success", result.success},
+                {"response", result.response},
+                {"metadata", result.metadata},
+                {"error", result.error}}}};
+        const auto line = record.dump(-1, ' ', false, json::error_handler_t::replace);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!out_.is_open())
+        {
+            if (path_.has_parent_path())
+                std::filesystem::create_directories(path_.parent_path());
+            out_.open(path_, std::ios::app);
+        }
+        out_ << line << '\n';
+        out_.flush();
+        recorded_++;
+        return result;
+    }
+
+    ProviderResult replay(const std::string &provider, const std::string &input, const ChunkCallback &on_chunk,
+                          const std::optional<Clock::time_point> &deadline)
+    {
+        const Entry *entry = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto exact = by_input_.find(key(provider, input));
+            if (exact != by_input_.end())
+            {
+                entry = &entries_[exact->second.next()];
+            }
+            else if (auto any = by_provider_.find(provider); any != by_provider_.end())
+            {
+                entry = &entries_[any->second.next()];
+            }
+            if (!entry)
+            {
+                misses_++;
+                return {false, "", {}, "No recording for provider " + provider};
+            }
+            replayed_++;
+        }
+
+        // Entries are never modified after load, so no lock from here on
+        const auto started = Clock::now();
+        auto wait_until = [&](double offset_ms)
+        {
+            auto at = started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(offset_ms * speed_));
+            if (deadline && *deadline < at)
+            {
+                std::this_thread::sleep_until(*deadline);
+                return false;
+            }
+            std::this_thread::sleep_until(at);
+            return true;
+        };
+        auto expired = []()
+        {
+            ProviderResult result{false, "", {}, "Deadline exceeded"};
+            result.deadline_exceeded = true;
+            return result;
+        };
+
+        if (on_chunk)
+        {
+            for (const auto &[offset_ms, chunk] : entry->chunks)
+            {
+                if (!wait_until(offset_ms))
+                    return expired();
+                if (!on_chunk(chunk))
+                    break;
+            }
+        }
+        if (!wait_until(entry->total_ms))
+            return expired();
+        return entry->result;
+    }
+
+    static double elapsed_ms(Clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    struct Cursor
+    {
+        std::vector<size_t> indices;
+        size_t position = 0;
+
+        size_t next()
+        {
+            return indices[position++ % indices.size()];
+        }
+    };
+
+    const Mode mode_;
+    const std::filesystem::path path_;
+    const double speed_;
+
+    mutable std::mutex mutex_;
+    std::vector<Entry> entries_;
+    std::unordered_map<std::string, Cursor> by_input_;
+    std::unordered_map<std::string, Cursor> by_provider_;
+    std::ofstream out_;
+    uint64_t recorded_ = 0;
+    uint64_t replayed_ = 0;
+    uint64_t misses_ = 0;
+};
@@ -0,0 +1,191 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deps/json.hpp>
+#include "provider/lua_bridge.h"
+#include "provider/stream_decoder.h"
+
+using json = nlohmann::json;
+
+// Streaming half of the provider contract, passed to handlers as
+// params.sink when the caller consumes tokens as they arrive. A handler
+// either emits text deltas itself (sink:emit) or declares the wire format
+// (sink:decode("ndjson" | "sse", "path.to.delta")) and feeds raw body bytes
+// with sink:write; the framing and JSON parsing then happen here, in C++.
+//
+//   sink:write(bytes) / sink:emit(text) -> false once reading should stop
+//   sink:finish()       flushes a trailing unterminated event
+//   sink:content()      everything emitted so far
+//   sink:last_event()   last decoded event as a table (final stats etc.)
+//   sink:error()        "error" field of a decoded event, if any
+class ChunkSink
+{
+public:
+    using ChunkCallback = std::function<bool(const std::string &)>;
+
+    explicit ChunkSink(ChunkCallback on_chunk) : on_chunk_(std::move(on_chunk)) {}
+
+    // Returns false for an unknown format
+    bool decode(const std::string &format, const std::string &delta_path)
+    {
+        if (format == "ndjson")
+            format_ = Format::Ndjson;
+        else if (format == "sse")
+            format_ = Format::Sse;
+        else
+            return false;
+
+        path_.clear();
+        size_t start = 0;
+        while (start <= delta_path.size())
+        {
+            auto dot = delta_path.find('.', start);
+            if (dot == std::string::npos)
+                dot = delta_path.size();
+            if (dot > start)
+                path_.push_back(delta_path.substr(start, dot - start));
+            start = dot + 1;
+        }
+        return true;
+    }
+
+    bool write(std::string_view bytes)
+    {
+        if (!accepting())
+            return false;
+        switch (format_)
+        {
+        case Format::Ndjson:
+            lines_.feed(bytes, [this](std::string_view line) { return on_event(line); });
+            break;
+        case Format::Sse:
+            sse_.feed(bytes, [this](std::string_view payload) { return on_event(payload); });
+            break;
+        case Format::Raw:
+            emit(std::string(bytes));
+            break;
+        }
+        return accepting();
+    }
+
+    bool emit(const std::string &text)
+    {
+        if (!accepting())
+            return false;
+        if (text.empty())
+            return true;
+        content_ += text;
+        if (on_chunk_ && !on_chunk_(text))
+            stopped_ = true;
+        return accepting();
+    }
+
+    bool finish()
+    {
+        if (format_ == Format::Ndjson)
+            lines_.finish([this](std::string_view line) { return on_event(line); });
+        else if (format_ == Format::Sse)
+            sse_.finish([this](std::string_view payload) { return on_event(payload); });
+        return accepting();
+    }
+
+    const std::string &content() const { return content_; }
+    const json &last_event() const { return last_event_; }
+    const std::string &error() const { return error_; }
+    bool stopped() const { return stopped_; }
+    bool done() const { return sse_.done(); }
+
+    static void open(sol::state &lua)
+    {
+        lua.new_usertype<ChunkSink>(
+            "ChunkSink", sol::no_constructor,
+            "decode", &ChunkSink::decode,
+            "write", [](ChunkSink &self, std::string_view bytes) { return self.write(bytes); },
+            "emit", &ChunkSink::emit,
+            "finish", &ChunkSink::finish,
+            "content", &ChunkSink::content,
+            "stopped", &ChunkSink::stopped,
+            "done", &ChunkSink::done,
+            "last_event", [](const ChunkSink &self, sol::this_state state)
+            { return lua_bridge::json_to_lua(state, self.last_event()); },
+            "error", [](const ChunkSink &self, sol::this_state state)
+            { return self.error_.empty() ? sol::object(sol::lua_nil) : sol::make_object(state, self.error_); });
+    }
+
+private:
+    enum class Format
+    {
+        Raw,
+        Ndjson,
+        Sse
+    };
+
+    bool accepting() const
+    {
+        return !stopped_ && error_.empty() && !sse_.done();
+    }
+
+    bool on_event(std::string_view payload)
+    {
+        if (payload.empty())
+            return true;
+        auto event = json::parse(payload, nullptr, false);
+        if (event.is_discarded())
+            return true;
+
+        if (event.is_object() && event.contains("error") && !event["error"].is_null())
+        {
+            const auto &error = event["error"];
+            if (error.is_string())
+                error_ = error.get<std::string>();
+            else if (error.is_object() && error.contains("message") && error["message"].is_string())
+                error_ = error["message"].get<std::string>();
+            else
+                error_ = error.dump();
+            return false;
+        }
+
+        const json *node = &event;
+        for (const auto &key : path_)
+        {
+            if (node->is_array())
+            {
+                const size_t index = std::strtoul(key.c_str(), nullptr, 10);
+                if (index >= node->size())
+                {
+                    node = nullptr;
+                    break;
+                }
+                node = &(*node)[index];
+            }
+            else if (node->is_object() && node->contains(key))
+            {
+                node = &(*node)[key];
+            }
+            else
+            {
+                node = nullptr;
+                break;
+            }
+        }
+
+        std::string delta = node && node->is_string() ? node->get<std::string>() : std::string();
+        last_event_ = std::move(event);
+        return emit(delta);
+    }
+
+    ChunkCallback on_chunk_;
+    Format format_ = Format::Raw;
+    std::vector<std::string> path_;
+    LineDecoder lines_;
+    SseDecoder sse_;
+    std::string content_;
+    json last_event_;
+    std::string error_;
+    bool stopped_ = false;
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// Runs callbacks at their deadlines on one shared thread, for blocking calls
+// that can only be cut short from outside, e.g. httplib's send() via stop().
+//
+//   DeadlineTimer::Scope expiry(deadline, [&client] { client->stop(); });
+//   client->send(request);
+class DeadlineTimer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static DeadlineTimer &getInstance()
+    {
+        static DeadlineTimer instance;
+        return instance;
+    }
+
+    // Armed for its lifetime; no deadline, no timer. The callback never
+    // runs after the destructor returned, so it may reference the caller's
+    // stack.
+    class Scope
+    {
+    public:
+        Scope(const std::optional<Clock::time_point> &at, std::function<void()> callback)
+        {
+            if (at)
+                key_ = getInstance().add(*at, std::move(callback));
+        }
+        ~Scope()
+        {
+            if (key_)
+                getInstance().remove(*key_);
+        }
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        std::optional<std::pair<Clock::time_point, uint64_t>> key_;
+    };
+
+    ~DeadlineTimer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        condition_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+    }
+
+private:
+    using Key = std::pair<Clock::time_point, uint64_t>;
+
+    DeadlineTimer() = default;
+
+    Key add(Clock::time_point at, std::function<void()> callback)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Key key{at, next_id_++};
+        timers_.emplace(key, std::move(callback));
+        if (!thread_.joinable())
+            thread_ = std::thread(&DeadlineTimer::run, this);
+        condition_.notify_all();
+        return key;
+    }
+
+    void remove(const Key &key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        timers_.erase(key);
+    }
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_)
+        {
+            if (timers_.empty())
+            {
+                condition_.wait(lock);
+                continue;
+            }
+            auto next = timers_.begin();
+            if (Clock::now() < next->first.first)
+            {
+                condition_.wait_until(lock, next->first.first);
+                continue;
+            }
+            // Under mutex_, so remove() waits for a callback in progress
+            auto callback = std::move(next->second);
+            timers_.erase(next);
+            callback();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::map<Key, std::function<void()>> timers_;
+    uint64_t next_id_ = 0;
+    bool stopping_ = false;
+    std::thread thread_;
+};
@@ -0,0 +1,283 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <deps/json.hpp>
+
+using json = nlohmann::json;
+
+// Per-provider concurrency cap with weighted fair queueing. Requests over
+// the cap wait in one of two classes: live call turns always go before
+// batch work (REST /think, history summaries). Within a class, tenants
+// share slots in proportion to their weight (start-time fair queueing), so
+// one tenant's burst queues behind its own earlier requests instead of
+// everyone else's.
+//
+// Limits come from the provider's config file:
+//   "limits": {"max_concurrency": 4, "max_queue": 64}
+// max_concurrency 0 (the default) means unlimited.
+class FairLimiter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Priority
+    {
+        Live = 0,
+        Batch = 1
+    };
+
+    struct Limits
+    {
+        size_t max_concurrency = 0;
+        size_t max_queue = 256;
+
+        static Limits from_json(const json &limits)
+        {
+            Limits result;
+            result.max_concurrency = limits.value("max_concurrency", result.max_concurrency);
+            result.max_queue = limits.value("max_queue", result.max_queue);
+            return result;
+        }
+    };
+
+    struct Stats
+    {
+        std::string provider;
+        size_t max_concurrency;
+        size_t in_use;
+        size_t queued;
+        uint64_t granted;
+        uint64_t rejected;
+        // Queue wait per class, indexed by Priority
+        std::array<double, 2> wait_ms_total;
+        std::array<double, 2> wait_ms_max;
+    };
+
+    // A slot; handed to the next waiter when destroyed
+    class Permit
+    {
+    public:
+        Permit(FairLimiter *limiter, std::string provider) : limiter_(limiter), provider_(std::move(provider)) {}
+        Permit(Permit &&other) noexcept : limiter_(other.limiter_), provider_(std::move(other.provider_))
+        {
+            other.limiter_ = nullptr;
+        }
+        Permit &operator=(Permit &&other) noexcept
+        {
+            if (this != &other)
+            {
+                reset();
+                limiter_ = other.limiter_;
+                provider_ = std::move(other.provider_);
+                other.limiter_ = nullptr;
+            }
+            return *this;
+        }
+        Permit(const Permit &) = delete;
+        Permit &operator=(const Permit &) = delete;
+
+        ~Permit()
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            if (limiter_)
+                limiter_->release(provider_);
+            limiter_ = nullptr;
+        }
+
+    private:
+        FairLimiter *limiter_;
+        std::string provider_;
+    };
+
+    using Grant = std::function<void(Permit)>;
+
+    void configure(const std::string &provider, const Limits &limits)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        providers_[provider].limits = limits;
+    }
+
+    // Calls on_grant right away when a slot is free, otherwise later on the
+    // thread that frees one. Returns false, without calling it, when the
+    // provider's queue is full.
+    bool acquire_async(const std::string &provider, const std::string &tenant, double weight, Priority priority, Grant on_grant)
+    {
+        std::optional<Ticket> queued;
+        return enqueue(provider, tenant, weight, priority, std::move(on_grant), queued);
+    }
+
+    // Blocks until a slot is free; nullopt when the queue is full or the
+    // deadline passes first. A waiter that times out leaves the queue; if its
+    // slot was being granted at that moment, the slot is handed straight on.
+    std::optional<Permit> acquire(const std::string &provider, const std::string &tenant, double weight, Priority priority,
+                                  const std::optional<Clock::time_point> &deadline = std::nullopt)
+    {
+        auto granted = std::make_shared<std::promise<Permit>>();
+        auto permit = granted->get_future();
+        std::optional<Ticket> queued;
+        if (!enqueue(provider, tenant, weight, priority, [granted](Permit slot) { granted->set_value(std::move(slot)); }, queued))
+        {
+            return std::nullopt;
+        }
+        if (queued && deadline && permit.wait_until(*deadline) == std::future_status::timeout)
+        {
+            if (!withdraw(provider, *queued))
+            {
+                // Lost the race with release(); the grant is under way
+                permit.get();
+            }
+            return std::nullopt;
+        }
+        return permit.get();
+    }
+
+    std::vector<Stats> stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Stats> result;
+        for (const auto &[provider, state] : providers_)
+        {
+            Stats stats{
+                .provider = provider,
+                .max_concurrency = state.limits.max_concurrency,
+                .in_use = state.in_use,
+                .queued = state.queued(),
+                .granted = state.granted,
+                .rejected = state.rejected,
+                .wait_ms_total = {},
+                .wait_ms_max = {}};
+            for (size_t i = 0; i < state.classes.size(); i++)
+            {
+                stats.wait_ms_total[i] = state.classes[i].wait_ms_total;
+                stats.wait_ms_max[i] = state.classes[i].wait_ms_max;
+            }
+            result.push_back(std::move(stats));
+        }
+        return result;
+    }
+
+private:
+    struct Waiter
+    {
+        Clock::time_point enqueued;
+        Grant grant;
+    };
+
+    // Where a queued request waits, to take it out again
+    struct Ticket
+    {
+        Priority priority;
+        std::pair<double, uint64_t> key;
+    };
+
+    // Sets `queued` when the request had to wait
+    bool enqueue(const std::string &provider, const std::string &tenant, double weight, Priority priority, Grant on_grant,
+                 std::optional<Ticket> &queued)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &state = providers_[provider];
+            const bool limited = state.limits.max_concurrency > 0;
+            if (limited && state.in_use >= state.limits.max_concurrency)
+            {
+                if (state.queued() >= state.limits.max_queue)
+                {
+                    state.rejected++;
+                    return false;
+                }
+                auto &queue = state.classes[static_cast<size_t>(priority)];
+                // Finish tag of this request: after the tenant's previous one,
+                // and no earlier than the work already served
+                auto &finish = queue.finish[tenant];
+                const double tag = std::max(queue.virtual_time, finish) + 1.0 / std::max(weight, 0.01);
+                finish = tag;
+                const auto key = std::make_pair(tag, next_seq_++);
+                queue.waiting.emplace(key, Waiter{Clock::now(), std::move(on_grant)});
+                queued = Ticket{priority, key};
+                return true;
+            }
+            state.in_use++;
+            state.granted++;
+        }
+        on_grant(Permit(this, provider));
+        return true;
+    }
+
+    // False when the request already left the queue (its slot is granted)
+    bool withdraw(const std::string &provider, const Ticket &ticket)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &queue = providers_[provider].classes[static_cast<size_t>(ticket.priority)];
+        return queue.waiting.erase(ticket.key) > 0;
+    }
+
+    struct Queue
+    {
+        // Ordered by (finish tag, arrival)
+        std::map<std::pair<double, uint64_t>, Waiter> waiting;
+        std::unordered_map<std::string, double> finish;
+        double virtual_time = 0;
+        double wait_ms_total = 0;
+        double wait_ms_max = 0;
+    };
+
+    struct State
+    {
+        Limits limits;
+        size_t in_use = 0;
+        std::array<Queue, 2> classes;
+        uint64_t granted = 0;
+        uint64_t rejected = 0;
+
+        size_t queued() const
+        {
+            return classes[0].waiting.size() + classes[1].waiting.size();
+        }
+    };
+
+    void release(const std::string &provider)
+    {
+        Grant grant;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &state = providers_[provider];
+            state.in_use--;
+            for (auto &queue : state.classes)
+            {
+                if (queue.waiting.empty())
+                    continue;
+                auto next = queue.waiting.begin();
+                queue.virtual_time = next->first.first;
+                const double waited = std::chrono::duration<double, std::milli>(Clock::now() - next->second.enqueued).count();
+                queue.wait_ms_total += waited;
+                queue.wait_ms_max = std::max(queue.wait_ms_max, waited);
+                grant = std::move(next->second.grant);
+                queue.waiting.erase(next);
+                state.in_use++;
+                state.granted++;
+                break;
+            }
+        }
+        if (grant)
+            grant(Permit(this, provider));
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, State> providers_;
+    uint64_t next_seq_ = 0;
+};
@@ -0,0 +1,157 @@
+#pragma once
+#include "deps/httplib.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Keep-alive httplib clients grouped by scheme://host:port. A client serves
+// one request at a time, so each request leases one and hands it back; the
+// next request to the same host reuses its open connection (and TLS session).
+class HttpClientPool
+{
+public:
+    struct Timeouts
+    {
+        time_t connect_sec = 5;
+        time_t read_sec = 60;
+        time_t write_sec = 10;
+    };
+
+    struct Stats
+    {
+        size_t hosts;
+        size_t idle;
+        uint64_t created;
+        uint64_t reused;
+        uint64_t discarded;
+    };
+
+    class Lease
+    {
+    public:
+        Lease(HttpClientPool *pool, std::string origin, std::unique_ptr<httplib::Client> client)
+            : pool_(pool), origin_(std::move(origin)), client_(std::move(client)) {}
+        Lease(Lease &&) = default;
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        ~Lease()
+        {
+            if (pool_ && client_)
+                pool_->release(origin_, std::move(client_), reusable_);
+        }
+
+        httplib::Client &operator*() const { return *client_; }
+        httplib::Client *operator->() const { return client_.get(); }
+
+        // The connection is in an unknown state (cancelled read, transport
+        // error); close it instead of returning it to the pool
+        void discard() { reusable_ = false; }
+
+    private:
+        HttpClientPool *pool_;
+        std::string origin_;
+        std::unique_ptr<httplib::Client> client_;
+        bool reusable_ = true;
+    };
+
+    static HttpClientPool &getInstance()
+    {
+        static HttpClientPool instance;
+        return instance;
+    }
+
+    HttpClientPool(const HttpClientPool &) = delete;
+    HttpClientPool &operator=(const HttpClientPool &) = delete;
+
+    // "https://api.groq.com/openai/v1" -> {"https://api.groq.com", "/openai/v1"}
+    static std::pair<std::string, std::string> split_url(const std::string &url)
+    {
+        const auto scheme_end = url.find("://");
+        const auto host_start = scheme_end == std::string::npos ? 0 : scheme_end + 3;
+        const auto path_start = url.find('/', host_start);
+        if (path_start == std::string::npos)
+            return {url, ""};
+        std::string path = url.substr(path_start);
+        while (!path.empty() && path.back() == '/')
+            path.pop_back();
+        return {url.substr(0, path_start), path};
+    }
+
+    Lease acquire(const std::string &origin)
+    {
+        return acquire(origin, Timeouts());
+    }
+
+    Lease acquire(const std::string &origin, const Timeouts &timeouts)
+    {
+        std::unique_ptr<httplib::Client> client;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto &idle = idle_[origin];
+            if (!idle.empty())
+            {
+                client = std::move(idle.back());
+                idle.pop_back();
+                reused_++;
+            }
+        }
+        if (!client)
+        {
+            client = std::make_unique<httplib::Client>(origin);
+            client->set_keep_alive(true);
+            std::lock_guard<std::mutex> lock(mutex_);
+            created_++;
+        }
+        client->set_connection_timeout(timeouts.connect_sec);
+        client->set_read_timeout(timeouts.read_sec);
+        client->set_write_timeout(timeouts.write_sec);
+        return Lease(this, origin, std::move(client));
+    }
+
+    void set_max_idle_per_host(size_t count)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        max_idle_per_host_ = count;
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t idle = 0;
+        for (const auto &[origin, clients] : idle_)
+            idle += clients.size();
+        return Stats{
+            .hosts = idle_.size(),
+            .idle = idle,
+            .created = created_,
+            .reused = reused_,
+            .discarded = discarded_};
+    }
+
+private:
+    HttpClientPool() = default;
+
+    void release(const std::string &origin, std::unique_ptr<httplib::Client> client, bool reusable)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &idle = idle_[origin];
+        if (!reusable || !client->is_valid() || idle.size() >= max_idle_per_host_)
+        {
+            discarded_++;
+            return;
+        }
+        idle.push_back(std::move(client));
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<httplib::Client>>> idle_;
+    size_t max_idle_per_host_ = 16;
+    uint64_t created_ = 0;
+    uint64_t reused_ = 0;
+    uint64_t discarded_ = 0;
+};
@@ -0,0 +1,239 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <deps/json.hpp>
+
+using json = nlohmann::json;
+
+// Conversions between nlohmann::json and Lua values, shared by the provider
+// manager and the C++ objects handed to provider scripts.
+namespace lua_bridge
+{
+    inline sol::object json_to_lua(sol::state_view lua, const json &j);
+
+    // Read-only proxy for a json node. Scalars are converted when indexed;
+    // objects and arrays come back as further views sharing the same root,
+    // so a script only pays for the parts of a request it actually reads.
+    // Supports t.key, t[i] (1-based), #t, pairs(t) and ipairs(t).
+    //
+    // A view either shares ownership of its root, or borrows json owned by
+    // the caller for as long as a scope token lives; using a borrowed view
+    // after that raises a Lua error instead of reading freed memory.
+    class JsonView
+    {
+    public:
+        JsonView(std::shared_ptr<const json> root, std::weak_ptr<const void> scope, const json *node)
+            : root_(std::move(root)), scope_(std::move(scope)), node_(node) {}
+
+        // Scalars become Lua values, containers become views
+        static sol::object wrap(sol::state_view lua, const std::shared_ptr<const json> &root, const json &node)
+        {
+            return wrap(lua, root, {}, node);
+        }
+
+        static sol::object wrap(sol::state_view lua, json value)
+        {
+            auto root = std::make_shared<const json>(std::move(value));
+            return wrap(lua, root, *root);
+        }
+
+        // No copy: valid until `scope` expires
+        static sol::object borrow(sol::state_view lua, const std::weak_ptr<const void> &scope, const json &node)
+        {
+            return wrap(lua, nullptr, scope, node);
+        }
+
+        const json &node() const
+        {
+            if (!root_ && scope_.expired())
+                throw sol::error("JsonView used after its request returned");
+            return *node_;
+        }
+
+        sol::object index(const sol::object &key, sol::this_state state) const
+        {
+            sol::state_view lua(state);
+            const json &node = this->node();
+            if (node.is_array() && key.get_type() == sol::type::number)
+            {
+                const auto position = key.as<int64_t>();
+                if (position < 1 || static_cast<size_t>(position) > node.size())
+                    return sol::lua_nil;
+                return wrap(lua, root_, scope_, node[static_cast<size_t>(position - 1)]);
+            }
+            if (node.is_object() && key.get_type() == sol::type::string)
+            {
+                auto it = node.find(key.as<std::string>());
+                if (it == node.end())
+                    return sol::lua_nil;
+                return wrap(lua, root_, scope_, *it);
+            }
+            return sol::lua_nil;
+        }
+
+        size_t length() const
+        {
+            const json &node = this->node();
+            return node.is_array() ? node.size() : 0;
+        }
+
+        // Stateful iterator for __pairs: array entries as (i, value), object
+        // entries as (key, value)
+        sol::object pairs(sol::this_state state) const
+        {
+            struct Cursor
+            {
+                JsonView view;
+                json::const_iterator it;
+                size_t position;
+            };
+            auto cursor = std::make_shared<Cursor>(Cursor{*this, node().cbegin(), 0});
+            auto next = [cursor](sol::this_state state) -> std::tuple<sol::object, sol::object>
+            {
+                sol::state_view lua(state);
+                if (cursor->it == cursor->view.node().cend())
+                    return {sol::lua_nil, sol::lua_nil};
+                const auto &value = *cursor->it;
+                sol::object key = cursor->view.node_->is_array()
+                                      ? sol::make_object(lua, static_cast<int64_t>(cursor->position + 1))
+                                      : sol::make_object(lua, cursor->it.key());
+                ++cursor->it;
+                ++cursor->position;
+                return {key, wrap(lua, cursor->view.root_, cursor->view.scope_, value)};
+            };
+            return sol::make_object(state, next);
+        }
+
+        static void open(sol::state &lua)
+        {
+            lua.new_usertype<JsonView>(
+                "JsonView", sol::no_constructor,
+                sol::meta_function::index, &JsonView::index,
+                sol::meta_function::new_index, [](const JsonView &, const sol::object &, const sol::object &)
+                { throw sol::error("JsonView is read-only"); },
+                sol::meta_function::length, &JsonView::length,
+                sol::meta_function::pairs, [](const JsonView &self, sol::this_state state)
+                { return std::make_tuple(self.pairs(state), sol::lua_nil, sol::lua_nil); });
+
+            // Helpers that can't be methods without shadowing json keys
+            lua["package"]["preload"]["json_view"] = [](sol::this_state state)
+            {
+                sol::state_view lua(state);
+                sol::table module = lua.create_table();
+                module["is_view"] = [](const sol::object &value) { return value.is<JsonView>(); };
+                // Deep copy into plain Lua tables (e.g. before cjson.encode)
+                module["totable"] = [](const sol::object &value, sol::this_state state)
+                {
+                    return value.is<JsonView>() ? json_to_lua(state, value.as<const JsonView &>().node()) : value;
+                };
+                // Serializes a view straight from C++
+                module["encode"] = [](const JsonView &view) { return view.node().dump(); };
+                return module;
+            };
+        }
+
+    private:
+        static sol::object wrap(sol::state_view lua, const std::shared_ptr<const json> &root,
+                                const std::weak_ptr<const void> &scope, const json &node)
+        {
+            if (node.is_object() || node.is_array())
+                return sol::make_object(lua, JsonView(root, scope, &node));
+            return json_to_lua(lua, node);
+        }
+
+        std::shared_ptr<const json> root_;
+        std::weak_ptr<const void> scope_;
+        const json *node_;
+    };
+
+    inline sol::object json_to_lua(sol::state_view lua, const json &j)
+    {
+        switch (j.type())
+        {
+        case json::value_t::boolean:
+            return sol::make_object(lua, j.get<bool>());
+        case json::value_t::number_integer:
+            return sol::make_object(lua, j.get<int64_t>());
+        case json::value_t::number_unsigned:
+            return sol::make_object(lua, static_cast<int64_t>(j.get<uint64_t>()));
+        case json::value_t::number_float:
+            return sol::make_object(lua, j.get<double>());
+        case json::value_t::string:
+            return sol::make_object(lua, j.get_ref<const std::string &>());
+        case json::value_t::array:
+        {
+            sol::table arr = lua.create_table(static_cast<int>(j.size()), 0);
+            for (size_t i = 0; i < j.size(); i++)
+            {
+                arr[i + 1] = json_to_lua(lua, j[i]);
+            }
+            return arr;
+        }
+        case json::value_t::object:
+        {
+            sol::table obj = lua.create_table(0, static_cast<int>(j.size()));
+            for (auto &[key, value] : j.items())
+            {
+                obj[key] = json_to_lua(lua, value);
+            }
+            return obj;
+        }
+        default:
+            return sol::nil;
+        }
+    }
+
+    // One type switch per value; integers stay integers, and views handed
+    // back by the script are copied from their node without touching Lua.
+    inline json lua_to_json(const sol::object &obj)
+    {
+        switch (obj.get_type())
+        {
+        case sol::type::boolean:
+            return obj.as<bool>();
+        case sol::type::number:
+        {
+            lua_State *L = obj.lua_state();
+            obj.push();
+            json number = lua_isinteger(L, -1) ? json(static_cast<int64_t>(lua_tointeger(L, -1)))
+                                               : json(static_cast<double>(lua_tonumber(L, -1)));
+            lua_pop(L, 1);
+            return number;
+        }
+        case sol::type::string:
+            return obj.as<std::string>();
+        case sol::type::userdata:
+            if (obj.is<JsonView>())
+                return obj.as<const JsonView &>().node();
+            return json();
+        case sol::type::table:
+        {
+            sol::table table = obj;
+            const size_t size = table.size();
+            if (size > 0)
+            { // Array
+                json arr = json::array();
+                for (size_t i = 1; i <= size; i++)
+                {
+                    arr.push_back(lua_to_json(table[i]));
+                }
+                return arr;
+            }
+            // Object
+            json result = json::object();
+            table.for_each([&](const sol::object &key, const sol::object &value)
+                           {
+                               if (key.get_type() == sol::type::string)
+                                   result[key.as<std::string>()] = lua_to_json(value);
+                               else
+                                   result[lua_to_json(key).dump()] = lua_to_json(value);
+                           });
+            return result;
+        }
+        default:
+            return json();
+        }
+    }
+}
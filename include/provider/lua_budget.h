@@ -0,0 +1,97 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <chrono>
+#include <optional>
+#include "provider/cancel_signal.h"
+
+// Execution budget for provider scripts. A count hook runs every
+// HOOK_INTERVAL instructions and raises "deadline exceeded" in a thread that
+// is past its deadline, so a runaway script can't hold a Lua state (or its
+// caller) forever. Coroutines inherit the hook from the thread that creates
+// them, and each one arms its own deadline; a thread that was never armed
+// runs unchecked.
+//
+// Time spent blocked inside C++ (a native_http read) doesn't run the hook;
+// those calls take their own deadline. Neither does a coroutine suspended on
+// the event loop: ProviderEventLoop fails it at its deadline.
+//
+// The hook also stops a blocking call's script once the call's CancelSignal
+// (CancelSignal::current()) is cancelled.
+class LuaBudget
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int HOOK_INTERVAL = 10000;
+
+    // Installs the hook on the state's main thread and registers
+    // provider_arm_deadline(remaining_ms) for coroutines. Without a
+    // remaining time, default_budget is used.
+    static void open(sol::state &lua, std::chrono::milliseconds default_budget)
+    {
+        lua_State *L = lua.lua_state();
+        // thread -> deadline in steady-clock ms; weak keys so finished
+        // coroutines can be collected
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushliteral(L, "k");
+        lua_setfield(L, -2, "__mode");
+        lua_setmetatable(L, -2);
+        lua_rawsetp(L, LUA_REGISTRYINDEX, &deadlines_key);
+        lua_sethook(L, &hook, LUA_MASKCOUNT, HOOK_INTERVAL);
+
+        lua["provider_arm_deadline"] = [default_budget](sol::this_state state, sol::optional<double> remaining_ms)
+        {
+            const auto budget = remaining_ms
+                                    ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(*remaining_ms))
+                                    : std::chrono::duration_cast<Clock::duration>(default_budget);
+            arm(state, Clock::now() + budget);
+        };
+    }
+
+    // Arms the deadline of the thread L (the one running the current call)
+    static void arm(lua_State *L, Clock::time_point deadline)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &deadlines_key);
+        lua_pushthread(L);
+        lua_pushnumber(L, to_ms(deadline));
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+    }
+
+    static void disarm(lua_State *L)
+    {
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &deadlines_key);
+        lua_pushthread(L);
+        lua_pushnil(L);
+        lua_rawset(L, -3);
+        lua_pop(L, 1);
+    }
+
+private:
+    static double to_ms(Clock::time_point time)
+    {
+        return std::chrono::duration<double, std::milli>(time.time_since_epoch()).count();
+    }
+
+    static void hook(lua_State *L, lua_Debug *)
+    {
+        const auto &cancel = CancelSignal::current();
+        if (cancel && cancel->cancelled())
+        {
+            luaL_error(L, "cancelled");
+        }
+        lua_rawgetp(L, LUA_REGISTRYINDEX, &deadlines_key);
+        lua_pushthread(L);
+        lua_rawget(L, -2);
+        const bool armed = lua_isnumber(L, -1);
+        const double deadline = armed ? lua_tonumber(L, -1) : 0;
+        lua_pop(L, 2);
+        if (armed && to_ms(Clock::now()) > deadline)
+        {
+            luaL_error(L, "deadline exceeded");
+        }
+    }
+
+    static inline const char deadlines_key = 0;
+};
@@ -0,0 +1,436 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <tuple>
+#include "provider/cancel_signal.h"
+#include "provider/deadline_timer.h"
+#include "provider/http_client_pool.h"
+
+// `require "native_http"` in provider scripts: HTTP over the shared
+// HttpClientPool (per-origin keep-alive connections) instead of opening a
+// fresh lua-http connection per request.
+//
+//   local res, err = native_http.request{ url = ..., method = "POST",
+//       headers = {...}, body = "...", timeout = 60, connect_timeout = 5,
+//       deadline = 30 }   -- seconds for the whole exchange, body included
+//   -- res.status, res.headers, res.body
+//
+//   local stream, err = native_http.stream{ ... }
+//   -- stream:status(), stream:headers(), stream:each_chunk(),
+//   -- stream:get_body_as_string(), stream:shutdown()
+//
+//   native_http.ssl -- false when built without https support
+//
+// A request past its deadline has its connection stopped (DeadlineTimer)
+// and fails with "deadline exceeded", however the server trickles bytes.
+// A stream reads on a thread of its own while it is open, so each stream
+// in flight costs an OS thread; its deadline applies to waits on it.
+//
+// The stream methods mirror lua-http's stream so providers can use either.
+class LuaHttp
+{
+public:
+    struct Options
+    {
+        std::string origin;
+        std::string path;
+        std::string method = "GET";
+        httplib::Headers headers;
+        std::string body;
+        HttpClientPool::Timeouts timeouts;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+    };
+
+    // Response body read on a background thread and handed to Lua chunk by
+    // chunk; the reader blocks once max_buffered bytes are waiting.
+    // shutdown() (barge-in, deadline, GC) shuts the socket down under a
+    // reader stuck waiting for the server, so it returns right away. So does
+    // cancelling the provider call that opened the stream.
+    class Stream
+    {
+    public:
+        static constexpr size_t MAX_BUFFERED = 1 << 20;
+
+        explicit Stream(Options options) : options_(std::move(options)) {}
+
+        ~Stream()
+        {
+            shutdown();
+        }
+
+        // Returns once the response headers arrived or the request failed
+        bool start(std::string &error)
+        {
+            cancel_ = CancelSignal::current();
+            cancel_interrupt_ = std::make_unique<CancelSignal::Interrupt>(cancel_.get(), [this]
+                                                                          {
+                                                                              {
+                                                                                  std::lock_guard<std::mutex> lock(mutex_);
+                                                                                  cancelled_ = true;
+                                                                                  if (error_.empty())
+                                                                                      error_ = "cancelled";
+                                                                              }
+                                                                              condition_.notify_all();
+                                                                              interrupt();
+                                                                          });
+            thread_ = std::thread(&Stream::run, this);
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!wait(lock, [this] { return headers_ready_; }))
+            {
+                error = error_;
+                return false;
+            }
+            if (status_ == 0)
+            {
+                error = error_.empty() ? "No response" : error_;
+                return false;
+            }
+            return true;
+        }
+
+        int status() const
+        {
+            return status_;
+        }
+
+        sol::table headers(sol::this_state state) const
+        {
+            sol::state_view lua(state);
+            sol::table table = lua.create_table();
+            for (const auto &[name, value] : headers_)
+            {
+                table[lowercase(name)] = value;
+            }
+            return table;
+        }
+
+        // Next body chunk, or nil at the end of the body
+        sol::object next_chunk(sol::this_state state)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!wait(lock, [this] { return !chunks_.empty() || finished_; }) || chunks_.empty())
+            {
+                return sol::lua_nil;
+            }
+            std::string chunk = std::move(chunks_.front());
+            chunks_.pop_front();
+            buffered_ -= chunk.size();
+            condition_.notify_all();
+            return sol::make_object(state, chunk);
+        }
+
+        std::tuple<sol::object, sol::object> get_body_as_string(sol::this_state state)
+        {
+            std::string body;
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (true)
+            {
+                if (!wait(lock, [this] { return !chunks_.empty() || finished_; }))
+                    break;
+                while (!chunks_.empty())
+                {
+                    body += chunks_.front();
+                    chunks_.pop_front();
+                }
+                buffered_ = 0;
+                condition_.notify_all();
+                if (finished_)
+                    break;
+            }
+            if (!error_.empty())
+            {
+                return {sol::make_object(state, body), sol::make_object(state, error_)};
+            }
+            return {sol::make_object(state, body), sol::lua_nil};
+        }
+
+        // Stops reading; a connection that wasn't read to the end is closed
+        void shutdown()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                cancelled_ = true;
+            }
+            condition_.notify_all();
+            interrupt();
+            if (thread_.joinable())
+            {
+                thread_.join();
+            }
+            cancel_interrupt_.reset();
+        }
+
+    private:
+        // Waits for the predicate until the deadline, if any. On expiry the
+        // read is cancelled and the error set to "deadline exceeded".
+        template <typename Predicate>
+        bool wait(std::unique_lock<std::mutex> &lock, Predicate predicate)
+        {
+            if (!options_.deadline)
+            {
+                condition_.wait(lock, predicate);
+                return true;
+            }
+            if (condition_.wait_until(lock, *options_.deadline, predicate))
+                return true;
+            cancelled_ = true;
+            error_ = "deadline exceeded";
+            condition_.notify_all();
+            lock.unlock();
+            interrupt();
+            lock.lock();
+            return false;
+        }
+
+        // Unblocks a reader waiting on the socket. Only the socket is shut
+        // down (the one thread-safe operation on a busy httplib client); the
+        // reader then fails and discards the connection.
+        void interrupt()
+        {
+            std::lock_guard<std::mutex> lock(client_mutex_);
+            if (client_)
+                client_->stop();
+        }
+
+        void run()
+        {
+            auto client = HttpClientPool::getInstance().acquire(options_.origin, options_.timeouts);
+            {
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                client_ = &*client;
+            }
+
+            httplib::Request request;
+            request.method = options_.method;
+            request.path = options_.path;
+            request.headers = options_.headers;
+            request.body = options_.body;
+            request.response_handler = [this](const httplib::Response &response)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                status_ = response.status;
+                headers_ = response.headers;
+                headers_ready_ = true;
+                condition_.notify_all();
+                return true;
+            };
+            request.content_receiver = [this](const char *data, size_t length, uint64_t, uint64_t)
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                condition_.wait(lock, [this] { return cancelled_ || buffered_ < MAX_BUFFERED; });
+                if (cancelled_)
+                {
+                    return false;
+                }
+                chunks_.emplace_back(data, length);
+                buffered_ += length;
+                condition_.notify_all();
+                return true;
+            };
+
+            bool started = false;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                started = !cancelled_;
+            }
+            auto result = started && client->is_valid() ? client->send(request) : httplib::Result();
+            {
+                // From here on the client may go back to the pool
+                std::lock_guard<std::mutex> lock(client_mutex_);
+                client_ = nullptr;
+            }
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!result)
+            {
+                client.discard();
+                if (!cancelled_)
+                {
+                    error_ = client->is_valid() ? httplib::to_string(result.error()) : "Invalid url " + options_.origin;
+                }
+            }
+            finished_ = true;
+            headers_ready_ = true;
+            condition_.notify_all();
+        }
+
+        static std::string lowercase(std::string text)
+        {
+            for (auto &c : text)
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            return text;
+        }
+
+        const Options options_;
+        std::thread thread_;
+        std::shared_ptr<CancelSignal> cancel_;
+        std::unique_ptr<CancelSignal::Interrupt> cancel_interrupt_;
+
+        // The reader's client while its request is in flight
+        std::mutex client_mutex_;
+        httplib::Client *client_ = nullptr;
+
+        std::mutex mutex_;
+        std::condition_variable condition_;
+        bool headers_ready_ = false;
+        bool finished_ = false;
+        bool cancelled_ = false;
+        int status_ = 0;
+        httplib::Headers headers_;
+        std::deque<std::string> chunks_;
+        size_t buffered_ = 0;
+        std::string error_;
+    };
+
+    // Makes the module available to `require` in this state
+    static void open(sol::state &lua)
+    {
+        lua.new_usertype<Stream>(
+            "NativeHttpStream", sol::no_constructor,
+            "status", &Stream::status,
+            "headers", &Stream::headers,
+            "each_chunk", [](const std::shared_ptr<Stream> &self)
+            { return [self](sol::this_state state) { return self->next_chunk(state); }; },
+            "get_body_as_string", &Stream::get_body_as_string,
+            "shutdown", &Stream::shutdown);
+
+        lua["package"]["preload"]["native_http"] = [](sol::this_state state)
+        {
+            sol::state_view lua(state);
+            sol::table module = lua.create_table();
+            module["request"] = &LuaHttp::request;
+            module["stream"] = &LuaHttp::stream;
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+            module["ssl"] = true;
+#else
+            module["ssl"] = false;
+#endif
+            return module;
+        };
+    }
+
+private:
+    static bool parse_options(const sol::table &table, Options &options, std::string &error)
+    {
+        sol::optional<std::string> url = table["url"];
+        if (!url)
+        {
+            error = "url is required";
+            return false;
+        }
+        std::tie(options.origin, options.path) = HttpClientPool::split_url(*url);
+        if (options.path.empty())
+            options.path = "/";
+        options.method = table.get_or<std::string>("method", "GET");
+        options.body = table.get_or<std::string>("body", "");
+        options.timeouts.read_sec = table.get_or("timeout", 60);
+        options.timeouts.connect_sec = table.get_or("connect_timeout", 5);
+        sol::optional<double> deadline = table["deadline"];
+        if (deadline)
+        {
+            options.deadline = std::chrono::steady_clock::now() +
+                               std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(*deadline));
+            // A single read can't outlast the whole exchange
+            options.timeouts.read_sec = std::clamp<time_t>(static_cast<time_t>(*deadline) + 1, 1, options.timeouts.read_sec);
+        }
+
+        sol::optional<sol::table> headers = table["headers"];
+        if (headers)
+        {
+            headers->for_each([&](const sol::object &key, const sol::object &value)
+                              {
+                                  if (key.is<std::string>())
+                                      options.headers.emplace(key.as<std::string>(), value.as<std::string>());
+                              });
+        }
+        return true;
+    }
+
+    static std::tuple<sol::object, sol::object> request(sol::table table, sol::this_state state)
+    {
+        sol::state_view lua(state);
+        Options options;
+        std::string error;
+        if (!parse_options(table, options, error))
+        {
+            return {sol::lua_nil, sol::make_object(lua, error)};
+        }
+
+        auto client = HttpClientPool::getInstance().acquire(options.origin, options.timeouts);
+        if (!client->is_valid())
+        {
+            client.discard();
+            return {sol::lua_nil, sol::make_object(lua, "Invalid url " + options.origin)};
+        }
+
+        httplib::Request request;
+        request.method = options.method;
+        request.path = options.path;
+        request.headers = options.headers;
+        request.body = options.body;
+        httplib::Result result;
+        std::atomic<bool> expired{false};
+        {
+            CancelSignal::Interrupt interrupt(CancelSignal::current().get(), [&client] { client->stop(); });
+            DeadlineTimer::Scope expiry(options.deadline, [&client, &expired]
+                                        {
+                                            expired = true;
+                                            client->stop();
+                                        });
+            const auto &cancel = CancelSignal::current();
+            if (cancel && cancel->cancelled())
+            {
+                client.discard();
+                return {sol::lua_nil, sol::make_object(lua, "cancelled")};
+            }
+            result = client->send(request);
+        }
+        if (!result || expired)
+        {
+            client.discard();
+            return {sol::lua_nil, sol::make_object(lua, expired ? std::string("deadline exceeded") : httplib::to_string(result.error()))};
+        }
+
+        sol::table headers = lua.create_table();
+        for (const auto &[name, value] : result->headers)
+        {
+            std::string key = name;
+            for (auto &c : key)
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            headers[key] = value;
+        }
+        sol::table response = lua.create_table_with(
+            "status", result->status,
+            "headers", headers,
+            "body", result->body);
+        return {response, sol::lua_nil};
+    }
+
+    static std::tuple<sol::object, sol::object> stream(sol::table table, sol::this_state state)
+    {
+        sol::state_view lua(state);
+        Options options;
+        std::string error;
+        if (!parse_options(table, options, error))
+        {
+            return {sol::lua_nil, sol::make_object(lua, error)};
+        }
+
+        auto stream = std::make_shared<Stream>(std::move(options));
+        if (!stream->start(error))
+        {
+            return {sol::lua_nil, sol::make_object(lua, error)};
+        }
+        return {sol::make_object(lua, stream), sol::lua_nil};
+    }
+};
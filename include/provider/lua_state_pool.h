@@ -0,0 +1,230 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "common/prompt_log.h"
+#include "utils/logger.h"
+
+// Lua mirror of a conversation's PromptLog (see ProviderManager::cached_messages)
+struct CachedPrompt
+{
+    std::weak_ptr<const PromptLog> log;
+    sol::table messages;
+    // Stamps of the mirrored messages, to notice the log's tail was dropped
+    std::vector<uint64_t> stamps;
+};
+
+// One independently initialized interpreter with its own copy of every
+// provider script. Only the thread holding the lease may touch it.
+struct LuaContext
+{
+    // Declared first so the references below are released before the state closes
+    sol::state lua;
+    std::unordered_map<std::string, sol::function> handlers;
+    std::unordered_map<uint64_t, CachedPrompt> prompt_cache;
+    size_t scripts_loaded = 0;
+};
+
+// Fixed-size pool of LuaContexts. States are created on demand up to
+// max_size; a request that finds none idle waits up to max_wait.
+class LuaStatePool
+{
+public:
+    using Factory = std::function<std::unique_ptr<LuaContext>()>;
+
+    struct Stats
+    {
+        size_t size;
+        size_t max_size;
+        size_t idle;
+        size_t in_use;
+        uint64_t checkouts;
+        uint64_t waits;
+        uint64_t timeouts;
+        double wait_ms_total;
+        double wait_ms_max;
+    };
+
+    // Returns the state to the pool when it goes out of scope
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(LuaStatePool *pool, LuaContext *context) : pool_(pool), context_(context) {}
+        Lease(Lease &&other) noexcept : pool_(other.pool_), context_(other.context_)
+        {
+            other.pool_ = nullptr;
+            other.context_ = nullptr;
+        }
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+        Lease &operator=(Lease &&) = delete;
+
+        ~Lease()
+        {
+            if (pool_ && context_)
+                pool_->release(context_);
+        }
+
+        explicit operator bool() const { return context_ != nullptr; }
+        LuaContext &operator*() const { return *context_; }
+        LuaContext *operator->() const { return context_; }
+
+    private:
+        LuaStatePool *pool_ = nullptr;
+        LuaContext *context_ = nullptr;
+    };
+
+    LuaStatePool(size_t max_size, std::chrono::milliseconds max_wait, Factory factory)
+        : max_size_(std::max<size_t>(max_size, 1)), max_wait_(max_wait), factory_(std::move(factory))
+    {
+    }
+
+    LuaStatePool(const LuaStatePool &) = delete;
+    LuaStatePool &operator=(const LuaStatePool &) = delete;
+
+    // Empty lease if no state became available within max_wait, or if a new
+    // one could not be created
+    Lease acquire()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        checkouts_++;
+
+        const auto started = std::chrono::steady_clock::now();
+        bool waited = false;
+        auto can_proceed = [this] { return !idle_.empty() || contexts_.size() + creating_ < max_size_; };
+
+        while (idle_.empty())
+        {
+            if (contexts_.size() + creating_ < max_size_)
+            {
+                record_wait(waited, started);
+                return create(lock);
+            }
+            if (!waited)
+            {
+                waits_++;
+                waited = true;
+            }
+            if (!condition_.wait_until(lock, started + max_wait_, can_proceed))
+            {
+                timeouts_++;
+                record_wait(waited, started);
+                return Lease();
+            }
+        }
+
+        record_wait(waited, started);
+        LuaContext *context = idle_.back();
+        idle_.pop_back();
+        return Lease(this, context);
+    }
+
+    // Creates the remaining states up front so the first burst of calls does
+    // not pay for interpreter start-up
+    void prewarm()
+    {
+        std::vector<Lease> leases;
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (contexts_.size() + creating_ >= max_size_)
+                    break;
+            }
+            auto lease = acquire();
+            if (!lease)
+                break;
+            leases.push_back(std::move(lease));
+        }
+    }
+
+    Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{
+            .size = contexts_.size(),
+            .max_size = max_size_,
+            .idle = idle_.size(),
+            .in_use = contexts_.size() - idle_.size(),
+            .checkouts = checkouts_,
+            .waits = waits_,
+            .timeouts = timeouts_,
+            .wait_ms_total = wait_ms_total_,
+            .wait_ms_max = wait_ms_max_};
+    }
+
+private:
+    // Called with the lock held; builds the state without it. A factory
+    // failure (e.g. a provider script that does not load) yields an empty lease.
+    Lease create(std::unique_lock<std::mutex> &lock)
+    {
+        creating_++;
+        lock.unlock();
+        std::unique_ptr<LuaContext> context;
+        try
+        {
+            context = factory_();
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Failed to create Lua state: " << e.what();
+        }
+        catch (...)
+        {
+            LOG_ERROR << "Failed to create Lua state";
+        }
+        lock.lock();
+        creating_--;
+        if (!context)
+        {
+            // A waiter may now be able to create the state instead
+            condition_.notify_one();
+            return Lease();
+        }
+        contexts_.push_back(std::move(context));
+        return Lease(this, contexts_.back().get());
+    }
+
+    void record_wait(bool waited, std::chrono::steady_clock::time_point started)
+    {
+        if (!waited)
+            return;
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+        wait_ms_total_ += ms;
+        wait_ms_max_ = std::max(wait_ms_max_, ms);
+    }
+
+    void release(LuaContext *context)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            idle_.push_back(context);
+        }
+        condition_.notify_one();
+    }
+
+    const size_t max_size_;
+    const std::chrono::milliseconds max_wait_;
+    Factory factory_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable condition_;
+    std::vector<std::unique_ptr<LuaContext>> contexts_;
+    std::vector<LuaContext *> idle_;
+    size_t creating_ = 0;
+
+    uint64_t checkouts_ = 0;
+    uint64_t waits_ = 0;
+    uint64_t timeouts_ = 0;
+    double wait_ms_total_ = 0;
+    double wait_ms_max_ = 0;
+};
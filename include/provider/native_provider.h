@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <optional>
+#include <string>
+#include <deps/json.hpp>
+#include "common/prompt_log.h"
+#include "provider/cancel_signal.h"
+
+using json = nlohmann::json;
+
+struct ProviderResult
+{
+    bool success;
+    std::string response;
+    json metadata;
+    std::string error;
+    // Failed because the caller's deadline passed
+    bool deadline_exceeded = false;
+};
+
+// A provider implemented in C++ rather than a Lua script. ProviderManager
+// dispatches to it by name, exactly like a Lua handler.
+class NativeProvider
+{
+public:
+    using ChunkCallback = std::function<bool(const std::string &)>;
+
+    struct Request
+    {
+        const std::string &input;
+        // Provider config parameters merged with the request options
+        const json &config;
+        // Either the incrementally maintained prompt (already ending with
+        // input) or a plain history to which input is appended
+        const PromptSnapshot *prompt;
+        const json *history;
+        const json &metadata;
+        const ChunkCallback &on_chunk;
+        // Stop waiting on the backend after this
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        // Stop as soon as this is cancelled (may be null)
+        CancelSignal *cancel = nullptr;
+    };
+
+    virtual ~NativeProvider() = default;
+
+    virtual ProviderResult request(const Request &request) = 0;
+
+    // Chat messages in the OpenAI wire format
+    static json build_messages(const Request &request)
+    {
+        json messages = json::array();
+        if (request.prompt && request.prompt->log)
+        {
+            request.prompt->for_each([&](const Message &message)
+                                     { messages.push_back({{"role", message.role}, {"content", message.content}}); });
+            return messages;
+        }
+        if (request.history && request.history->is_array())
+        {
+            for (const auto &message : *request.history)
+            {
+                messages.push_back({{"role", message.value("role", "user")}, {"content", message.value("content", "")}});
+            }
+        }
+        messages.push_back({{"role", "user"}, {"content", request.input}});
+        return messages;
+    }
+};
@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include "provider/http_client_pool.h"
+#include "provider/native_provider.h"
+#include "provider/stream_decoder.h"
+
+// Chat completions against any OpenAI-compatible API (OpenAI, Groq, vLLM,
+// llama.cpp server, Ollama's /v1). Connections come from the shared
+// HttpClientPool, so consecutive turns skip TCP and TLS setup.
+//
+// Parameters (config file or provider_options): base_url, api_key, model,
+// temperature, max_tokens, top_p, stop, connect_timeout, read_timeout.
+class OpenAIProvider : public NativeProvider
+{
+public:
+    ProviderResult request(const Request &request) override
+    {
+        const auto &config = request.config;
+        const auto [origin, base_path] = HttpClientPool::split_url(config.value("base_url", "https://api.openai.com/v1"));
+        const bool stream = request.on_chunk != nullptr;
+
+        json body = {
+            {"model", config.value("model", "gpt-4o-mini")},
+            {"messages", build_messages(request)},
+            {"stream", stream}};
+        for (const char *key : {"temperature", "max_tokens", "top_p", "stop", "seed"})
+        {
+            if (config.contains(key) && !config[key].is_null())
+                body[key] = config[key];
+        }
+        if (stream)
+            body["stream_options"] = {{"include_usage", true}};
+
+        HttpClientPool::Timeouts timeouts;
+        timeouts.connect_sec = config.value("connect_timeout", 5);
+        timeouts.read_sec = config.value("read_timeout", 60);
+        if (request.deadline)
+        {
+            const auto remaining = std::chrono::duration_cast<std::chrono::seconds>(*request.deadline - std::chrono::steady_clock::now()).count();
+            timeouts.read_sec = std::clamp<time_t>(remaining + 1, 1, timeouts.read_sec);
+            timeouts.connect_sec = std::min(timeouts.connect_sec, timeouts.read_sec);
+        }
+        auto client = HttpClientPool::getInstance().acquire(origin, timeouts);
+        if (!client->is_valid())
+        {
+            client.discard();
+            return {false, "", {}, "Invalid base_url " + origin + " (https needs CPPHTTPLIB_OPENSSL_SUPPORT)"};
+        }
+
+        httplib::Request http_request;
+        http_request.method = "POST";
+        http_request.path = base_path + "/chat/completions";
+        http_request.body = body.dump();
+        http_request.set_header("Content-Type", "application/json");
+        if (config.contains("api_key") && config["api_key"].is_string())
+            http_request.set_header("Authorization", "Bearer " + config["api_key"].get<std::string>());
+
+        const auto started = std::chrono::steady_clock::now();
+        StreamState state;
+        int status = 0;
+        std::string raw;
+        bool expired = false;
+
+        http_request.response_handler = [&status](const httplib::Response &response)
+        {
+            status = response.status;
+            return true;
+        };
+        http_request.content_receiver = [&](const char *data, size_t length, uint64_t, uint64_t)
+        {
+            if (request.cancel && request.cancel->cancelled())
+                return false;
+            if (request.deadline && std::chrono::steady_clock::now() >= *request.deadline)
+            {
+                expired = true;
+                return false;
+            }
+            if (status != 200 || !stream)
+            {
+                raw.append(data, length);
+                return true;
+            }
+            const bool keep_reading = state.decoder.feed(std::string_view(data, length), [&](std::string_view payload)
+                                                         { return on_stream_event(payload, state, request.on_chunk, started); });
+            // After [DONE] the rest of the body is drained so the connection stays reusable
+            return keep_reading || state.decoder.done();
+        };
+
+        httplib::Result result;
+        {
+            // A cancelled request (a hedge that lost) shuts its socket down
+            // instead of waiting for the backend to finish
+            CancelSignal::Interrupt interrupt(request.cancel, [&client] { client->stop(); });
+            if (!request.cancel || !request.cancel->cancelled())
+                result = client->send(http_request);
+        }
+        const bool cancelled = request.cancel && request.cancel->cancelled();
+        if (cancelled)
+        {
+            client.discard();
+            return {false, state.content, {}, "Cancelled"};
+        }
+        if (state.stopped || expired || !result)
+        {
+            // The body was not read to the end; the connection can't be reused
+            client.discard();
+        }
+        if (expired || (!result && request.deadline && std::chrono::steady_clock::now() >= *request.deadline))
+        {
+            ProviderResult timed_out{false, state.content, {}, "Deadline exceeded"};
+            timed_out.deadline_exceeded = true;
+            return timed_out;
+        }
+        if (!result && !state.stopped)
+        {
+            return {false, "", {}, "HTTP error: " + httplib::to_string(result.error())};
+        }
+        if (status != 200)
+        {
+            return {false, "", {}, "API error (status " + std::to_string(status) + "): " + error_message(raw)};
+        }
+
+        const double total_ms = elapsed_ms(started);
+        if (stream)
+        {
+            json metadata = {
+                {"model", state.model},
+                {"finish_reason", state.finish_reason},
+                {"usage", state.usage},
+                {"timing", {{"total_ms", total_ms}, {"first_token_ms", state.first_token_ms}}}};
+            return {true, state.content, metadata, ""};
+        }
+
+        try
+        {
+            auto response = json::parse(raw);
+            const auto &choice = response.at("choices").at(0);
+            json metadata = {
+                {"model", response.value("model", "")},
+                {"finish_reason", choice.value("finish_reason", "")},
+                {"usage", response.value("usage", json::object())},
+                {"timing", {{"total_ms", total_ms}}}};
+            return {true, choice.at("message").value("content", ""), metadata, ""};
+        }
+        catch (const std::exception &e)
+        {
+            return {false, "", {}, "Invalid API response: " + std::string(e.what())};
+        }
+    }
+
+private:
+    struct StreamState
+    {
+        SseDecoder decoder;
+        std::string content;
+        std::string model;
+        std::string finish_reason;
+        json usage = json::object();
+        double first_token_ms = -1;
+        bool stopped = false;
+    };
+
+    static double elapsed_ms(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+
+    static bool on_stream_event(std::string_view payload, StreamState &state, const ChunkCallback &on_chunk,
+                                std::chrono::steady_clock::time_point started)
+    {
+        auto event = json::parse(payload, nullptr, false);
+        if (event.is_discarded())
+            return true;
+
+        if (state.model.empty())
+            state.model = event.value("model", "");
+        if (event.contains("usage") && event["usage"].is_object())
+            state.usage = event["usage"];
+        if (!event.contains("choices") || !event["choices"].is_array() || event["choices"].empty())
+            return true;
+
+        const auto &choice = event["choices"][0];
+        if (choice.contains("finish_reason") && choice["finish_reason"].is_string())
+            state.finish_reason = choice["finish_reason"];
+
+        const auto delta = choice.value("delta", json::object());
+        if (!delta.contains("content") || !delta["content"].is_string())
+            return true;
+        const auto &text = delta["content"].get_ref<const std::string &>();
+        if (text.empty())
+            return true;
+
+        if (state.first_token_ms < 0)
+            state.first_token_ms = elapsed_ms(started);
+        state.content += text;
+        if (!on_chunk(text))
+        {
+            state.stopped = true;
+            return false;
+        }
+        return true;
+    }
+
+    static std::string error_message(const std::string &body)
+    {
+        auto parsed = json::parse(body, nullptr, false);
+        if (!parsed.is_discarded() && parsed.contains("error"))
+        {
+            const auto &error = parsed["error"];
+            if (error.is_string())
+                return error;
+            if (error.is_object() && error.contains("message") && error["message"].is_string())
+                return error["message"];
+        }
+        return body.empty() ? "unknown error" : body;
+    }
+};
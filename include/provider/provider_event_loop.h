@@ -0,0 +1,382 @@
+#pragma once
+#include <sol/sol.hpp>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "provider/cancel_signal.h"
+#include "provider/lua_state_pool.h"
+#include "utils/logger.h"
+
+// Runs provider handlers as coroutines multiplexed onto a few threads. Each
+// thread owns a LuaContext and a cqueues controller: lua-http yields to the
+// controller instead of blocking, and the thread polls the controller's
+// pollfd together with an eventfd used to hand it new requests.
+//
+// A suspended coroutine runs no Lua, so neither LuaBudget nor the ChunkSink
+// notices its deadline or cancellation while it waits on a stalled server.
+// The loop does: at the deadline, or once cancelled, the request completes
+// with ok = false and the thread's slot is freed. The coroutine itself gives
+// up by the deadline too, as provider.lua bounds every read by it; its late
+// result is dropped.
+class ProviderEventLoop
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    // pcall status followed by the handler's (success, response, error)
+    using Completion = std::function<void(bool ok, sol::object success, sol::object response, sol::object error)>;
+    // Starts handler(params) as a coroutine on the current loop thread;
+    // done runs once, at the latest at the deadline or when cancel fires
+    using Spawn = std::function<void(sol::function handler, sol::table params,
+                                     const std::optional<Clock::time_point> &deadline,
+                                     std::shared_ptr<CancelSignal> cancel, Completion done)>;
+    // Runs on a loop thread; either spawns a coroutine or finishes the request
+    // itself. context is null when the loop cannot run it (stopping, or the
+    // thread's Lua state failed to start) and the job must report the failure.
+    using Job = std::function<void(LuaContext *context, const Spawn &spawn)>;
+    using ContextFactory = std::function<std::unique_ptr<LuaContext>()>;
+
+    struct Stats
+    {
+        size_t threads;
+        size_t in_flight;
+        size_t capacity;
+        uint64_t submitted;
+        uint64_t rejected;
+    };
+
+    ProviderEventLoop(size_t threads, size_t capacity, ContextFactory factory)
+        : capacity_(std::max<size_t>(capacity, 1)), factory_(std::move(factory))
+    {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); i++)
+        {
+            auto worker = std::make_unique<Worker>();
+            worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            workers_.push_back(std::move(worker));
+        }
+        for (auto &worker : workers_)
+        {
+            worker->thread = std::thread(&ProviderEventLoop::run, this, worker.get());
+        }
+    }
+
+    ProviderEventLoop(const ProviderEventLoop &) = delete;
+    ProviderEventLoop &operator=(const ProviderEventLoop &) = delete;
+
+    ~ProviderEventLoop()
+    {
+        stopping_ = true;
+        for (auto &worker : workers_)
+        {
+            wake(*worker);
+        }
+        for (auto &worker : workers_)
+        {
+            if (worker->thread.joinable())
+                worker->thread.join();
+            close(worker->wake_fd);
+        }
+    }
+
+    // Returns false when capacity requests are already in flight
+    bool submit(Job job)
+    {
+        if (stopping_)
+        {
+            rejected_++;
+            return false;
+        }
+        if (in_flight_.fetch_add(1) >= capacity_)
+        {
+            in_flight_--;
+            rejected_++;
+            return false;
+        }
+        submitted_++;
+
+        Worker *target = workers_.front().get();
+        for (auto &worker : workers_)
+        {
+            if (worker->load < target->load)
+                target = worker.get();
+        }
+        target->load++;
+        {
+            std::lock_guard<std::mutex> lock(target->mutex);
+            target->queue.push_back(std::move(job));
+        }
+        wake(*target);
+        return true;
+    }
+
+    Stats stats() const
+    {
+        return Stats{
+            .threads = workers_.size(),
+            .in_flight = in_flight_.load(),
+            .capacity = capacity_,
+            .submitted = submitted_.load(),
+            .rejected = rejected_.load()};
+    }
+
+private:
+    struct Pending
+    {
+        Completion done;
+        std::optional<Clock::time_point> deadline;
+        std::shared_ptr<CancelSignal> cancel;
+        // Wakes the loop thread when cancel fires
+        std::unique_ptr<CancelSignal::Interrupt> interrupt;
+    };
+
+    struct Worker
+    {
+        std::thread thread;
+        int wake_fd = -1;
+        std::mutex mutex;
+        std::deque<Job> queue;
+        std::atomic<size_t> load{0};
+        // Touched only by the loop thread
+        std::unordered_map<int64_t, Pending> pending;
+        int64_t next_id = 0;
+    };
+
+    static constexpr const char *LOOP_SCRIPT = R"(
+        local cqueues = require "cqueues"
+        local loop = { controller = cqueues.new() }
+
+        function loop.spawn(id, handler, params)
+            loop.controller:wrap(function()
+                -- Execution budget of this coroutine (see LuaBudget)
+                if provider_arm_deadline then
+                    provider_arm_deadline(params.deadline_ms)
+                end
+                provider_loop_done(id, pcall(handler, params))
+            end)
+        end
+
+        -- Runs every coroutine that can make progress without blocking
+        function loop.step()
+            local ok, err = loop.controller:step(0)
+            return ok, err, loop.controller:pollfd(), loop.controller:timeout()
+        end
+
+        return loop
+    )";
+
+    static void wake(Worker &worker)
+    {
+        uint64_t one = 1;
+        [[maybe_unused]] auto written = write(worker.wake_fd, &one, sizeof(one));
+    }
+
+    void finish(Worker &worker)
+    {
+        worker.load--;
+        in_flight_--;
+    }
+
+    // Called with the entry already out of worker.pending
+    void complete(Worker &worker, Pending &pending, bool ok, sol::object success, sol::object response, sol::object error)
+    {
+        pending.interrupt.reset();
+        try
+        {
+            pending.done(ok, success, response, error);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Provider completion failed: " << e.what();
+        }
+        finish(worker);
+    }
+
+    // Fails the requests past their deadline or cancelled
+    void expire(Worker &worker, LuaContext &context)
+    {
+        const auto now = Clock::now();
+        for (auto it = worker.pending.begin(); it != worker.pending.end();)
+        {
+            const bool cancelled = it->second.cancel && it->second.cancel->cancelled();
+            if (!cancelled && !(it->second.deadline && now >= *it->second.deadline))
+            {
+                ++it;
+                continue;
+            }
+            auto pending = std::move(it->second);
+            it = worker.pending.erase(it);
+            complete(worker, pending, false, sol::make_object(context.lua, cancelled ? "cancelled" : "deadline exceeded"),
+                     sol::lua_nil, sol::lua_nil);
+        }
+    }
+
+    // Milliseconds until the nearest pending deadline, capped by timeout_ms
+    static int until_next_deadline(const Worker &worker, int timeout_ms)
+    {
+        const auto now = Clock::now();
+        for (const auto &[id, pending] : worker.pending)
+        {
+            if (!pending.deadline)
+                continue;
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(*pending.deadline - now).count();
+            const int ms = static_cast<int>(std::max<int64_t>(left, 0));
+            timeout_ms = timeout_ms < 0 ? ms : std::min(timeout_ms, ms);
+        }
+        return timeout_ms;
+    }
+
+    void run(Worker *worker)
+    {
+        std::unique_ptr<LuaContext> context;
+        sol::function spawn_coroutine;
+        sol::function step;
+        try
+        {
+            context = factory_();
+            // Tells provider.lua to stay on lua-http, which yields to the controller
+            context->lua["provider_async"] = true;
+            sol::table loop = context->lua.script(LOOP_SCRIPT);
+            spawn_coroutine = loop["spawn"];
+            step = loop["step"];
+            context->lua["provider_loop_done"] = [this, worker](int64_t id, sol::variadic_args results)
+            {
+                // Gone when expire() already failed it
+                auto it = worker->pending.find(id);
+                if (it == worker->pending.end())
+                    return;
+                auto pending = std::move(it->second);
+                worker->pending.erase(it);
+                auto arg = [&results](size_t i) { return i < results.size() ? sol::object(results[i]) : sol::object(sol::lua_nil); };
+                complete(*worker, pending, arg(0).is<bool>() && arg(0).as<bool>(), arg(1), arg(2), arg(3));
+            };
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Provider event loop failed to start: " << e.what();
+            spawn_coroutine = sol::function();
+            step = sol::function();
+            context.reset();
+        }
+
+        Spawn spawn = [&](sol::function handler, sol::table params,
+                          const std::optional<Clock::time_point> &deadline,
+                          std::shared_ptr<CancelSignal> cancel, Completion done)
+        {
+            const int64_t id = ++worker->next_id;
+            auto &pending = worker->pending[id];
+            pending.done = std::move(done);
+            pending.deadline = deadline;
+            if (cancel)
+            {
+                pending.interrupt = std::make_unique<CancelSignal::Interrupt>(cancel.get(), [worker] { wake(*worker); });
+                pending.cancel = std::move(cancel);
+            }
+            spawn_coroutine(id, handler, params);
+        };
+
+        while (true)
+        {
+            std::deque<Job> jobs;
+            {
+                std::lock_guard<std::mutex> lock(worker->mutex);
+                jobs.swap(worker->queue);
+            }
+            for (auto &job : jobs)
+            {
+                run_job(*worker, context.get(), job, spawn);
+            }
+
+            if (stopping_)
+                break;
+
+            int controller_fd = -1;
+            int timeout_ms = -1;
+            if (context)
+            {
+                try
+                {
+                    auto [ok, err, fd, timeout] = step().get<std::tuple<bool, sol::object, int, sol::optional<double>>>();
+                    if (!ok)
+                    {
+                        LOG_ERROR << "Provider event loop step failed: "
+                                  << (err.is<std::string>() ? err.as<std::string>() : std::string("unknown"));
+                    }
+                    controller_fd = fd;
+                    if (timeout)
+                        timeout_ms = static_cast<int>(std::ceil(*timeout * 1000.0));
+                }
+                catch (const std::exception &e)
+                {
+                    LOG_ERROR << "Provider event loop step failed: " << e.what();
+                }
+                expire(*worker, *context);
+                timeout_ms = until_next_deadline(*worker, timeout_ms);
+            }
+
+            pollfd fds[2] = {
+                {worker->wake_fd, POLLIN, 0},
+                {controller_fd, POLLIN, 0}};
+            poll(fds, controller_fd >= 0 ? 2 : 1, timeout_ms);
+            if (fds[0].revents & POLLIN)
+            {
+                uint64_t count;
+                [[maybe_unused]] auto read_bytes = read(worker->wake_fd, &count, sizeof(count));
+            }
+        }
+
+        // Fail whatever is still queued or running so no caller waits forever
+        std::deque<Job> jobs;
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            jobs.swap(worker->queue);
+        }
+        for (auto &job : jobs)
+        {
+            run_job(*worker, context.get(), job, spawn);
+        }
+        auto pending = std::move(worker->pending);
+        worker->pending.clear();
+        for (auto &[id, entry] : pending)
+        {
+            complete(*worker, entry, false, sol::make_object(context->lua, "Provider event loop stopped"), sol::lua_nil, sol::lua_nil);
+        }
+    }
+
+    void run_job(Worker &worker, LuaContext *context, Job &job, const Spawn &spawn)
+    {
+        const size_t before = worker.pending.size();
+        try
+        {
+            job(stopping_ ? nullptr : context, spawn);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Provider event loop job failed: " << e.what();
+        }
+        if (worker.pending.size() == before)
+        {
+            finish(worker);
+        }
+    }
+
+    const size_t capacity_;
+    ContextFactory factory_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> in_flight_{0};
+    std::atomic<uint64_t> submitted_{0};
+    std::atomic<uint64_t> rejected_{0};
+};
@@ -4,7 +4,28 @@
 #include <optional>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 #include <deps/json.hpp>
+#include "common/prompt_log.h"
+#include "core/configuration.h"
+#include "provider/cancel_signal.h"
+#include "provider/cassette.h"
+#include "provider/chunk_sink.h"
+#include "provider/fair_limiter.h"
+#include "provider/lua_bridge.h"
+#include "provider/lua_budget.h"
+#include "provider/lua_http.h"
+#include "provider/lua_state_pool.h"
+#include "provider/native_provider.h"
+#include "provider/openai_provider.h"
+#include "provider/provider_event_loop.h"
+#include "provider/provider_router.h"
+#include "provider/tier_controller.h"
+#include "utils/logger.h"
 
 using json = nlohmann::json;
 
@@ -17,13 +38,30 @@ public:
         json metadata;
     };
 
-    struct RequestResult
+    using RequestResult = ProviderResult;
+
+    // Who a request is for, used to share provider capacity: tenants split
+    // a capped provider by weight, live call turns go before batch work
+    struct RequestContext
     {
-        bool success;
-        std::string response;
-        json metadata;
-        std::string error;
+        std::string tenant = "default";
+        double weight = 1.0;
+        FairLimiter::Priority priority = FairLimiter::Priority::Live;
+        // Reaches the queue wait, the Lua handler (params.deadline_ms and the
+        // execution budget) and the HTTP layer; past it the request fails
+        // with deadline_exceeded set
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        // Set when the result is no longer wanted (a losing hedge); the
+        // provider stops as soon as it notices
+        std::shared_ptr<CancelSignal> cancel;
     };
+
+    // Receives content deltas while a streaming provider is still generating.
+    // Returning false asks the provider to stop reading the response.
+    using ChunkCallback = std::function<bool(const std::string &)>;
+    // Receives the result of submit_request, on an event loop thread
+    using CompletionCallback = std::function<void(RequestResult)>;
+
    static ProviderManager& getInstance()
     {
         static ProviderManager instance;
@@ -35,81 +73,167 @@ public:
     ProviderManager& operator=(const ProviderManager&) = delete;
    
 
-    void register_provider(const std::string &name, sol::function handler)
-    {
-        providers_[name] = ProviderEntry{
-            .handler = std::move(handler),
-            .config = load_provider_config(name)};
-    }
-
     RequestResult process_request(
         const std::string &provider_name,
         const std::string &input,
         const json &options = {},
         const json &history = json::array(),
-        const json &metadata = json::object())
+        const json &metadata = json::object(),
+        ChunkCallback on_chunk = nullptr,
+        const RequestContext &context = {})
     {
-        if (!providers_.count(provider_name))
-        {
-            return {false, "", {}, "Provider not registered"};
-        }
+        return run_request(provider_name, input, options, &history, nullptr, metadata, on_chunk, context);
+    }
 
-        auto &provider = providers_.at(provider_name);
+    // Conversation turn: the prompt (already ending with the user's input) is
+    // mirrored into Lua incrementally and passed to the handler as
+    // params.messages, so per-turn work is proportional to the new messages.
+    RequestResult process_request(
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const PromptSnapshot &prompt,
+        const json &metadata = json::object(),
+        ChunkCallback on_chunk = nullptr,
+        const RequestContext &context = {})
+    {
+        return run_request(provider_name, input, options, nullptr, &prompt, metadata, on_chunk, context);
+    }
 
-        try
+    // Conversation turn spread over interchangeable backends, e.g.
+    //   "routing": {"providers": ["groq", {"provider": "ollama", "options": {...}}],
+    //               "hedge": true, "max_attempts": 2}
+    // Each entry's options are merged over `options`. See ProviderRouter for
+    // the policy fields.
+    RequestResult route_request(
+        const json &routing,
+        const std::string &input,
+        const json &options,
+        const PromptSnapshot &prompt,
+        const json &metadata = json::object(),
+        ChunkCallback on_chunk = nullptr,
+        const RequestContext &context = {})
+    {
+        std::vector<ProviderRouter::Backend> backends;
+        for (const auto &entry : routing.value("providers", json::array()))
         {
-            sol::table lua_params = lua_->create_table_with(
-                "input", input,
-                "config", json_to_lua(provider.config.parameters),
-                "options", json_to_lua(options),
-                "history", json_to_lua(history),
-                "metadata", json_to_lua(metadata));
-            std::cout<< options.dump(4) << std::endl;
-            sol::protected_function_result result = provider.handler(lua_params);
-            if (!result.valid())
-            {
-                sol::error err = result;
-                return {false, "", {}, "Lua error: " + std::string(err.what())};
-            }
-
-            auto [success, lua_response, error] = result.get<std::tuple<bool, sol::object, sol::object>>();
-            std::string error_str;
-            if (error.is<std::string>())
+            ProviderRouter::Backend backend;
+            backend.options = options.is_object() ? options : json::object();
+            if (entry.is_string())
             {
-                error_str = error.as<std::string>();
+                backend.provider = entry.get<std::string>();
             }
-            else if (error.is<sol::nil_t>())
+            else if (entry.is_object() && entry.contains("provider"))
             {
-                error_str = "";
+                backend.provider = entry["provider"].get<std::string>();
+                backend.options.update(entry.value("options", json::object()));
             }
             else
             {
-                error_str = "Invalid error type returned from Lua";
+                continue;
             }
+            backend.key = backend.provider + "/" + model_of(backend.provider, backend.options);
+            backends.push_back(std::move(backend));
+        }
 
-            RequestResult request_result;
-            request_result.success = success;
-            request_result.error = error_str;
-            std::cout<< error_str << std::endl;
-            if (lua_response.is<sol::table>())
+        return router_.route(
+            backends, ProviderRouter::Policy::from_json(routing), on_chunk,
+            [this, &input, &prompt, &metadata, &context](const ProviderRouter::Backend &backend, const ChunkCallback &chunk,
+                                                         const std::shared_ptr<CancelSignal> &cancel)
             {
-                sol::table response_table = lua_response;
-                request_result.response = response_table["content"];
-                request_result.metadata = lua_to_json(response_table["metadata"]);
-                provider.config.metadata.update(lua_to_json(response_table["metadata"]));
-                // // Update provider metadata
-                // if (response_table["metadata"])
-                // {
-                //     provider.config.metadata.update(lua_to_json(response_table["metadata"]));
-                // }
-            }
+                RequestContext attempt_context = context;
+                attempt_context.cancel = cancel;
+                return run_request(backend.provider, input, backend.options, nullptr, &prompt, metadata, chunk, attempt_context);
+            });
+    }
 
-            return request_result;
-        }
-        catch (const std::exception &e)
+    // Picks an entry of the agent's "tiers" by the provider's load level and
+    // returns `options` with that tier's options merged over them:
+    //   "tiers": [{"name": "full", "options": {"model": "llama3.1:8b"}},
+    //             {"name": "fast", "options": {"model": "llama3.2:1b"}}]
+    // Level 0 is the first tier; levels past the end use the last one.
+    json tiered_options(const std::string &provider_name, const json &tiers, const json &options)
+    {
+        json result = options.is_object() ? options : json::object();
+        if (!tiers.is_array() || tiers.empty())
+            return result;
+        const auto &tier = tiers[std::min(tiers_.level(provider_name), tiers.size() - 1)];
+        if (tier.is_object())
+            result.update(tier.value("options", json::object()));
+        return result;
+    }
+
+    // True when PROVIDER_EVENT_LOOP is set: handlers run as coroutines on the
+    // event loop, and process_request waits for them there
+    bool async_enabled() const
+    {
+        // Cassette record/replay wraps the blocking path only
+        return loop_ != nullptr && !cassette_;
+    }
+
+    // Non-blocking conversation turn. on_chunk and on_done run on a loop
+    // thread, so they must not block (or call process_request). Returns
+    // false if the event loop is disabled, the provider is native, or the
+    // provider's queue is full. A turn waiting for a provider slot is
+    // submitted by the thread that frees one.
+    bool submit_request(
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const PromptSnapshot &prompt,
+        const json &metadata,
+        ChunkCallback on_chunk,
+        CompletionCallback on_done,
+        const RequestContext &context = {})
+    {
+        if (!loop_ || is_native(provider_name))
         {
-            return {false, "", {}, "Exception: " + std::string(e.what())};
+            return false;
         }
+        auto ticket = std::make_shared<TierController::Ticket>(tiers_.begin(provider_name));
+        auto request = std::make_shared<AsyncRequest>(
+            AsyncRequest{provider_name, input, options, std::nullopt, prompt, metadata, std::move(on_chunk), context.deadline, context.cancel});
+        return limiter_.acquire_async(
+            provider_name, context.tenant, context.weight, context.priority,
+            [this, ticket, request, on_done = std::move(on_done)](FairLimiter::Permit slot)
+            {
+                if (expired(request->deadline))
+                {
+                    // Waited in the queue past the turn's deadline
+                    slot.reset();
+                    on_done(deadline_result());
+                    return;
+                }
+                auto permit = std::make_shared<FairLimiter::Permit>(std::move(slot));
+                const auto deadline = request->deadline;
+                bool submitted = submit_async(std::move(*request), [ticket, permit, on_done, deadline](RequestResult result) mutable
+                {
+                    if (!result.success && expired(deadline))
+                        result.deadline_exceeded = true;
+                    permit.reset();
+                    ticket.reset();
+                    on_done(std::move(result));
+                });
+                if (!submitted)
+                {
+                    on_done({false, "", {}, "Provider event loop is saturated"});
+                }
+            });
+    }
+
+    // Providers implemented in C++; looked up before the Lua handlers
+    void register_native_provider(const std::string &name, std::shared_ptr<NativeProvider> provider)
+    {
+        auto config = load_provider_config(name);
+        std::unique_lock<std::shared_mutex> lock(providers_mutex_);
+        providers_[name] = std::move(config);
+        native_providers_[name] = std::move(provider);
+    }
+
+    bool is_native(const std::string &provider_name) const
+    {
+        std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+        return native_providers_.count(provider_name) > 0;
     }
 
     void set_config_path(const std::filesystem::path &path)
@@ -119,6 +243,7 @@ public:
 
     void load_providers_from_folder(const std::string &folder_path)
     {
+        load_native_providers();
         for (const auto &entry : std::filesystem::directory_iterator(folder_path))
         {
             if (entry.path().extension() == ".lua")
@@ -127,50 +252,553 @@ public:
             }
         }
         set_config_path(folder_path);
+        pool_.prewarm();
     }
+
+    // Queues the script for every Lua state; each state loads it the next
+    // time it is checked out
     void load_provider(const std::filesystem::path &file_path)
     {
+        {
+            std::lock_guard<std::mutex> lock(scripts_mutex_);
+            scripts_.push_back(file_path);
+        }
+        auto lease = pool_.acquire();
+        if (lease)
+        {
+            sync_scripts(*lease);
+        }
+    }
+
+    std::vector<std::string> provider_names() const
+    {
+        std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+        std::vector<std::string> names;
+        for (const auto &[name, config] : providers_)
+        {
+            names.push_back(name);
+        }
+        return names;
+    }
+
+    LuaStatePool::Stats pool_stats() const
+    {
+        return pool_.stats();
+    }
+
+    std::vector<ProviderRouter::BackendStats> router_stats() const
+    {
+        return router_.stats();
+    }
+
+    std::vector<FairLimiter::Stats> limiter_stats() const
+    {
+        return limiter_.stats();
+    }
+
+    std::vector<TierController::Stats> tier_stats() const
+    {
+        return tiers_.stats();
+    }
+
+    std::optional<Cassette::Stats> cassette_stats() const
+    {
+        if (!cassette_)
+            return std::nullopt;
+        return cassette_->stats();
+    }
+
+    std::optional<ProviderEventLoop::Stats> event_loop_stats() const
+    {
+        if (!loop_)
+            return std::nullopt;
+        return loop_->stats();
+    }
+
+private:
+    // Owned copy of a request that outlives the caller's stack
+    struct AsyncRequest
+    {
+        std::string provider_name;
+        std::string input;
+        json options;
+        std::optional<json> history;
+        std::optional<PromptSnapshot> prompt;
+        json metadata;
+        ChunkCallback on_chunk;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+        std::shared_ptr<CancelSignal> cancel;
+    };
+
+    static RequestResult cancelled_result()
+    {
+        return {false, "", {}, "Cancelled"};
+    }
+
+    static RequestResult deadline_result()
+    {
+        RequestResult result{false, "", {}, "Deadline exceeded"};
+        result.deadline_exceeded = true;
+        return result;
+    }
+
+    static bool expired(const std::optional<std::chrono::steady_clock::time_point> &deadline)
+    {
+        return deadline && std::chrono::steady_clock::now() >= *deadline;
+    }
+
+    RequestResult run_request(
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const json *history,
+        const PromptSnapshot *prompt,
+        const json &metadata,
+        ChunkCallback on_chunk,
+        const RequestContext &context)
+    {
+        auto ticket = tiers_.begin(provider_name);
+        auto permit = limiter_.acquire(provider_name, context.tenant, context.weight, context.priority, context.deadline);
+        if (!permit)
+        {
+            return expired(context.deadline) ? deadline_result() : RequestResult{false, "", {}, "Provider queue is full"};
+        }
+
+        auto result = cassette_
+                          ? cassette_->run(provider_name, input, on_chunk, context.deadline, [&](const ChunkCallback &chunk)
+                                           { return dispatch(provider_name, input, options, history, prompt, metadata, chunk, context.deadline, context.cancel); })
+                          : dispatch(provider_name, input, options, history, prompt, metadata, std::move(on_chunk), context.deadline, context.cancel);
+        if (!result.success && expired(context.deadline))
+        {
+            result.deadline_exceeded = true;
+        }
+        return result;
+    }
+
+    RequestResult dispatch(
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const json *history,
+        const PromptSnapshot *prompt,
+        const json &metadata,
+        ChunkCallback on_chunk,
+        const std::optional<std::chrono::steady_clock::time_point> &deadline,
+        const std::shared_ptr<CancelSignal> &cancel)
+    {
+        if (auto native = find_native(provider_name))
+        {
+            return run_native(*native, provider_name, input, options, history, prompt, metadata, on_chunk, deadline, cancel.get());
+        }
+
+        if (loop_)
+        {
+            // Blocking callers share the loop's states instead of pinning one
+            // from the pool. The loop completes the request at the deadline,
+            // or once cancelled, so this waits no longer than the coroutine
+            // holds its slot.
+            // on_chunk may refer to the caller's stack: once the caller has
+            // left, the coroutine's remaining chunks are refused
+            struct Abandon
+            {
+                std::mutex mutex;
+                std::condition_variable condition;
+                std::optional<RequestResult> result;
+                bool abandoned = false;
+            };
+            auto abandon = std::make_shared<Abandon>();
+            ChunkCallback guarded;
+            if (on_chunk)
+            {
+                guarded = [abandon, on_chunk = std::move(on_chunk)](const std::string &chunk)
+                {
+                    std::lock_guard<std::mutex> lock(abandon->mutex);
+                    return !abandon->abandoned && on_chunk(chunk);
+                };
+            }
+            AsyncRequest request{provider_name, input, options, std::nullopt, std::nullopt, metadata, std::move(guarded), deadline, cancel};
+            if (history)
+                request.history = *history;
+            if (prompt)
+                request.prompt = *prompt;
+            auto done = [abandon](RequestResult result)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(abandon->mutex);
+                    abandon->result = std::move(result);
+                }
+                abandon->condition.notify_all();
+            };
+            if (!submit_async(std::move(request), std::move(done)))
+            {
+                return {false, "", {}, "Provider event loop is saturated"};
+            }
+            std::unique_lock<std::mutex> lock(abandon->mutex);
+            abandon->condition.wait(lock, [&] { return abandon->result.has_value(); });
+            abandon->abandoned = true;
+            return std::move(*abandon->result);
+        }
+
+        auto lease = pool_.acquire();
+        if (!lease)
+        {
+            return {false, "", {}, "No Lua state available (timed out or failed to load)"};
+        }
+        LuaContext &context = *lease;
+        sync_scripts(context);
+
+        auto handler = context.handlers.find(provider_name);
+        if (handler == context.handlers.end())
+        {
+            return {false, "", {}, "Provider not registered"};
+        }
+
+        try
+        {
+            // The request json is lent to the script until this call returns
+            auto scope = std::make_shared<char>();
+            // native_http and the execution budget stop the script once cancelled
+            CancelSignal::Bind bind(cancel);
+            sol::table lua_params = make_params(context, provider_name, input, options, history, prompt, metadata, on_chunk, deadline, nullptr, scope);
+            LuaBudget::arm(context.lua.lua_state(), deadline.value_or(std::chrono::steady_clock::now() + lua_budget_));
+            sol::protected_function_result result = handler->second(lua_params);
+            LuaBudget::disarm(context.lua.lua_state());
+            if (!result.valid())
+            {
+                sol::error err = result;
+                return {false, "", {}, "Lua error: " + std::string(err.what())};
+            }
+
+            auto [success, lua_response, error] = result.get<std::tuple<bool, sol::object, sol::object>>();
+            return collect_result(provider_name, success, lua_response, error);
+        }
+        catch (const std::exception &e)
+        {
+            return {false, "", {}, "Exception: " + std::string(e.what())};
+        }
+    }
+
+    std::string model_of(const std::string &provider_name, const json &options) const
+    {
+        if (options.contains("model") && options["model"].is_string())
+            return options["model"].get<std::string>();
+        std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+        auto it = providers_.find(provider_name);
+        if (it != providers_.end() && it->second.parameters.contains("model") && it->second.parameters["model"].is_string())
+            return it->second.parameters["model"].get<std::string>();
+        return "default";
+    }
+
+    std::shared_ptr<NativeProvider> find_native(const std::string &provider_name) const
+    {
+        std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+        auto it = native_providers_.find(provider_name);
+        return it == native_providers_.end() ? nullptr : it->second;
+    }
+
+    RequestResult run_native(
+        NativeProvider &native,
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const json *history,
+        const PromptSnapshot *prompt,
+        const json &metadata,
+        const ChunkCallback &on_chunk,
+        const std::optional<std::chrono::steady_clock::time_point> &deadline,
+        CancelSignal *cancel)
+    {
+        json config;
+        {
+            std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+            config = providers_.at(provider_name).parameters;
+        }
+        if (options.is_object())
+        {
+            config.update(options);
+        }
+
         try
         {
-            lua_->script_file(file_path.string());
-            std::string name = file_path.stem().string();
-            sol::function handler = (*lua_)[name];
-            if (handler != sol::nil)
+            return native.request({input, config, prompt, history, metadata, on_chunk, deadline, cancel});
+        }
+        catch (const std::exception &e)
+        {
+            return {false, "", {}, "Exception: " + std::string(e.what())};
+        }
+    }
+
+    // Every config/<name>.json with "native": "openai" becomes an
+    // OpenAI-compatible provider called <name>
+    void load_native_providers()
+    {
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(config_path_, error))
+        {
+            if (entry.path().extension() != ".json")
+                continue;
+            std::ifstream f(entry.path());
+            json config = json::parse(f, nullptr, false);
+            if (config.is_discarded() || config.value("native", "") != "openai")
+                continue;
+            register_native_provider(entry.path().stem().string(), std::make_shared<OpenAIProvider>());
+        }
+    }
+
+    bool submit_async(AsyncRequest request, CompletionCallback on_done)
+    {
+        auto shared = std::make_shared<AsyncRequest>(std::move(request));
+        return loop_->submit([this, shared, on_done](LuaContext *context, const ProviderEventLoop::Spawn &spawn)
+        {
+            if (!context)
             {
-                register_provider(name, handler);
+                on_done({false, "", {}, "Provider event loop unavailable"});
+                return;
             }
-            else
+            sync_scripts(*context);
+
+            auto handler = context->handlers.find(shared->provider_name);
+            if (handler == context->handlers.end())
+            {
+                on_done({false, "", {}, "Provider not registered"});
+                return;
+            }
+
+            try
+            {
+                sol::table lua_params = make_params(
+                    *context, shared->provider_name, shared->input, shared->options,
+                    shared->history ? &*shared->history : nullptr,
+                    shared->prompt ? &*shared->prompt : nullptr,
+                    shared->metadata, shared->on_chunk, shared->deadline, shared, {});
+                spawn(handler->second, lua_params, shared->deadline, shared->cancel, [this, shared, on_done](bool ok, sol::object success, sol::object response, sol::object error)
+                {
+                    RequestResult result;
+                    try
+                    {
+                        if (!ok && shared->cancel && shared->cancel->cancelled())
+                            result = cancelled_result();
+                        else if (!ok && expired(shared->deadline))
+                            result = deadline_result();
+                        else if (!ok)
+                            result = {false, "", {}, "Lua error: " + (success.is<std::string>() ? success.as<std::string>() : std::string("unknown"))};
+                        else
+                            result = collect_result(shared->provider_name, success.is<bool>() && success.as<bool>(), response, error);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        result = {false, "", {}, "Exception: " + std::string(e.what())};
+                    }
+                    on_done(std::move(result));
+                });
+            }
+            catch (const std::exception &e)
             {
-               
-               // fmt::print(stderr, "Warning: No handler function found for provider '{}' in {}\n", name, file_path.string());
+                on_done({false, "", {}, "Exception: " + std::string(e.what())});
             }
+        });
+    }
+
+    sol::table make_params(
+        LuaContext &context,
+        const std::string &provider_name,
+        const std::string &input,
+        const json &options,
+        const json *history,
+        const PromptSnapshot *prompt,
+        const json &metadata,
+        const ChunkCallback &on_chunk,
+        const std::optional<std::chrono::steady_clock::time_point> &deadline,
+        const std::shared_ptr<const void> &owner,
+        const std::weak_ptr<const void> &scope)
+    {
+        json parameters;
+        {
+            std::shared_lock<std::shared_mutex> lock(providers_mutex_);
+            parameters = providers_.at(provider_name).parameters;
+        }
+
+        sol::table lua_params = context.lua.create_table_with(
+            "input", input,
+            "config", lua_bridge::JsonView::wrap(context.lua, std::move(parameters)),
+            "options", view(context.lua, options, owner, scope),
+            "metadata", view(context.lua, metadata, owner, scope));
+        if (prompt && prompt->log)
+        {
+            lua_params["messages"] = cached_messages(context, *prompt);
+            lua_params["prompt_id"] = prompt->log->id();
+        }
+        else if (history)
+        {
+            lua_params["history"] = view(context.lua, *history, owner, scope);
+        }
+        if (deadline)
+        {
+            lua_params["deadline_ms"] = std::chrono::duration<double, std::milli>(*deadline - std::chrono::steady_clock::now()).count();
         }
-        catch (const sol::error &e)
+        if (on_chunk)
         {
-           // fmt::print(stderr, "Error loading provider from {}: {}\n", file_path.string(), e.what());
+            auto sink = std::make_shared<ChunkSink>(on_chunk);
+            lua_params["sink"] = sink;
+            lua_params["emit"] = [sink](const std::string &chunk) { return sink->emit(chunk); };
         }
+        return lua_params;
     }
 
-private:
- ProviderManager() : lua_(std::make_unique<sol::state>())
+    // Read-only view of a request field, never a copy. With an owner (a
+    // queued request) the view shares ownership of its json; a blocking call
+    // lends the caller's json until `scope` expires, and a script that keeps
+    // the view past that gets an error when it uses it.
+    static sol::object view(sol::state_view lua, const json &value, const std::shared_ptr<const void> &owner,
+                            const std::weak_ptr<const void> &scope)
     {
-        lua_->open_libraries(sol::lib::base, sol::lib::package, sol::lib::table);
-        initialize_lua_environment();
+        if (owner)
+            return lua_bridge::JsonView::wrap(lua, std::shared_ptr<const json>(owner, &value), value);
+        return lua_bridge::JsonView::borrow(lua, scope, value);
     }
-    struct ProviderEntry
+
+    RequestResult collect_result(const std::string &provider_name, bool success, const sol::object &lua_response, const sol::object &error)
     {
-        sol::function handler;
-        ProviderConfig config;
-    };
+        std::string error_str;
+        if (error.is<std::string>())
+        {
+            error_str = error.as<std::string>();
+        }
+        else if (error.is<sol::nil_t>())
+        {
+            error_str = "";
+        }
+        else
+        {
+            error_str = "Invalid error type returned from Lua";
+        }
 
-    std::unique_ptr<sol::state> lua_;
-    std::unordered_map<std::string, ProviderEntry> providers_;
+        RequestResult request_result;
+        request_result.success = success;
+        request_result.error = error_str;
+        if (!success)
+        {
+            LOG_DEBUG << "Provider " << provider_name << " returned an error: " << error_str;
+        }
+        if (lua_response.is<sol::table>())
+        {
+            sol::table response_table = lua_response;
+            request_result.response = response_table["content"];
+            request_result.metadata = lua_bridge::lua_to_json(response_table["metadata"]);
+            {
+                std::unique_lock<std::shared_mutex> lock(providers_mutex_);
+                providers_.at(provider_name).metadata.update(request_result.metadata);
+            }
+            // // Update provider metadata
+            // if (response_table["metadata"])
+            // {
+            //     provider.config.metadata.update(lua_to_json(response_table["metadata"]));
+            // }
+        }
+
+        return request_result;
+    }
+
+    ProviderManager()
+        : pool_(
+              AppConfig::getInstance().get<int>("LUA_STATE_POOL_SIZE", 4),
+              std::chrono::milliseconds(AppConfig::getInstance().get<int>("LUA_STATE_WAIT_MS", 30000)),
+              [this]() { return create_context(); })
+    {
+        if (AppConfig::getInstance().get<int>("PROVIDER_EVENT_LOOP", 0) != 0)
+        {
+            loop_ = std::make_unique<ProviderEventLoop>(
+                AppConfig::getInstance().get<int>("PROVIDER_LOOP_THREADS", 2),
+                AppConfig::getInstance().get<int>("PROVIDER_LOOP_CAPACITY", 512),
+                [this]() { return create_context(); });
+        }
+
+        // PROVIDER_CASSETTE=record|replay: see Cassette
+        const auto cassette = AppConfig::getInstance().get<std::string>("PROVIDER_CASSETTE", "off");
+        if (cassette == "record" || cassette == "replay")
+        {
+            cassette_ = std::make_unique<Cassette>(
+                cassette == "record" ? Cassette::Mode::Record : Cassette::Mode::Replay,
+                AppConfig::getInstance().get<std::string>("PROVIDER_CASSETTE_PATH", "./cassettes/providers.jsonl"),
+                AppConfig::getInstance().get<float>("PROVIDER_CASSETTE_SPEED", 1.0f));
+        }
+    }
+
+    LuaStatePool pool_;
+    std::mutex scripts_mutex_;
+    std::vector<std::filesystem::path> scripts_;
+    mutable std::shared_mutex providers_mutex_;
+    std::unordered_map<std::string, ProviderConfig> providers_;
+    std::unordered_map<std::string, std::shared_ptr<NativeProvider>> native_providers_;
     std::filesystem::path config_path_ = "./config/";
+    ProviderRouter router_;
+    TierController tiers_;
+    FairLimiter limiter_;
+    std::unique_ptr<Cassette> cassette_;
+    // Execution budget of a handler call that has no deadline of its own
+    std::chrono::milliseconds lua_budget_{AppConfig::getInstance().get<int>("LUA_MAX_RUN_MS", 120000)};
+    // Declared last: its threads use everything above and are joined first
+    std::unique_ptr<ProviderEventLoop> loop_;
 
-    void initialize_lua_environment()
+    std::unique_ptr<LuaContext> create_context()
     {
-        std::cout << "test-------------------------";
-        lua_->open_libraries(
+        auto context = std::make_unique<LuaContext>();
+        context->lua.open_libraries(sol::lib::base, sol::lib::package, sol::lib::table);
+        initialize_lua_environment(context->lua);
+        lua_bridge::JsonView::open(context->lua);
+        LuaBudget::open(context->lua, lua_budget_);
+        LuaHttp::open(context->lua);
+        ChunkSink::open(context->lua);
+        sync_scripts(*context);
+        return context;
+    }
+
+    // Loads the scripts added since this state was last checked out
+    void sync_scripts(LuaContext &context)
+    {
+        std::vector<std::filesystem::path> pending;
+        {
+            std::lock_guard<std::mutex> lock(scripts_mutex_);
+            pending.assign(scripts_.begin() + context.scripts_loaded, scripts_.end());
+            context.scripts_loaded = scripts_.size();
+        }
+        for (const auto &file_path : pending)
+        {
+            try
+            {
+                context.lua.script_file(file_path.string());
+                std::string name = file_path.stem().string();
+                sol::function handler = context.lua[name];
+                if (handler != sol::nil)
+                {
+                    register_provider(context, name, handler);
+                }
+                else
+                {
+                   
+                   // fmt::print(stderr, "Warning: No handler function found for provider '{}' in {}\n", name, file_path.string());
+                }
+            }
+            catch (const sol::error &e)
+            {
+               // fmt::print(stderr, "Error loading provider from {}: {}\n", file_path.string(), e.what());
+            }
+        }
+    }
+
+    void register_provider(LuaContext &context, const std::string &name, sol::function handler)
+    {
+        context.handlers[name] = std::move(handler);
+        std::unique_lock<std::shared_mutex> lock(providers_mutex_);
+        if (!providers_.count(name))
+        {
+            providers_[name] = load_provider_config(name);
+        }
+    }
+
+    void initialize_lua_environment(sol::state &lua)
+    {
+        lua.open_libraries(
             sol::lib::base,
             sol::lib::package,
             sol::lib::table,
@@ -180,8 +808,8 @@ private:
             sol::lib::debug,
             sol::lib::os);
 
-        std::string package_path = (*lua_)["package"]["path"];
-        std::string package_cpath = (*lua_)["package"]["cpath"];
+        std::string package_path = lua["package"]["path"];
+        std::string package_cpath = lua["package"]["cpath"];
 
         package_path += ";./lua/?.lua";
 
@@ -192,10 +820,10 @@ private:
         // Add C module path
         package_cpath += ";/usr/local/lib/lua/5.4/?.so";
 
-        (*lua_)["package"]["path"] = package_path;
-        (*lua_)["package"]["cpath"] = package_cpath;
-        std::cout << package_path << std::endl;
-        lua_->script(R"(
+        lua["package"]["path"] = package_path;
+        lua["package"]["cpath"] = package_cpath;
+        LOG_DEBUG << "Lua package.path: " << package_path;
+        lua.script(R"(
             -- Prevent insecure OS functions
             os.exit = nil
             os.setlocale = nil
@@ -206,83 +834,63 @@ private:
     ProviderConfig load_provider_config(const std::string &name)
     {
         std::ifstream f(config_path_ / (name + ".json"));
-        std::cout << config_path_ / (name + ".json") << std::endl;
+        LOG_DEBUG << "Loading provider config " << (config_path_ / (name + ".json")).string();
         if (!f.is_open())
             return {};
 
         json config = json::parse(f);
-        std::cout << config.dump(2) << std::endl;
+        tiers_.configure(name, TierController::Thresholds::from_json(config.value("tiering", json::object())));
+        limiter_.configure(name, FairLimiter::Limits::from_json(config.value("limits", json::object())));
         return {
             .parameters = config.value("parameters", json::object()),
             .metadata = config.value("metadata", json::object())};
     }
 
-    sol::object json_to_lua(const json &j)
+    sol::table message_to_lua(sol::state &lua, const Message &message)
     {
-        if (j.is_null())
-            return sol::nil;
-        if (j.is_boolean())
-            return sol::make_object(lua_->lua_state(), j.get<bool>());
-        if (j.is_number())
-            return sol::make_object(lua_->lua_state(), j.get<double>());
-        if (j.is_string())
-            return sol::make_object(lua_->lua_state(), j.get<std::string>());
+        return lua.create_table_with("role", message.role, "content", message.content);
+    }
 
-        if (j.is_array())
+    // Lua mirror of a conversation's PromptLog, extended by whatever was
+    // appended since the previous turn served by this state. Messages
+    // dropped from the log's tail (a cancelled turn) are dropped from the
+    // mirror too, rather than the whole prompt being copied again.
+    sol::table cached_messages(LuaContext &context, const PromptSnapshot &prompt)
+    {
+        auto &cache = context.prompt_cache;
+        auto it = cache.find(prompt.log->id());
+        if (it == cache.end())
         {
-            sol::table arr = lua_->create_table();
-            for (size_t i = 0; i < j.size(); i++)
-            {
-                arr[i + 1] = json_to_lua(j[i]);
-            }
-            return arr;
+            evict_stale_prompts(context);
+            it = cache.emplace(prompt.log->id(), CachedPrompt{prompt.log, context.lua.create_table(), {}}).first;
         }
 
-        if (j.is_object())
+        auto &cached = it->second;
+        prompt.log->sync(cached.stamps, prompt.size, prompt.stamp, [&](size_t index)
+                         { cached.messages[index + 1] = sol::lua_nil; },
+                         [&](const Message &message)
+                         { cached.messages[cached.stamps.size()] = message_to_lua(context.lua, message); });
+        if (!cached.stamps.empty() && cached.stamps.back() > prompt.stamp)
         {
-            sol::table obj = lua_->create_table();
-            for (auto &[key, value] : j.items())
-            {
-                obj[key] = json_to_lua(value);
-            }
-            return obj;
+            // A later turn of the same conversation already extended the mirror
+            sol::table messages = context.lua.create_table(static_cast<int>(prompt.size), 0);
+            size_t index = 0;
+            prompt.for_each([&](const Message &message)
+                            { messages[++index] = message_to_lua(context.lua, message); });
+            return messages;
         }
-
-        return sol::nil;
+        return cached.messages;
     }
 
-    json lua_to_json(const sol::object &obj)
+    void evict_stale_prompts(LuaContext &context)
     {
-        if (obj == sol::nil)
-            return json();
-        if (obj.is<bool>())
-            return obj.as<bool>();
-        if (obj.is<double>())
-            return obj.as<double>();
-        if (obj.is<std::string>())
-            return obj.as<std::string>();
-
-        if (obj.is<sol::table>())
+        auto &cache = context.prompt_cache;
+        for (auto it = cache.begin(); it != cache.end();)
         {
-            sol::table table = obj;
-            if (table.size() > 0)
-            { // Array
-                json arr = json::array();
-                for (size_t i = 1; i <= table.size(); i++)
-                {
-                    arr.push_back(lua_to_json(table[i]));
-                }
-                return arr;
-            }
+            if (it->second.log.expired())
+                it = cache.erase(it);
             else
-            { // Object
-                json obj = json::object();
-                table.for_each([&](sol::object key, sol::object value)
-                               { obj[key.as<std::string>()] = lua_to_json(value); });
-                return obj;
-            }
+                ++it;
         }
-
-        return json();
     }
-};
\ No newline at end of file
+};
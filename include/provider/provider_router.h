@@ -0,0 +1,434 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <deps/json.hpp>
+#include "provider/cancel_signal.h"
+#include "provider/native_provider.h"
+
+using json = nlohmann::json;
+
+// Latency-aware choice between interchangeable backends (provider + model).
+// Every attempt feeds an EWMA of its latency and error rate and a window of
+// recent latencies. A request goes to the fastest healthy backend. If it
+// hasn't answered by that backend's p95 latency, a hedged request goes to
+// the next one and the first answer wins. If it fails, the next backend is
+// tried.
+//
+// Latency is time to first output: the first streamed chunk, or the whole
+// result for providers that don't stream. With streaming, the attempt that
+// emits first owns the caller's stream and the others are stopped via their
+// chunk callbacks. Once the race is decided the remaining attempts are
+// cancelled through the race's CancelSignal, and route() joins them before
+// it returns. A cancelled attempt only tells how long the backend took at
+// least, so it can raise that backend's latency estimate but never lower it.
+class ProviderRouter
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using ChunkCallback = std::function<bool(const std::string &)>;
+
+    struct Backend
+    {
+        std::string provider;
+        json options;
+        // "provider/model"; health is tracked per key
+        std::string key;
+    };
+
+    struct Policy
+    {
+        bool hedge = false;
+        double hedge_quantile = 0.95;
+        std::chrono::milliseconds min_hedge_delay{100};
+        // Also the delay used until a backend has enough samples
+        std::chrono::milliseconds max_hedge_delay{3000};
+        size_t max_attempts = 3;
+        // A backend is skipped while its error rate is above this, or for
+        // `cooldown` after `failure_threshold` consecutive failures
+        double max_error_rate = 0.5;
+        int failure_threshold = 3;
+        std::chrono::milliseconds cooldown{10000};
+
+        static Policy from_json(const json &routing)
+        {
+            Policy policy;
+            policy.hedge = routing.value("hedge", policy.hedge);
+            policy.hedge_quantile = routing.value("hedge_quantile", policy.hedge_quantile);
+            policy.min_hedge_delay = std::chrono::milliseconds(routing.value("min_hedge_delay_ms", 100));
+            policy.max_hedge_delay = std::chrono::milliseconds(routing.value("max_hedge_delay_ms", 3000));
+            policy.max_attempts = std::max<size_t>(1, routing.value("max_attempts", policy.max_attempts));
+            policy.max_error_rate = routing.value("max_error_rate", policy.max_error_rate);
+            policy.failure_threshold = routing.value("failure_threshold", policy.failure_threshold);
+            policy.cooldown = std::chrono::milliseconds(routing.value("cooldown_ms", 10000));
+            return policy;
+        }
+    };
+
+    // Runs one backend; `cancel` is set once the race no longer needs it
+    using Attempt = std::function<ProviderResult(const Backend &, const ChunkCallback &, const std::shared_ptr<CancelSignal> &cancel)>;
+
+    struct BackendStats
+    {
+        std::string key;
+        double latency_ms;
+        double p95_ms;
+        double error_rate;
+        bool healthy;
+        uint64_t requests;
+        uint64_t errors;
+        uint64_t hedges;
+        uint64_t hedge_wins;
+    };
+
+    static constexpr double EWMA_ALPHA = 0.2;
+    static constexpr size_t WINDOW = 64;
+    // Samples needed before the window's quantile drives the hedge delay
+    static constexpr size_t MIN_SAMPLES = 8;
+
+    // Runs `attempt` against the backends (in preference order) until one
+    // succeeds. Blocks the caller; attempts run on their own threads, which
+    // are cancelled and joined before this returns.
+    ProviderResult route(const std::vector<Backend> &backends, const Policy &policy,
+                         const ChunkCallback &on_chunk, Attempt attempt)
+    {
+        if (backends.empty())
+        {
+            return {false, "", {}, "No providers to route to"};
+        }
+
+        {
+            // stats() judges health by the policy of the latest route
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto &backend : backends)
+                health_[backend.key].policy = policy;
+        }
+        const auto order = rank(backends, policy);
+        const size_t limit = std::min(policy.max_attempts, order.size());
+        auto race = std::make_shared<Race>();
+        race->on_chunk = on_chunk;
+
+        size_t next = 0;
+        size_t failures_seen = 0;
+        bool hedged = false;
+        std::unique_lock<std::mutex> lock(race->mutex);
+        std::string current = order[next].key;
+        launch(race, order[next++], false, attempt, policy);
+        auto progressed = [&] { return race->winner || race->errors.size() > failures_seen || race->running == 0; };
+        while (true)
+        {
+            bool hedge_due = false;
+            if (policy.hedge && !hedged && next < limit && !race->stream_claimed)
+            {
+                // Wait up to the backend's p95 for its first output
+                hedge_due = !race->condition.wait_for(lock, hedge_delay(current, policy),
+                                                      [&] { return progressed() || race->stream_claimed; });
+            }
+            else
+            {
+                race->condition.wait(lock, progressed);
+            }
+
+            if (race->winner)
+                break;
+            if (hedge_due)
+            {
+                hedged = true;
+                current = order[next].key;
+                launch(race, order[next++], true, attempt, policy);
+                continue;
+            }
+            if (race->errors.size() > failures_seen)
+            {
+                // An attempt failed: fail over without waiting for the others
+                failures_seen = race->errors.size();
+                if (next < limit && !race->stream_claimed)
+                {
+                    current = order[next].key;
+                    launch(race, order[next++], false, attempt, policy);
+                    continue;
+                }
+            }
+            if (race->running == 0)
+                break;
+        }
+        lock.unlock();
+
+        // Losing hedges stop reading (or waiting on) their backend
+        race->cancel->cancel();
+        for (auto &thread : race->threads)
+            thread.join();
+        lock.lock();
+
+        if (!race->winner)
+        {
+            std::string error = "All providers failed";
+            for (const auto &failure : race->errors)
+                error += "; " + failure;
+            return {false, "", {}, error};
+        }
+
+        ProviderResult result = std::move(*race->winner);
+        if (!result.metadata.is_object())
+            result.metadata = json::object();
+        result.metadata["route"] = {
+            {"backend", race->winner_key},
+            {"attempts", next},
+            {"hedged", hedged},
+            {"errors", race->errors}};
+        return result;
+    }
+
+    std::vector<BackendStats> stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<BackendStats> result;
+        const auto now = Clock::now();
+        for (const auto &[key, health] : health_)
+        {
+            result.push_back(BackendStats{
+                .key = key,
+                .latency_ms = health.latency_ms,
+                .p95_ms = health.quantile(0.95),
+                .error_rate = health.error_rate,
+                .healthy = health.healthy(now, health.policy),
+                .requests = health.requests,
+                .errors = health.errors,
+                .hedges = health.hedges,
+                .hedge_wins = health.hedge_wins});
+        }
+        return result;
+    }
+
+private:
+    struct Health
+    {
+        double latency_ms = 0;
+        double error_rate = 0;
+        bool measured = false;
+        std::array<double, WINDOW> window{};
+        size_t samples = 0;
+        int consecutive_failures = 0;
+        Clock::time_point open_until{};
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t hedges = 0;
+        uint64_t hedge_wins = 0;
+        // The policy of the latest route that included this backend
+        Policy policy;
+
+        bool healthy(Clock::time_point now, const Policy &policy) const
+        {
+            return now >= open_until && error_rate <= policy.max_error_rate;
+        }
+
+        double quantile(double q) const
+        {
+            const size_t count = std::min(samples, WINDOW);
+            if (count == 0)
+                return 0;
+            std::vector<double> sorted(window.begin(), window.begin() + count);
+            const size_t index = std::min(count - 1, static_cast<size_t>(q * count));
+            std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+            return sorted[index];
+        }
+    };
+
+    // Shared by the caller and its attempts
+    struct Race
+    {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::shared_ptr<CancelSignal> cancel = std::make_shared<CancelSignal>();
+        std::vector<std::thread> threads;
+        ChunkCallback on_chunk;
+        int running = 0;
+        bool stream_claimed = false;
+        size_t stream_owner = 0;
+        size_t attempts = 0;
+        std::optional<ProviderResult> winner;
+        std::string winner_key;
+        std::vector<std::string> errors;
+    };
+
+    // Healthy backends first, fastest first; backends without samples count
+    // as fastest so they get measured. Ties keep the configured order.
+    std::vector<Backend> rank(const std::vector<Backend> &backends, const Policy &policy) const
+    {
+        struct Ranked
+        {
+            const Backend *backend;
+            bool healthy;
+            double latency_ms;
+        };
+        std::vector<Ranked> ranked;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto now = Clock::now();
+            for (const auto &backend : backends)
+            {
+                auto it = health_.find(backend.key);
+                if (it == health_.end())
+                    ranked.push_back({&backend, true, 0});
+                else
+                    ranked.push_back({&backend, it->second.healthy(now, policy), it->second.measured ? it->second.latency_ms : 0});
+            }
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](const Ranked &a, const Ranked &b)
+                         {
+                             if (a.healthy != b.healthy)
+                                 return a.healthy;
+                             return a.latency_ms < b.latency_ms;
+                         });
+        std::vector<Backend> order;
+        for (const auto &entry : ranked)
+            order.push_back(*entry.backend);
+        return order;
+    }
+
+    std::chrono::milliseconds hedge_delay(const std::string &key, const Policy &policy) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = health_.find(key);
+        if (it == health_.end() || it->second.samples < MIN_SAMPLES)
+            return policy.max_hedge_delay;
+        const auto delay = std::chrono::milliseconds(static_cast<int64_t>(it->second.quantile(policy.hedge_quantile)));
+        return std::clamp(delay, policy.min_hedge_delay, policy.max_hedge_delay);
+    }
+
+    // Called with race->mutex held
+    void launch(const std::shared_ptr<Race> &race, const Backend &backend, bool hedge, const Attempt &attempt, const Policy &policy)
+    {
+        const size_t index = race->attempts++;
+        race->running++;
+        if (hedge)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            health_[backend.key].hedges++;
+        }
+
+        race->threads.emplace_back([this, race, backend, hedge, index, attempt, policy]()
+        {
+            const auto started = Clock::now();
+            std::optional<Clock::time_point> first_output;
+            bool cancelled = false;
+
+            ChunkCallback on_chunk;
+            if (race->on_chunk)
+            {
+                on_chunk = [&](const std::string &delta)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(race->mutex);
+                        if (race->winner || (race->stream_claimed && race->stream_owner != index))
+                        {
+                            cancelled = true;
+                            return false;
+                        }
+                        if (!race->stream_claimed)
+                        {
+                            race->stream_claimed = true;
+                            race->stream_owner = index;
+                            first_output = Clock::now();
+                            race->condition.notify_all();
+                        }
+                    }
+                    // Only the owner gets here, and the caller waits for it to finish
+                    return race->on_chunk(delta);
+                };
+            }
+
+            ProviderResult result;
+            try
+            {
+                result = attempt(backend, on_chunk, race->cancel);
+            }
+            catch (const std::exception &e)
+            {
+                result = {false, "", {}, "Exception: " + std::string(e.what())};
+            }
+            const auto latency = (first_output ? *first_output : Clock::now()) - started;
+            cancelled = cancelled || race->cancel->cancelled();
+
+            bool won = false;
+            {
+                std::lock_guard<std::mutex> lock(race->mutex);
+                race->running--;
+                const bool owns_stream = race->stream_claimed && race->stream_owner == index;
+                if (!race->winner && !cancelled && (owns_stream || !race->stream_claimed))
+                {
+                    // A backend that already streamed to the caller can't be
+                    // replaced, even if it failed halfway
+                    if (result.success || owns_stream)
+                    {
+                        race->winner = result;
+                        race->winner_key = backend.key;
+                        won = true;
+                    }
+                    else
+                    {
+                        race->errors.push_back(backend.key + ": " + result.error);
+                    }
+                }
+                race->condition.notify_all();
+            }
+
+            record(backend.key, cancelled ? Outcome::Cancelled : result.success ? Outcome::Success : Outcome::Failure,
+                   latency, hedge && won, policy);
+        });
+    }
+
+    enum class Outcome
+    {
+        Success,
+        Failure,
+        // Stopped because another attempt won; its latency is only a lower bound
+        Cancelled
+    };
+
+    void record(const std::string &key, Outcome outcome, Clock::duration latency, bool hedge_won, const Policy &policy)
+    {
+        const double ms = std::chrono::duration<double, std::milli>(latency).count();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &health = health_[key];
+        health.requests++;
+        if (hedge_won)
+            health.hedge_wins++;
+        if (outcome == Outcome::Cancelled)
+        {
+            // It was at least this slow, which may only raise the estimate.
+            // Neither an error nor a success: the failure streak stands, and
+            // the window keeps real samples only.
+            if (!health.measured || ms > health.latency_ms)
+                health.latency_ms = ms;
+            health.measured = true;
+            return;
+        }
+        const bool success = outcome == Outcome::Success;
+        health.error_rate = (1 - EWMA_ALPHA) * health.error_rate + EWMA_ALPHA * (success ? 0.0 : 1.0);
+        if (!success)
+        {
+            health.errors++;
+            if (++health.consecutive_failures >= policy.failure_threshold)
+                health.open_until = Clock::now() + policy.cooldown;
+            return;
+        }
+        health.consecutive_failures = 0;
+        health.latency_ms = health.measured ? (1 - EWMA_ALPHA) * health.latency_ms + EWMA_ALPHA * ms : ms;
+        health.measured = true;
+        health.window[health.samples++ % WINDOW] = ms;
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Health> health_;
+};
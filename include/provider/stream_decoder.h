@@ -0,0 +1,129 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Splits a byte stream into lines, across arbitrary chunk boundaries.
+// Trailing '\r' is stripped so CRLF streams decode the same.
+class LineDecoder
+{
+public:
+    // Calls on_line for every complete line; stops early (and returns false)
+    // when on_line returns false
+    template <typename Fn>
+    bool feed(std::string_view bytes, Fn &&on_line)
+    {
+        size_t start = 0;
+        while (true)
+        {
+            const auto newline = bytes.find('\n', start);
+            if (newline == std::string_view::npos)
+                break;
+
+            std::string_view line = bytes.substr(start, newline - start);
+            start = newline + 1;
+            bool keep_going;
+            if (!partial_.empty())
+            {
+                partial_.append(line);
+                keep_going = on_line(trim_cr(partial_));
+                partial_.clear();
+            }
+            else
+            {
+                keep_going = on_line(trim_cr(line));
+            }
+            if (!keep_going)
+                return false;
+        }
+        partial_.append(bytes.substr(start));
+        return true;
+    }
+
+    // Delivers a final line that was not newline-terminated
+    template <typename Fn>
+    bool finish(Fn &&on_line)
+    {
+        if (partial_.empty())
+            return true;
+        std::string line;
+        line.swap(partial_);
+        return on_line(trim_cr(line));
+    }
+
+private:
+    static std::string_view trim_cr(std::string_view line)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.remove_suffix(1);
+        return line;
+    }
+
+    std::string partial_;
+};
+
+// Server-sent events as used by OpenAI-compatible streaming APIs: "data:"
+// lines, joined with '\n' until a blank line ends the event. "data: [DONE]"
+// ends the stream; comments and other fields are ignored.
+class SseDecoder
+{
+public:
+    template <typename Fn>
+    bool feed(std::string_view bytes, Fn &&on_data)
+    {
+        if (done_)
+            return false;
+        return lines_.feed(bytes, [&](std::string_view line) { return on_line(line, on_data); });
+    }
+
+    template <typename Fn>
+    bool finish(Fn &&on_data)
+    {
+        if (done_)
+            return false;
+        if (!lines_.finish([&](std::string_view line) { return on_line(line, on_data); }))
+            return false;
+        return dispatch(on_data);
+    }
+
+    bool done() const { return done_; }
+
+private:
+    template <typename Fn>
+    bool on_line(std::string_view line, Fn &on_data)
+    {
+        if (line.empty())
+            return dispatch(on_data);
+        if (line.substr(0, 5) != "data:")
+            return true;
+
+        line.remove_prefix(5);
+        if (!line.empty() && line.front() == ' ')
+            line.remove_prefix(1);
+        if (!data_.empty())
+            data_.push_back('\n');
+        data_.append(line);
+        has_data_ = true;
+        return true;
+    }
+
+    template <typename Fn>
+    bool dispatch(Fn &on_data)
+    {
+        if (!has_data_)
+            return true;
+        has_data_ = false;
+        std::string data;
+        data.swap(data_);
+        if (data == "[DONE]")
+        {
+            done_ = true;
+            return false;
+        }
+        return on_data(std::string_view(data));
+    }
+
+    LineDecoder lines_;
+    std::string data_;
+    bool has_data_ = false;
+    bool done_ = false;
+};
@@ -0,0 +1,216 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <deps/json.hpp>
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+
+// Load level per provider, for degrading agents to faster model tiers while
+// a backend is overloaded. The signals are requests in flight (the backend's
+// queue, as seen from here) and p95 latency over the requests of the last
+// p95_window_ms (at most WINDOW of them), so a backend that went quiet after
+// a slow spell is not judged by it forever. The level
+// goes up one step when either crosses its high mark. It comes back down one
+// step only when both are under their low marks and the level has held for
+// hold_ms, so it doesn't flap at the boundary.
+//
+// Thresholds come from the provider's config file:
+//   "tiering": {"queue_high": 4, "queue_low": 1, "p95_high_ms": 4000,
+//               "p95_low_ms": 1500, "p95_window_ms": 60000, "hold_ms": 15000,
+//               "max_level": 3}
+// Agents map a level to their own "tiers" list (level 0 = first entry).
+class TierController
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Thresholds
+    {
+        size_t queue_high = 4;
+        size_t queue_low = 1;
+        double p95_high_ms = 4000;
+        double p95_low_ms = 1500;
+        std::chrono::milliseconds p95_window{60000};
+        std::chrono::milliseconds hold{15000};
+        size_t max_level = 3;
+
+        static Thresholds from_json(const json &tiering)
+        {
+            Thresholds thresholds;
+            thresholds.queue_high = tiering.value("queue_high", thresholds.queue_high);
+            thresholds.queue_low = tiering.value("queue_low", thresholds.queue_low);
+            thresholds.p95_high_ms = tiering.value("p95_high_ms", thresholds.p95_high_ms);
+            thresholds.p95_low_ms = tiering.value("p95_low_ms", thresholds.p95_low_ms);
+            thresholds.p95_window = std::chrono::milliseconds(tiering.value("p95_window_ms", 60000));
+            thresholds.hold = std::chrono::milliseconds(tiering.value("hold_ms", 15000));
+            thresholds.max_level = tiering.value("max_level", thresholds.max_level);
+            return thresholds;
+        }
+    };
+
+    struct Stats
+    {
+        std::string provider;
+        size_t level;
+        size_t in_flight;
+        double p95_ms;
+        uint64_t escalations;
+        uint64_t recoveries;
+    };
+
+    // Counts a request as in flight until destroyed, then records its latency
+    class Ticket
+    {
+    public:
+        Ticket(TierController *controller, std::string provider)
+            : controller_(controller), provider_(std::move(provider)), started_(Clock::now()) {}
+        Ticket(Ticket &&other) noexcept
+            : controller_(other.controller_), provider_(std::move(other.provider_)), started_(other.started_)
+        {
+            other.controller_ = nullptr;
+        }
+        Ticket(const Ticket &) = delete;
+        Ticket &operator=(const Ticket &) = delete;
+
+        ~Ticket()
+        {
+            if (controller_)
+                controller_->finish(provider_, Clock::now() - started_);
+        }
+
+    private:
+        TierController *controller_;
+        std::string provider_;
+        Clock::time_point started_;
+    };
+
+    static constexpr size_t WINDOW = 64;
+
+    void configure(const std::string &provider, const Thresholds &thresholds)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        providers_[provider].thresholds = thresholds;
+    }
+
+    Ticket begin(const std::string &provider)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &state = providers_[provider];
+        state.in_flight++;
+        update(provider, state);
+        return Ticket(this, provider);
+    }
+
+    size_t level(const std::string &provider)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = providers_.find(provider);
+        if (it == providers_.end())
+            return 0;
+        update(provider, it->second);
+        return it->second.level;
+    }
+
+    std::vector<Stats> stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<Stats> result;
+        for (const auto &[provider, state] : providers_)
+        {
+            result.push_back(Stats{
+                .provider = provider,
+                .level = state.level,
+                .in_flight = state.in_flight,
+                .p95_ms = state.p95_ms(Clock::now()),
+                .escalations = state.escalations,
+                .recoveries = state.recoveries});
+        }
+        return result;
+    }
+
+private:
+    struct Sample
+    {
+        double ms;
+        Clock::time_point at;
+    };
+
+    struct State
+    {
+        Thresholds thresholds;
+        size_t in_flight = 0;
+        std::array<Sample, WINDOW> latencies{};
+        size_t samples = 0;
+        size_t level = 0;
+        Clock::time_point changed{};
+        uint64_t escalations = 0;
+        uint64_t recoveries = 0;
+
+        // Over the samples still inside the time window
+        double p95_ms(Clock::time_point now) const
+        {
+            std::vector<double> sorted;
+            for (size_t i = 0; i < std::min(samples, WINDOW); i++)
+            {
+                if (now - latencies[i].at <= thresholds.p95_window)
+                    sorted.push_back(latencies[i].ms);
+            }
+            const size_t count = sorted.size();
+            if (count == 0)
+                return 0;
+            const size_t index = std::min(count - 1, count * 95 / 100);
+            std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+            return sorted[index];
+        }
+    };
+
+    void finish(const std::string &provider, Clock::duration latency)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &state = providers_[provider];
+        if (state.in_flight > 0)
+            state.in_flight--;
+        state.latencies[state.samples++ % WINDOW] = {std::chrono::duration<double, std::milli>(latency).count(), Clock::now()};
+        update(provider, state);
+    }
+
+    // Called with mutex_ held
+    void update(const std::string &provider, State &state)
+    {
+        const auto now = Clock::now();
+        const auto &limits = state.thresholds;
+        const double p95 = state.p95_ms(now);
+        if ((state.in_flight >= limits.queue_high || p95 >= limits.p95_high_ms) && state.level < limits.max_level)
+        {
+            // Escalate at most once per hold period as well, so a burst that
+            // is already being absorbed doesn't jump straight to the last tier
+            if (state.level == 0 || now - state.changed >= limits.hold)
+            {
+                state.level++;
+                state.changed = now;
+                state.escalations++;
+                LOG_INFO << "Provider " << provider << " under load (in flight " << state.in_flight
+                         << ", p95 " << p95 << " ms), tier level " << state.level;
+            }
+        }
+        else if (state.level > 0 && state.in_flight <= limits.queue_low && p95 <= limits.p95_low_ms &&
+                 now - state.changed >= limits.hold)
+        {
+            state.level--;
+            state.changed = now;
+            state.recoveries++;
+            LOG_INFO << "Provider " << provider << " recovered (in flight " << state.in_flight
+                     << ", p95 " << p95 << " ms), tier level " << state.level;
+        }
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, State> providers_;
+};
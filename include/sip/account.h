@@ -8,14 +8,23 @@
 #include <string>
 
 class Agent;
+class Call;
 
 class Account: public pj::Account {
 public:
     using onRegStateCallback = std::function<void(bool, pj_status_t)>;
+    using onIncomingCallCallback = std::function<void(Call *)>;
+    using onCallEndedCallback = std::function<void(Call *)>;
     Account();
     void setAgent(const std::string &agentId);
     std::shared_ptr<Agent> getAgent() const;
+    const std::string &getAgentId() const { return m_agentId; }
     void registerRegStateCallback(onRegStateCallback cb);
+    void registerIncomingCallCallback(onIncomingCallCallback cb);
+    // Called from Call::onCallState once a call of this account has
+    // disconnected, so its owner can delete it
+    void registerCallEndedCallback(onCallEndedCallback cb);
+    void notifyCallEnded(Call *call);
     void onRegState(pj::OnRegStateParam &prm) override;
     void onIncomingCall(pj::OnIncomingCallParam &iprm) override;
 
@@ -23,6 +32,8 @@ public:
 
 private:
     onRegStateCallback regStateCallback = nullptr;
+    onIncomingCallCallback incomingCallCallback = nullptr;
+    onCallEndedCallback callEndedCallback = nullptr;
     std::string m_agentId;
     std::shared_ptr<Agent> m_agent;
     AgentManager& m_agentManager = AgentManager::getInstance();
@@ -3,17 +3,26 @@
 
 #include "agent/agent.h"
 #include "sip/account.h"
+#include "sip/call_stats.h"
+#include "sip/jitter_buffer_profile.h"
 #include "sip/media_port.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <pjsua2.hpp>
 class Call: public pj::Call {
 public:
     void onCallState(pj::OnCallStateParam &prm) override;
     void onCallMediaState(pj::OnCallMediaStateParam &prm) override;
+    void onStreamPreCreate(pj::OnStreamPreCreateParam &prm) override;
 
     std::shared_ptr<Agent> getAgent() const;
+    Account &getAccount() const { return m_account; }
+    std::shared_ptr<AgentSession> getSession() const;
+    CallStats sampleStats();
 
     Call(Account &acc, int call_id = PJSUA_INVALID_ID);
+    ~Call() override;
 
     enum Direction {
         INCOMING,
@@ -21,6 +30,18 @@ public:
     } direction;
 
 private:
-    Account m_account;
+    void releaseSession();
+    void startRecording();
+    std::vector<TurnTrace> turnTraces() const;
+
+    Account &m_account;
+    std::shared_ptr<Agent> m_agent;
+    std::shared_ptr<AgentSession> m_session;
+    mutable std::mutex m_sessionMutex;
+    // The session's turns, kept when it goes back to the agent's pool
+    std::vector<TurnTrace> m_turns;
     MediaPort mediaPort;
+    std::shared_ptr<CallRecorder> m_recorder;
+    JitterBufferProfile m_jbProfile;
+    std::atomic<bool> m_jbProfileApplied { false };
 };
\ No newline at end of file
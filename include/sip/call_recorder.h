@@ -0,0 +1,261 @@
+// call_recorder.h
+#pragma once
+
+#include "utils/logger.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deps/json.hpp>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <pjsua2.hpp>
+#include <queue>
+#include <string>
+#include <thread>
+#include <vector>
+
+using json = nlohmann::json;
+
+// Inbound audio of one call, with the arrival time of every frame, so the
+// call can be pushed through the pipeline again by tools/pipeline_replay.
+// Frames are kept in memory and written when the call ends, so the media
+// thread never touches the disk, and saved by CallRecordingWriter so the
+// end of the call doesn't either. Enabled per agent with "record_calls": true;
+// files go to CALL_RECORD_DIR.
+//
+// File layout: one JSON header line, then for each frame
+//   uint64 offset_us (since the first frame), uint32 samples, int16 pcm[samples]
+class CallRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        uint64_t offsetUs;
+        std::vector<int16_t> samples;
+    };
+
+    struct Recording {
+        json header;
+        std::vector<Frame> frames;
+    };
+
+    CallRecorder(std::filesystem::path path, json header, std::chrono::seconds maxDuration) :
+        m_path(std::move(path)),
+        m_header(std::move(header)),
+        m_maxDurationUs(std::chrono::duration_cast<std::chrono::microseconds>(maxDuration).count())
+    {
+        // A minute of 20 ms frames at 8 kHz before the first reallocation
+        m_samples.reserve(8000 * 60);
+        m_index.reserve(50 * 60);
+    }
+
+    // Media thread
+    void addFrame(const pj::MediaFrame &frame)
+    {
+        if (frame.size == 0) {
+            return;
+        }
+        const auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_started) {
+            m_started = now;
+        }
+        const auto offsetUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - *m_started).count());
+        if (offsetUs > static_cast<uint64_t>(m_maxDurationUs)) {
+            return;
+        }
+        const auto *pcm = reinterpret_cast<const int16_t *>(frame.buf.data());
+        const uint32_t count = frame.size / sizeof(int16_t);
+        m_index.push_back({ offsetUs, count });
+        m_samples.insert(m_samples.end(), pcm, pcm + count);
+    }
+
+    // Extra header field, e.g. the live turn latencies to compare a replay against
+    void annotate(const std::string &key, json value)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_header[key] = std::move(value);
+    }
+
+    bool save()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_index.empty()) {
+            return false;
+        }
+        std::error_code ec;
+        if (m_path.has_parent_path()) {
+            std::filesystem::create_directories(m_path.parent_path(), ec);
+        }
+        std::ofstream file(m_path, std::ios::binary);
+        if (!file) {
+            LOG_ERROR << "Cannot write call recording " << m_path.string();
+            return false;
+        }
+        auto header = m_header;
+        header["format"] = "pcmrec";
+        header["version"] = 1;
+        header["frames"] = m_index.size();
+        file << header.dump() << '\n';
+
+        size_t position = 0;
+        for (const auto &[offsetUs, count]: m_index) {
+            file.write(reinterpret_cast<const char *>(&offsetUs), sizeof(offsetUs));
+            file.write(reinterpret_cast<const char *>(&count), sizeof(count));
+            file.write(reinterpret_cast<const char *>(m_samples.data() + position), count * sizeof(int16_t));
+            position += count;
+        }
+        LOG_INFO << "Saved call recording " << m_path.string() << " (" << m_index.size() << " frames)";
+        return static_cast<bool>(file);
+    }
+
+    // Copy of an agent config without credentials (api_key, Authorization
+    // headers, passwords), fit for the header. Replays fall back to the
+    // provider's config file for them.
+    static json redact(const json &config)
+    {
+        if (config.is_array()) {
+            json result = json::array();
+            for (const auto &item: config) {
+                result.push_back(redact(item));
+            }
+            return result;
+        }
+        if (!config.is_object()) {
+            return config;
+        }
+        json result = json::object();
+        for (const auto &[key, value]: config.items()) {
+            if (!isSecret(key)) {
+                result[key] = redact(value);
+            }
+        }
+        return result;
+    }
+
+    static std::optional<Recording> load(const std::filesystem::path &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string line;
+        if (!file || !std::getline(file, line)) {
+            return std::nullopt;
+        }
+        Recording recording;
+        recording.header = json::parse(line, nullptr, false);
+        if (!recording.header.is_object() || recording.header.value("format", "") != "pcmrec") {
+            return std::nullopt;
+        }
+        while (true) {
+            Frame frame;
+            uint32_t count = 0;
+            if (!file.read(reinterpret_cast<char *>(&frame.offsetUs), sizeof(frame.offsetUs)) ||
+                !file.read(reinterpret_cast<char *>(&count), sizeof(count))) {
+                break;
+            }
+            frame.samples.resize(count);
+            if (!file.read(reinterpret_cast<char *>(frame.samples.data()), count * sizeof(int16_t))) {
+                break;
+            }
+            recording.frames.push_back(std::move(frame));
+        }
+        return recording;
+    }
+
+private:
+    static bool isSecret(std::string key)
+    {
+        // Header names too: X-Api-Key reads as x_api_key
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return c == '-' ? '_' : std::tolower(c); });
+        auto endsWith = [&](const std::string &suffix) {
+            return key.size() >= suffix.size() && key.compare(key.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        return key == "authorization" || key == "password" || key == "secret" || key == "token" ||
+            endsWith("_key") || endsWith("apikey") || endsWith("_secret") || endsWith("_password") ||
+            endsWith("_token");
+    }
+
+    struct IndexEntry {
+        uint64_t offsetUs;
+        uint32_t count;
+    };
+
+    const std::filesystem::path m_path;
+    json m_header;
+    const int64_t m_maxDurationUs;
+
+    std::mutex m_mutex;
+    std::optional<Clock::time_point> m_started;
+    std::vector<IndexEntry> m_index;
+    std::vector<int16_t> m_samples;
+};
+
+// Saves finished recordings on a thread of its own. A long call holds up to
+// CALL_RECORD_MAX_SEC of audio, and the call is deleted on the Manager's
+// worker, which shouldn't stall on the disk meanwhile. Recordings still
+// queued at exit are written before the thread is joined.
+class CallRecordingWriter {
+public:
+    static CallRecordingWriter &getInstance()
+    {
+        static CallRecordingWriter instance;
+        return instance;
+    }
+
+    void enqueue(std::shared_ptr<CallRecorder> recorder)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_stopping) {
+            lock.unlock();
+            recorder->save();
+            return;
+        }
+        m_pending.push(std::move(recorder));
+        if (!m_thread.joinable()) {
+            m_thread = std::thread(&CallRecordingWriter::run, this);
+        }
+        lock.unlock();
+        m_condition.notify_one();
+    }
+
+    ~CallRecordingWriter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_condition.notify_all();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+private:
+    CallRecordingWriter() = default;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(lock, [this] { return !m_pending.empty() || m_stopping; });
+            if (m_pending.empty()) {
+                return;
+            }
+            auto recorder = std::move(m_pending.front());
+            m_pending.pop();
+            lock.unlock();
+            recorder->save();
+            lock.lock();
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::queue<std::shared_ptr<CallRecorder>> m_pending;
+    bool m_stopping = false;
+    std::thread m_thread;
+};
@@ -0,0 +1,120 @@
+// call_stats.h
+#pragma once
+
+#include "agent/turn_trace.h"
+#include <deps/json.hpp>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+// Snapshot of one call's media quality, sampled periodically by the Manager.
+// Values are copied out of pjsua so readers never touch the live stream.
+struct CallStats {
+    int callId = -1;
+    std::string remoteUri;
+    std::string state;
+    std::string direction;
+    std::string agentId;
+    long durationSec = 0;
+    int64_t sampledAtMs = 0;
+
+    bool mediaActive = false;
+    std::string codec;
+    unsigned clockRate = 0;
+
+    double rttMs = 0;
+    double rttLastMs = 0;
+
+    unsigned rxPackets = 0;
+    unsigned rxLoss = 0;
+    unsigned rxDiscard = 0;
+    double rxJitterMs = 0;
+    double rxJitterLastMs = 0;
+
+    unsigned txPackets = 0;
+    unsigned txLoss = 0;
+    double txJitterMs = 0;
+
+    unsigned jbFrameSize = 0;
+    unsigned jbPrefetch = 0;
+    unsigned jbMinPrefetch = 0;
+    unsigned jbMaxPrefetch = 0;
+    unsigned jbSize = 0;
+    unsigned jbAvgDelayMs = 0;
+    unsigned jbMaxDelayMs = 0;
+    unsigned jbLost = 0;
+    unsigned jbDiscard = 0;
+    unsigned jbEmpty = 0;
+
+    // Profile requested by the agent; -1 means the pjmedia default was kept
+    bool jbProfileApplied = false;
+    int jbProfileInitMs = -1;
+    int jbProfileMinPrefetchMs = -1;
+    int jbProfileMaxPrefetchMs = -1;
+    int jbProfileMaxMs = -1;
+    std::string jbProfileDiscard;
+
+    uint64_t framesPlayed = 0;
+    uint64_t framesReceived = 0;
+    uint64_t playoutUnderruns = 0;
+
+    // Latency breakdown of the call's recent turns, oldest first
+    std::vector<TurnTrace> turns;
+};
+
+inline void to_json(json &j, const CallStats &s)
+{
+    j = json {
+        { "callId", s.callId },
+        { "remoteUri", s.remoteUri },
+        { "state", s.state },
+        { "direction", s.direction },
+        { "agentId", s.agentId },
+        { "durationSec", s.durationSec },
+        { "sampledAtMs", s.sampledAtMs },
+        { "mediaActive", s.mediaActive },
+        { "codec", s.codec },
+        { "clockRate", s.clockRate },
+        { "rtt", { { "meanMs", s.rttMs }, { "lastMs", s.rttLastMs } } },
+        { "rx", {
+                    { "packets", s.rxPackets },
+                    { "loss", s.rxLoss },
+                    { "discard", s.rxDiscard },
+                    { "jitterMs", s.rxJitterMs },
+                    { "jitterLastMs", s.rxJitterLastMs },
+                } },
+        { "tx", {
+                    { "packets", s.txPackets },
+                    { "loss", s.txLoss },
+                    { "jitterMs", s.txJitterMs },
+                } },
+        { "jitterBuffer", {
+                              { "frameSize", s.jbFrameSize },
+                              { "prefetch", s.jbPrefetch },
+                              { "minPrefetch", s.jbMinPrefetch },
+                              { "maxPrefetch", s.jbMaxPrefetch },
+                              { "size", s.jbSize },
+                              { "avgDelayMs", s.jbAvgDelayMs },
+                              { "maxDelayMs", s.jbMaxDelayMs },
+                              { "lost", s.jbLost },
+                              { "discard", s.jbDiscard },
+                              { "empty", s.jbEmpty },
+                              { "profile", {
+                                               { "applied", s.jbProfileApplied },
+                                               { "initMs", s.jbProfileInitMs },
+                                               { "minPrefetchMs", s.jbProfileMinPrefetchMs },
+                                               { "maxPrefetchMs", s.jbProfileMaxPrefetchMs },
+                                               { "maxMs", s.jbProfileMaxMs },
+                                               { "discard", s.jbProfileDiscard },
+                                           } },
+                          } },
+        { "frames", {
+                        { "played", s.framesPlayed },
+                        { "received", s.framesReceived },
+                        { "playoutUnderruns", s.playoutUnderruns },
+                    } },
+        { "turns", s.turns },
+    };
+}
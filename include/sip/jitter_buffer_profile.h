@@ -0,0 +1,69 @@
+// jitter_buffer_profile.h
+#pragma once
+
+#include <deps/json.hpp>
+#include <pjsua2.hpp>
+#include <string>
+
+using json = nlohmann::json;
+
+// Per-agent jitter buffer tuning, read from the agent config:
+//
+//   "jitter_buffer": { "init_ms": 20, "min_prefetch_ms": 20, "max_prefetch_ms": 60,
+//                      "max_ms": 200, "discard": "progressive" }
+//
+// Values of -1 keep pjmedia's defaults. Smaller prefetch means less receive
+// delay in front of the VAD at the cost of more discards on jittery trunks.
+struct JitterBufferProfile {
+    bool enabled = false;
+    int initMs = -1;
+    int minPrefetchMs = -1;
+    int maxPrefetchMs = -1;
+    int maxMs = -1;
+    pjmedia_jb_discard_algo discard = PJMEDIA_JB_DISCARD_PROGRESSIVE;
+
+    static JitterBufferProfile fromConfig(const json &config)
+    {
+        JitterBufferProfile profile;
+        if (!config.contains("jitter_buffer") || !config["jitter_buffer"].is_object()) {
+            return profile;
+        }
+        const auto &jb = config["jitter_buffer"];
+        profile.enabled = true;
+        profile.initMs = jb.value("init_ms", -1);
+        profile.minPrefetchMs = jb.value("min_prefetch_ms", -1);
+        profile.maxPrefetchMs = jb.value("max_prefetch_ms", -1);
+        profile.maxMs = jb.value("max_ms", -1);
+
+        const std::string discard = jb.value("discard", "progressive");
+        if (discard == "none") {
+            profile.discard = PJMEDIA_JB_DISCARD_NONE;
+        } else if (discard == "static") {
+            profile.discard = PJMEDIA_JB_DISCARD_STATIC;
+        } else {
+            profile.discard = PJMEDIA_JB_DISCARD_PROGRESSIVE;
+        }
+        return profile;
+    }
+
+    void applyTo(pj::StreamInfo &info) const
+    {
+        if (!enabled) {
+            return;
+        }
+        info.jbInit = initMs;
+        info.jbMinPre = minPrefetchMs;
+        info.jbMaxPre = maxPrefetchMs;
+        info.jbMax = maxMs;
+        info.jbDiscardAlgo = discard;
+    }
+
+    const char *discardName() const
+    {
+        switch (discard) {
+            case PJMEDIA_JB_DISCARD_NONE: return "none";
+            case PJMEDIA_JB_DISCARD_STATIC: return "static";
+            default: return "progressive";
+        }
+    }
+};
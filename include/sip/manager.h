@@ -7,15 +7,18 @@
 #include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <pjsua2.hpp>
 #include <queue>
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "agent/agent.h"
 #include "sip/account.h"
 #include "sip/call.h"
+#include "sip/call_stats.h"
 
 struct RegistrationStatus {
     bool success;
@@ -42,6 +45,12 @@ public:
     void hangupCall(int callId);
     void shutdown();
 
+    size_t activeCallCount() const;
+
+    // Cached quality stats, refreshed by the stats thread every CALL_STATS_INTERVAL_MS
+    std::vector<CallStats> getCallStats() const;
+    std::optional<CallStats> getCallStats(int callId) const;
+
 private:
     class TaskQueue {
     public:
@@ -57,6 +66,10 @@ private:
     };
 
     void workerThreadMain();
+    void statsThreadMain();
+    void sampleCallStats();
+    void adoptCall(Call *call);
+    void retireCall(Call *call);
     void shutdownPjsip();
     void enqueueTask(std::function<void()> task);
 
@@ -68,7 +81,14 @@ private:
     std::unique_ptr<std::thread> m_workerThread;
     std::atomic<bool> m_running { true };
     std::mutex m_accountsMutex;
-    std::mutex m_callsMutex;
+    mutable std::mutex m_callsMutex;
+
+    std::unique_ptr<std::thread> m_statsThread;
+    std::mutex m_statsWaitMutex;
+    std::condition_variable m_statsCondition;
+    std::chrono::milliseconds m_statsInterval { 1000 };
+    mutable std::mutex m_statsMutex;
+    std::unordered_map<int, CallStats> m_callStats;
 
     AgentManager& m_agentManager = AgentManager::getInstance();
 };
@@ -1,13 +1,20 @@
 // media_port.h
 #pragma once
 
+#include "sip/call_recorder.h"
 #include "sip/vad.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <pjsua2.hpp>
 #include <queue>
 #include <vector>
 
 class MediaPort: public pj::AudioMediaPort {
 public:
+    using PlayoutStartedCallback = std::function<void()>;
+
     VAD vad;
 
     explicit MediaPort();
@@ -15,10 +22,26 @@ public:
     void onFrameRequested(pj::MediaFrame &frame) override;
     void onFrameReceived(pj::MediaFrame &frame) override;
     void clearQueue();
+    // Captures inbound frames; set before the port starts receiving
+    void setRecorder(std::shared_ptr<CallRecorder> recorder) { m_recorder = std::move(recorder); }
+    // Media thread: the first non-silent frame after the queue ran dry or
+    // was cleared, i.e. when a reply becomes audible. Set before playout starts.
+    void setPlayoutStartedCallback(PlayoutStartedCallback callback) { m_onPlayoutStarted = std::move(callback); }
+
+    uint64_t framesPlayed() const { return m_framesPlayed.load(std::memory_order_relaxed); }
+    uint64_t framesReceived() const { return m_framesReceived.load(std::memory_order_relaxed); }
+    uint64_t playoutUnderruns() const { return m_playoutUnderruns.load(std::memory_order_relaxed); }
 
 private:
     size_t frameSize = 320;
     std::queue<std::vector<int16_t>> audioQueue;
     std::vector<int16_t> pcmBuffer;
     size_t pcmBufferIndex = 0;
+    std::shared_ptr<CallRecorder> m_recorder;
+    PlayoutStartedCallback m_onPlayoutStarted;
+    bool m_audible = false;
+
+    std::atomic<uint64_t> m_framesPlayed { 0 };
+    std::atomic<uint64_t> m_framesReceived { 0 };
+    std::atomic<uint64_t> m_playoutUnderruns { 0 };
 };
@@ -2,12 +2,19 @@
 #include "abs_ws_client.h"
 #include "deps/json.hpp"
 #include "utils/logger.h"
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <mutex>
 #include <vector>
+// Binary audio frames carry no request id, so the client attributes them to
+// the oldest request that hasn't finished yet: the server synthesizes one
+// request at a time, in order, and reports a status when each one ends.
+// Every chunk is handed on with the id given to synthesize_text(), which
+// lets the caller drop audio of a turn that is no longer current.
 class AuralisClient: public AbstractWebSocketClient {
 public:
-    using AudioChunkCallback = std::function<void(const std::vector<int16_t> &)>;
+    using AudioChunkCallback = std::function<void(const std::vector<int16_t> &, uint64_t request_id)>;
     using StatusCallback = std::function<void(const std::string &)>;
 
     void set_audio_callback(AudioChunkCallback callback)
@@ -20,7 +27,7 @@ public:
         status_callback = callback;
     }
 
-    void synthesize_text(const std::string &text, const std::string &voice = "default", bool stream = true, float temperature = 0.5)
+    void synthesize_text(const std::string &text, uint64_t request_id = 0, const std::string &voice = "default", bool stream = true, float temperature = 0.5)
     {
         if (!connected) {
             LOG_ERROR << "Auralis TTS client is not connected";
@@ -34,7 +41,10 @@ public:
             request["stream"] = stream;
             request["temperature"] = temperature;
             request["type"] = "synthesize";
+            request["id"] = request_id;
+            std::lock_guard<std::mutex> lock(pending_mutex);
             client.send(connection, request.dump(), websocketpp::frame::opcode::text);
+            pending.push_back({ request_id, false });
         } catch (const std::exception &e) {
             LOG_ERROR << "Error sending text to Auralis TTS: " << e.what();
         }
@@ -51,19 +61,23 @@ protected:
                 std::memcpy(audio_data.data(), payload.data(), payload.size());
                 LOG_DEBUG << "Received audio data: " << audio_data.size() << " samples";
 
+                const uint64_t request_id = current_request();
                 if (audio_callback) {
-                    audio_callback(audio_data);
+                    audio_callback(audio_data, request_id);
                 }
             } else {
                 // Handle JSON status and error messages
                 auto json_msg = nlohmann::json::parse(msg->get_payload());
                 if (json_msg.contains("status")) {
                     std::string status = json_msg["status"].get<std::string>();
+                    track_status(status, json_msg);
                     if (status_callback) {
                         status_callback(status);
                     }
                 } else if (json_msg.contains("error")) {
                     std::string error = json_msg["error"].get<std::string>();
+                    LOG_DEBUG << "Auralis TTS request failed: " << error;
+                    track_status("error", json_msg);
                 }
             }
         } catch (const std::exception &e) {
@@ -79,6 +93,8 @@ protected:
     void on_close(websocketpp::connection_hdl hdl) override
     {
         std::cout << "Disconnected from Auralis TTS server" << std::endl;
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        pending.clear();
     }
 
     void on_error(const std::string &error) override
@@ -87,6 +103,45 @@ protected:
     }
 
 private:
+    struct Request {
+        uint64_t id;
+        bool started;
+    };
+
+    uint64_t current_request()
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        return pending.empty() ? 0 : pending.front().id;
+    }
+
+    // Advances the request queue on the server's lifecycle statuses. An id
+    // echoed back by the server takes precedence over queue order.
+    void track_status(const std::string &status, const nlohmann::json &message)
+    {
+        const bool finished = status == "completed" || status == "done" || status == "finished" || status == "error" || status == "cancelled";
+        std::lock_guard<std::mutex> lock(pending_mutex);
+        if (message.contains("id") && message["id"].is_number_unsigned()) {
+            const auto id = message["id"].get<uint64_t>();
+            while (!pending.empty() && pending.front().id != id) {
+                pending.pop_front();
+            }
+        }
+        if (pending.empty()) {
+            return;
+        }
+        if (status == "started") {
+            // A server that doesn't report completion still starts requests in order
+            if (pending.front().started && pending.size() > 1) {
+                pending.pop_front();
+            }
+            pending.front().started = true;
+        } else if (finished) {
+            pending.pop_front();
+        }
+    }
+
     AudioChunkCallback audio_callback;
     StatusCallback status_callback;
+    std::mutex pending_mutex;
+    std::deque<Request> pending;
 };
\ No newline at end of file
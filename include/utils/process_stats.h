@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <malloc.h>
+
+// Resource usage of this process, for leak tracking (GET /status/process
+// and sip_loadgen --soak). Linux only: values come from /proc/self and
+// glibc's allocator.
+struct ProcessStats {
+    uint64_t rssKb = 0;
+    // Bytes handed out by malloc and not yet freed
+    uint64_t heapBytes = 0;
+    uint64_t openFds = 0;
+    uint64_t threads = 0;
+
+    static ProcessStats sample()
+    {
+        ProcessStats stats;
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.rfind("VmRSS:", 0) == 0) {
+                stats.rssKb = std::stoull(line.substr(6));
+            } else if (line.rfind("Threads:", 0) == 0) {
+                stats.threads = std::stoull(line.substr(8));
+            }
+        }
+
+        std::error_code ec;
+        for (auto it = std::filesystem::directory_iterator("/proc/self/fd", ec);
+             !ec && it != std::filesystem::directory_iterator(); it.increment(ec)) {
+            stats.openFds++;
+        }
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+        const auto info = mallinfo2();
+        stats.heapBytes = info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+        const auto info = mallinfo();
+        stats.heapBytes = static_cast<unsigned>(info.uordblks) + static_cast<unsigned>(info.hblkhd);
+#endif
+        return stats;
+    }
+};
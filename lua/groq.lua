@@ -1,5 +1,4 @@
 local Provider = require("provider")
-local http = require "http.request"
 local cjson = require "cjson"
 
 local function map_history(history)
@@ -13,28 +12,50 @@ local function map_history(history)
     return messages
 end
 
+-- Streams an OpenAI-style SSE response; the sink parses it in C++ and
+-- forwards every content delta
+local function read_stream(stream, sink)
+    local err = Provider.pump(stream, sink, "sse", "choices.0.delta.content")
+    if err then
+        return false, nil, "Groq stream error: " .. tostring(err)
+    end
+
+    local final = sink:last_event()
+    return true, {
+        content = sink:content(),
+        metadata = {
+            model = final and final.model,
+            usage = final and final.x_groq and final.x_groq.usage
+        }
+    }, nil
+end
+
 local groq_provider = Provider.create({
     model = "mixtral-8x7b-32768",
     temperature = 0.7,
     max_tokens = 1024,
     top_p = 1.0,
     stream = false,
-    stop = nil
+    stop = nil,
+    base_url = "https://api.groq.com/openai/v1",
+    timeout = 60
 }, function(params)
         -- Construct API request
-        local messages = map_history(params.history)
-
-        table.insert(messages, {
-            role = "user",
-            content = params.input
-        })
+        local messages = params.messages
+        if not messages then
+            messages = map_history(params.history)
+            table.insert(messages, {
+                role = "user",
+                content = params.input
+            })
+        end
         local request_body = {
             model = params.config.model,
             messages = messages,
             temperature = params.config.temperature,
             max_tokens = params.config.max_tokens,
             top_p = params.config.top_p,
-            stream = params.config.stream,
+            stream = params.sink ~= nil,
         }
 
         if params.config.stop then
@@ -43,27 +64,19 @@ local groq_provider = Provider.create({
   
         local serialized_body = cjson.encode(request_body)
         print(serialized_body)
-        -- Make API call (implementation would use C++ HTTP client)
-        local req = http.new_from_uri("https://api.groq.com/openai/v1/chat/completions")
-        local headers = {
-            ["Content-Type"] = "application/json",
-            ["Authorization"] = "Bearer " .. params.config.api_key,
-            ["Content-Length"] = #serialized_body, -- Important for POST requests
-        }
-
-        req.headers:upsert(":method", "POST")
-        req.headers:upsert("content-type", "application/json")
-        req.headers:upsert("authorization", "Bearer " .. params.config.api_key)
-        req:set_body(serialized_body)
-
-        local headers, stream = assert(req:go())
-        local status = headers:get(":status")
-        if not status then
-            return false, nil, "Missing HTTP status in response"
-        end
-        local status_code = tonumber(status)
+        -- Make API call
+        local status_code, stream, request_err = Provider.post(
+            params.config.base_url .. "/chat/completions",
+            {
+                ["content-type"] = "application/json",
+                ["authorization"] = "Bearer " .. params.config.api_key,
+            },
+            serialized_body,
+            params.config.timeout,
+            params.deadline_ms
+        )
         if not status_code then
-            return false, nil, "Invalid HTTP status code: " .. tostring(status)
+            return false, nil, "Groq request failed: " .. tostring(request_err)
         end
 
         -- Check HTTP status code
@@ -85,6 +98,10 @@ local groq_provider = Provider.create({
             return false, nil, string.format("Groq API error (status %d): %s", status_code, error_message)
         end
 
+        if params.sink then
+            return read_stream(stream, params.sink)
+        end
+
         -- Process successful response
         local body, err = stream:get_body_as_string()
         if err then
@@ -1,5 +1,4 @@
 local Provider = require("provider")
-local http = require "http.request"
 local cjson = require "cjson"
 
 local function map_history(history)
@@ -13,46 +12,124 @@ local function map_history(history)
     return messages
 end
 
+local function response_metadata(response_data)
+    return {
+        model = response_data.model,
+        done = response_data.done,
+        timing = {
+            total_duration = response_data.total_duration,
+            load_duration = response_data.load_duration,
+            prompt_eval_count = response_data.prompt_eval_count,
+            eval_count = response_data.eval_count
+        }
+    }
+end
+
+-- Prefix reuse: the Ollama runner keeps the KV cache of the prompt it last
+-- evaluated, so a prompt that extends the previous one only costs the new
+-- tokens, as long as the model stays loaded (keep_alive) and is not reloaded
+-- with different options (num_ctx). Nothing here selects the cache; the
+-- request settings above keep it alive, and this only reports whether the
+-- turn could have hit it. The session's state travels in the metadata
+-- returned on every turn and comes back as params.metadata.ollama.
+local function is_warm(params, messages)
+    local previous = params.metadata and params.metadata.ollama
+    return previous ~= nil
+        and params.prompt_id ~= nil
+        and previous.prompt_id == params.prompt_id
+        and previous.model == params.config.model
+        and previous.messages < #messages
+end
+
+local function session_state(params, messages, warm, timing)
+    if params.prompt_id == nil then
+        return nil
+    end
+    local previous = params.metadata.ollama
+    -- prompt_eval_count only counts the prompt tokens Ollama had to
+    -- evaluate, so the reused prefix is whatever the runner held after the
+    -- previous turn: its prompt plus its reply
+    local cached = warm and previous.context_tokens or 0
+    local evaluated = timing and timing.prompt_eval_count or 0
+    return {
+        model = params.config.model,
+        prompt_id = params.prompt_id,
+        -- Messages covered by the cached prefix, including the reply
+        messages = #messages + 1,
+        warm = warm,
+        turns = (warm and previous.turns or 0) + 1,
+        prompt_eval_count = timing and timing.prompt_eval_count,
+        -- Prompt tokens served from the cache this turn
+        cached_tokens = cached,
+        -- Tokens in the runner's cache after this turn
+        context_tokens = cached + evaluated + (timing and timing.eval_count or 0)
+    }
+end
+
+-- Streams an NDJSON /api/chat response; the sink parses it in C++ and
+-- forwards every content delta
+local function read_stream(stream, sink)
+    local err = Provider.pump(stream, sink, "ndjson", "message.content")
+    if err then
+        return false, nil, "Ollama stream error: " .. tostring(err)
+    end
+
+    local final = sink:last_event()
+    local metadata = (final and final.done) and response_metadata(final) or { done = false }
+    return true, { content = sink:content(), metadata = metadata }, nil
+end
+
 local ollama_provider = Provider.create({
     model = "llama3.2:1b", -- Default Ollama model
     temperature = 0.7,
     max_tokens = 1024,
     top_p = 1.0,
     stream = false,
-    stop = nil
+    stop = nil,
+    base_url = "http://ollama:11434",
+    timeout = 120,
+    keep_alive = "30m", -- Keep the model (and the sessions' cached prefixes) loaded between turns
+    num_ctx = 4096 -- Fixed so a request never triggers a reload that drops the cache
 }, function(params)
     -- Construct API request for Ollama
-    local messages = map_history(params.history)
+    local messages = params.messages
+    if not messages then
+        messages = map_history(params.history)
+        table.insert(messages, {
+            role = "user",
+            content = params.input
+        })
+    end
 
-    table.insert(messages, {
-        role = "user",
-        content = params.input
-    })
+    local warm = is_warm(params, messages)
 
     local request_body = {
         model = params.config.model,
         messages = messages,
-        stream = false,
+        stream = params.sink ~= nil,
+        keep_alive = params.config.keep_alive,
         options = {
             temperature = params.config.temperature,
             top_p = params.config.top_p,
             stop = params.config.stop,
             num_predict = params.config.max_tokens,
-
+            num_ctx = params.config.num_ctx
         }
     }
 
     local serialized_body = cjson.encode(request_body)
 
     -- Make API call to local Ollama instance
-    local req = http.new_from_uri("http://ollama:11434/api/chat")
-    req.headers:upsert(":method", "POST")
-    req.headers:upsert("content-type", "application/json")
-    req:set_body(serialized_body)
-
-    local headers, stream = assert(req:go())
-    local status = headers:get(":status")
-    local status_code = tonumber(status)
+    local status_code, stream, request_err = Provider.post(
+        params.config.base_url .. "/api/chat",
+        { ["content-type"] = "application/json" },
+        serialized_body,
+        params.config.timeout,
+        params.deadline_ms
+    )
+    if not status_code then
+        return false, nil, "Ollama request failed: " .. tostring(request_err)
+    end
 
     if status_code ~= 200 then
         local body = stream:get_body_as_string() or "No response body"
@@ -69,6 +146,14 @@ local ollama_provider = Provider.create({
         return false, nil, string.format("Ollama API error (status %d): %s", status_code, error_message)
     end
 
+    if params.sink then
+        local ok, result, err = read_stream(stream, params.sink)
+        if ok and result.metadata.done then
+            result.metadata.ollama = session_state(params, messages, warm, result.metadata.timing)
+        end
+        return ok, result, err
+    end
+
     -- Process successful response
     local body, err = stream:get_body_as_string()
     if err then
@@ -84,18 +169,12 @@ local ollama_provider = Provider.create({
         return false, nil, "No message in API response"
     end
 
+    local metadata = response_metadata(response_data)
+    metadata.ollama = session_state(params, messages, warm, metadata.timing)
+
     return true, {
         content = response_data.message.content,
-        metadata = {
-            model = response_data.model,
-            done = response_data.done,
-            timing = {
-                total_duration = response_data.total_duration,
-                load_duration = response_data.load_duration,
-                prompt_eval_count = response_data.prompt_eval_count,
-                eval_count = response_data.eval_count
-            }
-        }
+        metadata = metadata
     }, nil
 end
 )
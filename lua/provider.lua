@@ -18,6 +18,32 @@ function print_table(tbl, indent)
     end
 end
 
+local json_view_ok, json_view = pcall(require, "json_view")
+
+--[[
+    Whether a value can be read like a table: a Lua table, or a read-only
+    JsonView over the request's json (config, options, history, metadata)
+    @param value {any} - Value to check
+    @returns {boolean}
+]]
+local function is_table(value)
+    return type(value) == "table" or (json_view_ok and json_view.is_view(value))
+end
+
+--[[
+    Copies a JsonView into plain Lua tables so it can be modified or passed to
+    cjson; any other value is returned as is
+    @param value {any} - Value to convert
+    @returns {any}
+]]
+local function plain(value)
+    if type(value) == "userdata" and json_view_ok and json_view.is_view(value) then
+        return json_view.totable(value)
+    end
+    return value
+end
+M.plain = plain
+
 --[[
     Deep merges multiple tables with specified collision strategy
     @param mode {'force'|'keep'|'error'} - Merge strategy
@@ -29,26 +55,26 @@ local function deep_merge(mode, target, ...)
     local sources = { ... }
     
     for _, source in ipairs(sources) do
-        if type(source) ~= "table" then
+        if not is_table(source) then
             error(string.format("Invalid source type: expected table, got %s", type(source)))
         end
 
         for key, value in pairs(source) do
             if mode == 'force' then
-                if type(value) == "table" and type(target[key]) == "table" then
+                if is_table(value) and type(target[key]) == "table" then
                     deep_merge(mode, target[key], value)
                 else
-                    target[key] = value
+                    target[key] = plain(value)
                 end
             elseif mode == 'keep' then
                 if target[key] == nil then
-                    target[key] = value
+                    target[key] = plain(value)
                 end
             elseif mode == 'error' then
                 if target[key] ~= nil then
                     error(string.format("Key collision at '%s'", key))
                 end
-                target[key] = value
+                target[key] = plain(value)
             end
         end
     end
@@ -56,6 +82,127 @@ local function deep_merge(mode, target, ...)
     return target
 end
 
+local native_http_ok, native_http = pcall(require, "native_http")
+
+--[[
+    Wraps a lua-http stream so that no read outlives `deadline`: a suspended
+    coroutine runs no Lua, so the execution budget cannot stop a read that
+    waits on a stalled server.
+    @param stream {stream} - lua-http response stream
+    @param deadline {number} - cqueues.monotime() at which reads give up
+    @returns {table} - Stream with each_chunk, get_body_as_string and shutdown;
+        read_error holds the error that ended each_chunk early, if any
+]]
+local function deadline_stream(stream, deadline)
+    local monotime = require("cqueues").monotime
+    local wrapped = {}
+
+    function wrapped:each_chunk()
+        return function()
+            local remaining = deadline - monotime()
+            if remaining <= 0 then
+                wrapped.read_error = "deadline exceeded"
+                return nil
+            end
+            local chunk, err = stream:get_next_chunk(remaining)
+            if chunk == nil and err ~= nil then
+                wrapped.read_error = deadline - monotime() <= 0 and "deadline exceeded" or tostring(err)
+            end
+            return chunk
+        end
+    end
+
+    function wrapped:get_body_as_string()
+        local remaining = deadline - monotime()
+        if remaining <= 0 then
+            return nil, "deadline exceeded"
+        end
+        return stream:get_body_as_string(remaining)
+    end
+
+    function wrapped:shutdown()
+        return stream:shutdown()
+    end
+
+    return wrapped
+end
+
+--[[
+    POSTs a request and returns the response status and body stream. Uses the
+    pooled keep-alive native_http client, or lua-http when running on the
+    cqueues event loop, where a blocking call would stall every coroutine on
+    the thread, and for https URLs when native_http was built without TLS.
+    Both streams offer each_chunk, get_body_as_string and shutdown.
+    @param url {string} - Request URL
+    @param headers {table} - Request headers (lowercase names)
+    @param body {string} - Request body
+    @param timeout {number} - (Optional) Timeout in seconds for each read
+    @param deadline_ms {number} - (Optional) params.deadline_ms; bounds the whole
+        exchange, body included
+    @returns {number, stream} | {nil, nil, string} - Status and body stream, or an error
+]]
+function M.post(url, headers, body, timeout, deadline_ms)
+    local native = native_http_ok and not provider_async
+        and (native_http.ssl or not url:match("^https:"))
+    if native then
+        local stream, err = native_http.stream({
+            url = url,
+            method = "POST",
+            headers = headers,
+            body = body,
+            timeout = timeout,
+            deadline = deadline_ms and deadline_ms / 1000 or nil
+        })
+        if not stream then
+            return nil, nil, err
+        end
+        return stream:status(), stream
+    end
+
+    local http = require "http.request"
+    local req = http.new_from_uri(url)
+    req.headers:upsert(":method", "POST")
+    for name, value in pairs(headers or {}) do
+        req.headers:upsert(name, value)
+    end
+    req:set_body(body)
+
+    local deadline
+    if deadline_ms then
+        deadline = require("cqueues").monotime() + deadline_ms / 1000
+        timeout = math.min(timeout or math.huge, deadline_ms / 1000)
+    end
+    local response_headers, stream = req:go(timeout)
+    if not response_headers then
+        return nil, nil, tostring(stream)
+    end
+    if deadline then
+        stream = deadline_stream(stream, deadline)
+    end
+    return tonumber(response_headers:get(":status")), stream
+end
+
+--[[
+    Streams a response body through the C++ sink, which frames and parses it
+    and forwards each content delta to the caller.
+    @param stream {stream} - Response body stream from M.post
+    @param sink {ChunkSink} - params.sink
+    @param format {'ndjson'|'sse'} - Wire format of the body
+    @param delta_path {string} - Dotted path of the text delta in each event
+    @returns {string|nil} - Error reported by the sink or the stream, if any
+]]
+function M.pump(stream, sink, format, delta_path)
+    sink:decode(format, delta_path)
+    for chunk in stream:each_chunk() do
+        if not sink:write(chunk) then
+            break
+        end
+    end
+    sink:finish()
+    stream:shutdown()
+    return sink:error() or (type(stream) == "table" and stream.read_error or nil)
+end
+
 --[[
     Creates a new provider instance
     @param defaults {table} - Default configuration values
@@ -96,6 +243,17 @@ function M.create(defaults, request_handler)
             params.options or {}
         )
 
+        -- The caller's turn deadline caps the provider's own timeout, so a
+        -- slow backend gives up in time for the caller to say something else
+        local deadline_ms = tonumber(params.deadline_ms)
+        if deadline_ms then
+            if deadline_ms <= 0 then
+                return false, nil, "deadline exceeded"
+            end
+            local remaining = math.max(1, math.ceil(deadline_ms / 1000))
+            config.timeout = math.min(tonumber(config.timeout) or remaining, remaining)
+        end
+
         -- Validate API key presence and format
         if not config.api_key or type(config.api_key) ~= "string" or config.api_key == "" then
             return false, nil, "Invalid or missing API key"
@@ -104,9 +262,24 @@ function M.create(defaults, request_handler)
         -- Prepare handler arguments
         local handler_args = {
             input = tostring(params.input or ""),
-            history = type(params.history) == "table" and params.history or {},
+            -- history and metadata are read-only views (see is_table); use
+            -- M.plain for a modifiable copy
+            history = is_table(params.history) and params.history or {},
+            -- Provider-ready messages (ending with the user's input), shared with
+            -- the C++ prompt cache: read it, never modify it
+            messages = params.messages,
+            -- Identifies the conversation prompt params.messages belongs to
+            prompt_id = params.prompt_id,
             config = config,
-            metadata = provider.metadata
+            -- Metadata returned by this provider on the session's previous turn
+            metadata = is_table(params.metadata) and params.metadata or {},
+            -- Time left for this request in ms, or nil; config.timeout is
+            -- already capped by it
+            deadline_ms = deadline_ms,
+            -- Present when the caller consumes tokens as they arrive; see
+            -- M.pump for feeding it a response body
+            sink = params.sink,
+            emit = params.emit
         }
 
         -- Execute handler with protected call
@@ -4,7 +4,6 @@
 #include <mutex>
 #include <regex>
 #include <string>
-#define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "agent/agent.h"
 #include "core/configuration.h"
 #include "db/GlobalDatabase.h"
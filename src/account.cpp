@@ -24,6 +24,23 @@ void Account::registerRegStateCallback(onRegStateCallback cb)
     regStateCallback = std::move(cb);
 }
 
+void Account::registerIncomingCallCallback(onIncomingCallCallback cb)
+{
+    incomingCallCallback = std::move(cb);
+}
+
+void Account::registerCallEndedCallback(onCallEndedCallback cb)
+{
+    callEndedCallback = std::move(cb);
+}
+
+void Account::notifyCallEnded(Call *call)
+{
+    if (callEndedCallback) {
+        callEndedCallback(call);
+    }
+}
+
 void Account::onRegState(pj::OnRegStateParam &prm) {
     pj::AccountInfo ai = getInfo();
     if (regStateCallback) {
@@ -45,6 +62,9 @@ void Account::onIncomingCall(pj::OnIncomingCallParam &iprm)
     prm.statusCode = PJSIP_SC_OK;
     call->direction = Call::INCOMING;
     call->answer(prm);
+    if (incomingCallCallback) {
+        incomingCallCallback(call);
+    }
 }
 
 Account::~Account() { }
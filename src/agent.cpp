@@ -1,68 +1,63 @@
 
 #include "agent/agent.h"
-#include "provider/provider_manager.h"
 #include "utils/logger.h"
 
-void Agent::set_speech_callback(SpeechCallback callback)
+std::string Agent::process_message(const std::string &text)
 {
-    this->auralis_client_->set_audio_callback(callback);
+    auto config = config_snapshot();
+    std::shared_ptr<AgentSession> session;
+    {
+        std::lock_guard<std::mutex> lock(rest_session_mutex_);
+        if (!rest_session_) {
+            rest_session_ = std::make_shared<AgentSession>(config);
+            // REST turns yield to live calls on a capped provider
+            rest_session_->set_priority(FairLimiter::Priority::Batch);
+        }
+        session = rest_session_;
+    }
+    if (session->config() != config) {
+        session->set_config(config);
+    }
+    return session->process_message(text);
 }
 
-void Agent::connect_services()
+std::shared_ptr<AgentSession> Agent::acquire_session()
 {
-    try {
-        this->whisper_client_->connect("ws://stt:8765");
-        this->whisper_client_->set_transcription_callback(
-            [this](const std::string &transcription) {
-                auto res = this->process_message(transcription);
-                this->generate_audio(res);
-            });
-        this->auralis_client_->connect("ws://tts:8766");
-    } catch (...) {
-        
+    auto config = config_snapshot();
+    std::shared_ptr<AgentSession> session;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (!idle_sessions_.empty()) {
+            session = std::move(idle_sessions_.back());
+            idle_sessions_.pop_back();
+        }
     }
-}
-void Agent::process_audio(const std::vector<int16_t> &audio_data)
-{
 
-    this->whisper_client_->send_audio(audio_data);
-}
-
-void Agent::generate_audio(const std::string &text)
-{
-    this->auralis_client_->synthesize_text(text);
+    if (session) {
+        session->reset(config);
+    } else {
+        session = std::make_shared<AgentSession>(config);
+    }
+    session->connect_services();
+    return session;
 }
 
-std::string Agent::process_message(const std::string &text)
+void Agent::release_session(const std::shared_ptr<AgentSession> &session)
 {
-   
-    json history = history_;
-    auto response = ProviderManager::getInstance()
-        .process_request(
-            config_.value("provider", "ollama"), 
-            text, 
-            config_.value("provider_options", json::object()), 
-            history, 
-            metadata_
-        );
-
-    std::string result;
-
-    if (response.success) {
-        result = response.response;
-    } else {
-        LOG_ERROR << "Failed to process message: " << response.error;
-        result = response.error;
+    if (!session) {
+        return;
     }
+    session->reset(nullptr);
 
-    history_mutex_.lock();
-    this->history_.push_back(Message("user", text));
-    history_.push_back(Message("assistant", result));
-    history_mutex_.unlock();
-
-   
-    this->metadata_ = response.metadata;
-    
+    const size_t max_idle = config_snapshot()->value("session_pool_size", 4);
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    if (idle_sessions_.size() < max_idle) {
+        idle_sessions_.push_back(session);
+    }
+}
 
-    return result;
+size_t Agent::idle_sessions() const
+{
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    return idle_sessions_.size();
 }
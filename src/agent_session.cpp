@@ -0,0 +1,459 @@
+#include "agent/agent_session.h"
+#include "agent/sentence_chunker.h"
+#include "core/configuration.h"
+#include "provider/provider_manager.h"
+#include "utils/logger.h"
+
+AgentSession::AgentSession(std::shared_ptr<const json> config) :
+    config_(std::move(config))
+{
+    this->whisper_client_ = std::make_unique<WhisperClient>();
+    this->auralis_client_ = std::make_unique<AuralisClient>();
+    this->auralis_client_->set_audio_callback(
+        [this](const std::vector<int16_t> &audio_data, uint64_t turn) {
+            if (!speech_allowed(turn)) {
+                return;
+            }
+            tracer_.mark(TurnMark::TtsFirstChunk);
+            std::lock_guard<std::mutex> lock(speech_mutex_);
+            if (on_speech_) {
+                on_speech_(audio_data);
+            }
+        });
+}
+
+std::shared_ptr<const json> AgentSession::config() const
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    return config_;
+}
+
+void AgentSession::set_config(std::shared_ptr<const json> config)
+{
+    std::lock_guard<std::mutex> lock(config_mutex_);
+    config_ = std::move(config);
+}
+
+void AgentSession::set_speech_callback(SpeechCallback callback)
+{
+    std::lock_guard<std::mutex> lock(speech_mutex_);
+    on_speech_ = std::move(callback);
+}
+
+void AgentSession::connect_services()
+{
+    if (services_connected_) {
+        return;
+    }
+    try {
+        const auto &app_config = AppConfig::getInstance();
+        this->whisper_client_->connect(app_config.get<std::string>("STT_URI", "ws://stt:8765"));
+        this->whisper_client_->set_transcription_callback(
+            [this](const std::string &transcription) {
+                uint64_t lease = 0;
+                {
+                    std::lock_guard<std::mutex> lock(stt_mutex_);
+                    if (stt_leases_.empty()) {
+                        return;
+                    }
+                    lease = stt_leases_.front();
+                    stt_leases_.pop_front();
+                }
+                if (lease != lease_) {
+                    LOG_DEBUG << "Dropping transcript for a previous caller: " << transcription;
+                    return;
+                }
+                tracer_.transcript_received();
+                this->submit_turn(transcription, lease);
+            });
+        this->auralis_client_->connect(app_config.get<std::string>("TTS_URI", "ws://tts:8766"));
+        services_connected_ = true;
+    } catch (...) {
+
+    }
+}
+
+void AgentSession::reset(std::shared_ptr<const json> config)
+{
+    lease_++;
+    cancel_turn();
+    set_speech_callback(nullptr);
+    tracer_.reset();
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        history_.clear();
+        metadata_ = json::object();
+    }
+    // Late TTS audio of the previous caller carries an old turn id and is
+    // dropped by speech_allowed(); STT segments still in flight keep their
+    // old lease in stt_leases_ and their transcripts are dropped.
+    if (config) {
+        set_config(std::move(config));
+    }
+}
+
+void AgentSession::process_audio(const std::vector<int16_t> &audio_data)
+{
+    {
+        std::lock_guard<std::mutex> lock(stt_mutex_);
+        stt_leases_.push_back(lease_);
+        // STT didn't answer some segments; don't let the queue grow
+        while (stt_leases_.size() > 16) {
+            stt_leases_.pop_front();
+        }
+    }
+    this->whisper_client_->send_audio(audio_data);
+    tracer_.stt_sent();
+}
+
+void AgentSession::generate_audio(const std::string &text, uint64_t turn)
+{
+    tracer_.mark(TurnMark::TtsRequest);
+    this->auralis_client_->synthesize_text(text, turn);
+}
+
+void AgentSession::speak(const std::string &text)
+{
+    tracer_.cancel();
+    auto token = begin_turn();
+    generate_audio(text, token->id());
+}
+
+CancellationTokenPtr AgentSession::begin_turn()
+{
+    std::lock_guard<std::mutex> lock(turn_mutex_);
+    if (current_turn_) {
+        current_turn_->cancel();
+    }
+    current_turn_ = std::make_shared<CancellationToken>(++turn_ids_);
+    return current_turn_;
+}
+
+void AgentSession::cancel_turn()
+{
+    {
+        std::lock_guard<std::mutex> lock(turn_mutex_);
+        if (!current_turn_) {
+            current_turn_ = std::make_shared<CancellationToken>(++turn_ids_);
+        }
+        current_turn_->cancel();
+    }
+    // Synthesis already queued on the TTS server still arrives; it carries
+    // the cancelled turn's id and is dropped by speech_allowed()
+    tracer_.cancel();
+}
+
+bool AgentSession::speech_allowed(uint64_t turn)
+{
+    std::lock_guard<std::mutex> lock(turn_mutex_);
+    if (!current_turn_) {
+        return true;
+    }
+    return current_turn_->id() == turn && !current_turn_->cancelled();
+}
+
+void AgentSession::submit_turn(const std::string &text, uint64_t lease)
+{
+    if (lease != lease_) {
+        return;
+    }
+    auto token = begin_turn();
+    // The event loop multiplexes turns itself; no executor thread is held
+    if (ProviderManager::getInstance().async_enabled() && respond_async(text, token, lease)) {
+        return;
+    }
+    auto self = shared_from_this();
+    bool queued = TurnExecutor::getInstance().submit([self, text, token, lease]() {
+        if (!token->cancelled() && self->lease() == lease) {
+            self->respond(text, token, lease);
+        }
+    });
+    if (!queued) {
+        LOG_WARNING << "Turn executor saturated, dropping turn: " << text;
+    }
+}
+
+void AgentSession::respond(const std::string &text, const CancellationTokenPtr &token, uint64_t lease)
+{
+    auto cancelled = [&token]() { return token && token->cancelled(); };
+    const uint64_t turn = token ? token->id() : 0;
+
+    if (!config()->value("stream_tts", true)) {
+        auto result = run_request(text, nullptr, lease, token);
+        if (!cancelled()) {
+            tracer_.mark(TurnMark::LlmFirstToken);
+            tracer_.mark(TurnMark::LlmLastToken);
+            generate_audio(result, turn);
+        }
+        return;
+    }
+
+    SentenceChunker chunker([this, &cancelled, turn](const std::string &sentence) {
+        if (!cancelled()) {
+            generate_audio(sentence, turn);
+        }
+    });
+    bool first_token = true;
+    auto result = run_request(text, [this, &chunker, &cancelled, &first_token](const std::string &delta) {
+        if (cancelled()) {
+            return false;
+        }
+        if (first_token) {
+            tracer_.mark(TurnMark::LlmFirstToken);
+            first_token = false;
+        }
+        chunker.feed(delta);
+        return true;
+    }, lease, token);
+    if (cancelled()) {
+        return;
+    }
+    tracer_.mark(TurnMark::LlmFirstToken);
+    tracer_.mark(TurnMark::LlmLastToken);
+    chunker.flush();
+
+    // Provider did not stream (or failed before the first token)
+    if (chunker.emitted() == 0 && !result.empty()) {
+        generate_audio(result, turn);
+    }
+}
+
+bool AgentSession::respond_async(const std::string &text, const CancellationTokenPtr &token, uint64_t lease)
+{
+    auto config = this->config();
+    const std::string provider = config->value("provider", "ollama");
+    if (ProviderManager::getInstance().is_native(provider) || config->contains("routing")) {
+        // Native providers block on their own connection, and routed turns
+        // wait on racing attempts; run them on the executor
+        return false;
+    }
+    auto self = shared_from_this();
+
+    auto chunker = std::make_shared<SentenceChunker>([self, token](const std::string &sentence) {
+        if (!token->cancelled()) {
+            self->generate_audio(sentence, token->id());
+        }
+    });
+    ProviderManager::ChunkCallback on_chunk;
+    if (config->value("stream_tts", true)) {
+        on_chunk = [self, chunker, token, first_token = true](const std::string &delta) mutable {
+            if (token->cancelled()) {
+                return false;
+            }
+            if (first_token) {
+                self->tracer_.mark(TurnMark::LlmFirstToken);
+                first_token = false;
+            }
+            chunker->feed(delta);
+            return true;
+        };
+    }
+    json metadata;
+    uint64_t user_seq = 0;
+    auto prompt = begin_request(text, metadata, lease, user_seq);
+    auto on_done = [self, config, token, chunker, lease, user_seq](ProviderManager::RequestResult response) {
+        auto result = self->complete_request(response, *config, lease, user_seq, token);
+        if (token->cancelled()) {
+            return;
+        }
+        self->tracer_.mark(TurnMark::LlmFirstToken);
+        self->tracer_.mark(TurnMark::LlmLastToken);
+        chunker->flush();
+        if (chunker->emitted() == 0 && !result.empty()) {
+            self->generate_audio(result, token->id());
+        }
+    };
+
+    tracer_.llm_started(provider);
+    auto &providers = ProviderManager::getInstance();
+    bool submitted = providers.submit_request(
+        provider,
+        text,
+        providers.tiered_options(provider, config->value("tiers", json::array()), config->value("provider_options", json::object())),
+        prompt,
+        metadata,
+        on_chunk,
+        on_done,
+        request_context(*config, priority_));
+    if (!submitted) {
+        on_done({ false, "", {}, "Provider event loop or queue is saturated" });
+    }
+    return true;
+}
+
+PromptSnapshot AgentSession::begin_request(const std::string &text, json &metadata, uint64_t lease, uint64_t &user_seq)
+{
+    std::lock_guard<std::mutex> lock(history_mutex_);
+    if (lease == lease_) {
+        user_seq = history_.append("user", text);
+    }
+    metadata = metadata_;
+    const auto &prompt = history_.prompt();
+    return PromptSnapshot { prompt, prompt->size(), prompt->back_stamp() };
+}
+
+std::string AgentSession::complete_request(const ProviderManager::RequestResult &response, const json &config, uint64_t lease,
+    uint64_t user_seq, const CancellationTokenPtr &token)
+{
+    std::string result;
+
+    if (response.success) {
+        result = response.response;
+    } else if (response.deadline_exceeded) {
+        // Say something rather than leave the caller in silence
+        LOG_WARNING << "Turn deadline exceeded: " << response.error;
+        result = config.value("fallback_response",
+            "Sorry, that is taking me longer than it should. Could you say that again?");
+    } else {
+        LOG_ERROR << "Failed to process message: " << response.error;
+        result = response.error;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        // The session went back to the pool (and maybe to another caller)
+        // while this request ran
+        if (lease != lease_) {
+            return result;
+        }
+        // Barge-in or a newer turn: the answer was never (fully) spoken
+        if (token && token->cancelled()) {
+            history_.discard_turn(user_seq);
+            return result;
+        }
+        history_.complete_turn(user_seq, result);
+        this->metadata_ = response.metadata;
+    }
+    maybe_compact_history(config, lease);
+
+    return result;
+}
+
+std::string AgentSession::process_message(const std::string &text, ProviderManager::ChunkCallback on_chunk)
+{
+    return run_request(text, std::move(on_chunk), lease_, nullptr);
+}
+
+std::string AgentSession::run_request(const std::string &text, ProviderManager::ChunkCallback on_chunk, uint64_t lease,
+    const CancellationTokenPtr &token)
+{
+    auto config = this->config();
+    json metadata;
+    uint64_t user_seq = 0;
+    auto prompt = begin_request(text, metadata, lease, user_seq);
+
+    auto &providers = ProviderManager::getInstance();
+    const std::string provider = config->value("provider", "ollama");
+    tracer_.llm_started(config->contains("routing") ? "routing" : provider);
+    auto response = config->contains("routing")
+        ? providers.route_request(
+              (*config)["routing"],
+              text,
+              config->value("provider_options", json::object()),
+              prompt,
+              metadata,
+              on_chunk,
+              request_context(*config, priority_))
+        : providers.process_request(
+              provider,
+              text,
+              providers.tiered_options(provider, config->value("tiers", json::array()), config->value("provider_options", json::object())),
+              prompt,
+              metadata,
+              on_chunk,
+              request_context(*config, priority_));
+
+    return complete_request(response, *config, lease, user_seq, token);
+}
+
+ProviderManager::RequestContext AgentSession::request_context(const json &config, FairLimiter::Priority priority) const
+{
+    ProviderManager::RequestContext context;
+    context.tenant = config.value("tenant", context.tenant);
+    context.weight = config.value("tenant_weight", context.weight);
+    context.priority = priority;
+    const int timeout_ms = config.value("turn_timeout_ms", 20000);
+    if (timeout_ms > 0) {
+        context.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    }
+    return context;
+}
+
+void AgentSession::maybe_compact_history(const json &config, uint64_t lease)
+{
+    const auto settings = config.value("history", json::object());
+    const size_t budget = settings.value("token_budget", 2000);
+    const size_t keep_recent = settings.value("keep_recent_messages", 6);
+    const bool summarize_enabled = settings.value("summarize", true);
+
+    ConversationHistory::Compaction job;
+    {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        // Never let the prompt grow past twice the budget, even while a
+        // summary is still being produced
+        history_.truncate(budget * 2);
+        if (history_.tokens() <= budget || compacting_) {
+            return;
+        }
+        job = history_.begin_compaction(keep_recent);
+        if (job.empty()) {
+            history_.truncate(budget);
+            return;
+        }
+        if (!summarize_enabled) {
+            history_.complete_compaction(job, history_.summary());
+            return;
+        }
+        compacting_ = true;
+    }
+
+    auto self = shared_from_this();
+    bool queued = TurnExecutor::getInstance().submit([self, config, job, lease]() {
+        auto summary = self->summarize(config, job);
+        std::lock_guard<std::mutex> lock(self->history_mutex_);
+        self->compacting_ = false;
+        if (!summary.empty() && self->lease_ == lease) {
+            self->history_.complete_compaction(job, summary);
+        }
+    });
+    if (!queued) {
+        std::lock_guard<std::mutex> lock(history_mutex_);
+        compacting_ = false;
+    }
+}
+
+std::string AgentSession::summarize(const json &config, const ConversationHistory::Compaction &job)
+{
+    const auto settings = config.value("history", json::object());
+    std::string transcript;
+    if (!job.previous_summary.empty()) {
+        transcript += "Earlier summary: " + job.previous_summary + "\n";
+    }
+    for (const auto &message: job.messages) {
+        transcript += message.role + ": " + message.content + "\n";
+    }
+
+    const std::string prompt = settings.value("summary_prompt",
+        "Summarize the conversation below in a few sentences. Keep names, facts, "
+        "numbers and anything the assistant promised, so the conversation can "
+        "continue without the original messages.");
+
+    auto options = config.value("provider_options", json::object());
+    if (settings.contains("summary_options")) {
+        options.update(settings["summary_options"]);
+    }
+
+    auto response = ProviderManager::getInstance().process_request(
+        config.value("provider", "ollama"),
+        prompt + "\n\n" + transcript,
+        options,
+        json::array(),
+        json::object(),
+        nullptr,
+        request_context(config, FairLimiter::Priority::Batch));
+    if (!response.success) {
+        LOG_WARNING << "History summarization failed: " << response.error;
+        return "";
+    }
+    return response.response;
+}
@@ -2,18 +2,57 @@
 #include "sip/call.h"
 
 #include "agent/agent.h"
+#include "core/configuration.h"
 #include "utils/logger.h"
+#include <atomic>
+#include <chrono>
+#include <ctime>
 
 void Call::onCallState(pj::OnCallStateParam &prm)
 {
     pj::CallInfo ci = getInfo();
     LOG_DEBUG << "Call " << ci.id << " state: " << ci.stateText;
+    if (ci.state == PJSIP_INV_STATE_DISCONNECTED) {
+        releaseSession();
+        // May delete this call (on the Manager's worker), so nothing after it
+        m_account.notifyCallEnded(this);
+    }
+}
+
+std::shared_ptr<AgentSession> Call::getSession() const
+{
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+    return m_session;
+}
+
+void Call::releaseSession()
+{
+    std::shared_ptr<AgentSession> session;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionMutex);
+        session = std::move(m_session);
+        if (session) {
+            m_turns = session->tracer().traces();
+        }
+    }
+    if (m_agent && session) {
+        m_agent->release_session(session);
+    }
+}
+
+void Call::onStreamPreCreate(pj::OnStreamPreCreateParam &prm)
+{
+    // pjsua builds the jitter buffer from the stream info, so the agent's
+    // profile has to be in place before the stream for active media exists.
+    if (prm.streamInfo.type == PJMEDIA_TYPE_AUDIO) {
+        m_jbProfile.applyTo(prm.streamInfo);
+    }
 }
 
 void Call::onCallMediaState(pj::OnCallMediaStateParam &prm)
 {
 
-    auto agent = getAgent();
+    auto session = getSession();
     pj::CallInfo ci = getInfo();
     LOG_DEBUG << "Call " << ci.id << " media state: " << ci.media[0].status;
 
@@ -24,11 +63,21 @@ void Call::onCallMediaState(pj::OnCallMediaStateParam &prm)
 
             auto portInfo = aud_med->getPortInfo();
             auto format = portInfo.format;
+
+            if (m_jbProfile.enabled) {
+                pj::StreamInfo si = getStreamInfo(i);
+                m_jbProfileApplied = true;
+                LOG_DEBUG << "Call " << ci.id << " jitter buffer: init=" << si.jbInit
+                          << "ms min=" << si.jbMinPre << "ms max=" << si.jbMaxPre
+                          << "ms cap=" << si.jbMax << "ms discard=" << m_jbProfile.discardName();
+            }
             
             if (direction == Call::INCOMING) {
                 std::cout<<" Incoming call from " << ci.remoteUri;
                 LOG_DEBUG << "Incoming call from " << ci.remoteUri;
-                agent->generate_audio("Привет, я твой ассистент.");
+                if (session) {
+                    session->speak("Привет, я твой ассистент.");
+                }
               //  agent->generate_response("Привет, я твой ассистент.");
                 //   agent->sendText("Привет, я твой ассистент.");
             }
@@ -38,9 +87,80 @@ void Call::onCallMediaState(pj::OnCallMediaStateParam &prm)
     }
 }
 
+CallStats Call::sampleStats()
+{
+    CallStats stats;
+    pj::CallInfo ci = getInfo();
+    stats.callId = ci.id;
+    stats.remoteUri = ci.remoteUri;
+    stats.state = ci.stateText;
+    stats.direction = direction == Call::INCOMING ? "incoming" : "outgoing";
+    stats.durationSec = ci.connectDuration.sec;
+    stats.sampledAtMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+
+    for (unsigned i = 0; i < ci.media.size(); i++) {
+        if (ci.media[i].type != PJMEDIA_TYPE_AUDIO || ci.media[i].status != PJSUA_CALL_MEDIA_ACTIVE) {
+            continue;
+        }
+        pj::StreamInfo si = getStreamInfo(i);
+        pj::StreamStat ss = getStreamStat(i);
+
+        stats.mediaActive = true;
+        stats.codec = si.codecName;
+        stats.clockRate = si.codecClockRate;
+
+        stats.rttMs = ss.rtcp.rttUsec.mean / 1000.0;
+        stats.rttLastMs = ss.rtcp.rttUsec.last / 1000.0;
+
+        stats.rxPackets = ss.rtcp.rxStat.pkt;
+        stats.rxLoss = ss.rtcp.rxStat.loss;
+        stats.rxDiscard = ss.rtcp.rxStat.discard;
+        stats.rxJitterMs = ss.rtcp.rxStat.jitterUsec.mean / 1000.0;
+        stats.rxJitterLastMs = ss.rtcp.rxStat.jitterUsec.last / 1000.0;
+
+        stats.txPackets = ss.rtcp.txStat.pkt;
+        stats.txLoss = ss.rtcp.txStat.loss;
+        stats.txJitterMs = ss.rtcp.txStat.jitterUsec.mean / 1000.0;
+
+        stats.jbFrameSize = ss.jbuf.frameSize;
+        stats.jbPrefetch = ss.jbuf.prefetch;
+        stats.jbMinPrefetch = ss.jbuf.minPrefetch;
+        stats.jbMaxPrefetch = ss.jbuf.maxPrefetch;
+        stats.jbSize = ss.jbuf.size;
+        stats.jbAvgDelayMs = ss.jbuf.avgDelayMsec;
+        stats.jbMaxDelayMs = ss.jbuf.maxDelayMsec;
+        stats.jbLost = ss.jbuf.lost;
+        stats.jbDiscard = ss.jbuf.discard;
+        stats.jbEmpty = ss.jbuf.empty;
+        break;
+    }
+
+    stats.agentId = m_account.getAgentId();
+    stats.jbProfileApplied = m_jbProfileApplied;
+    stats.jbProfileInitMs = m_jbProfile.initMs;
+    stats.jbProfileMinPrefetchMs = m_jbProfile.minPrefetchMs;
+    stats.jbProfileMaxPrefetchMs = m_jbProfile.maxPrefetchMs;
+    stats.jbProfileMaxMs = m_jbProfile.maxMs;
+    stats.jbProfileDiscard = m_jbProfile.enabled ? m_jbProfile.discardName() : "";
+
+    stats.framesPlayed = mediaPort.framesPlayed();
+    stats.framesReceived = mediaPort.framesReceived();
+    stats.playoutUnderruns = mediaPort.playoutUnderruns();
+    stats.turns = turnTraces();
+    return stats;
+}
+
+std::vector<TurnTrace> Call::turnTraces() const
+{
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+    return m_session ? m_session->tracer().traces() : m_turns;
+}
+
 std::shared_ptr<Agent> Call::getAgent() const
 {
-    return m_account.getAgent();
+    return m_agent;
 }
 
 Call::Call(Account &acc, int call_id) :
@@ -49,25 +169,44 @@ Call::Call(Account &acc, int call_id) :
 {
     direction = OUTGOING;
     LOG_WARNING << "CALL CREATED";
-    this->getAgent()->set_speech_callback(
-        [this](const std::vector<int16_t> &audio_data) {
-            mediaPort.addToQueue(audio_data);
-        });
-    
+    m_agent = m_account.getAgent();
+    if (m_agent) {
+        m_jbProfile = JitterBufferProfile::fromConfig(m_agent->get_config());
+        m_session = m_agent->acquire_session();
+        m_session->tracer().set_agent_id(m_account.getAgentId());
+        m_session->set_speech_callback(
+            [this](const std::vector<int16_t> &audio_data) {
+                mediaPort.addToQueue(audio_data);
+            });
+        if (m_agent->get_config().value("record_calls", false)) {
+            startRecording();
+        }
+    }
+
     mediaPort.vad.setVoiceSegmentCallback(
         [this](const std::vector<pj::MediaFrame> &frames) {
             LOG_DEBUG << "Voice segment detected";
-          //  this->getAgent()->generate_response(VAD::mergeFrames(frames));
-            this->getAgent()->process_audio(VAD::mergeFrames(frames));
+            if (auto session = this->getSession()) {
+                session->tracer().speech_ended();
+                session->process_audio(VAD::mergeFrames(frames));
+            }
+        });
+
+    mediaPort.setPlayoutStartedCallback(
+        [this]() {
+            if (auto session = this->getSession()) {
+                session->tracer().mark(TurnMark::FirstPlayed);
+            }
         });
 
     mediaPort.vad.setSpeechStartedCallback(
         [this]() {
             LOG_DEBUG << "Speech started";
+            if (auto session = this->getSession()) {
+                session->cancel_turn();
+            }
             mediaPort.clearQueue();
         });
-    
-    
 
     if (mediaPort.getPortId() == PJSUA_INVALID_ID) {
         auto mediaFormatAudio = pj::MediaFormatAudio();
@@ -81,3 +220,39 @@ Call::Call(Account &acc, int call_id) :
         mediaPort.createPort("default", mediaFormatAudio);
     }
 }
+
+Call::~Call()
+{
+    releaseSession();
+    if (m_recorder) {
+        m_recorder->annotate("turns", turnTraces());
+        CallRecordingWriter::getInstance().enqueue(std::move(m_recorder));
+    }
+}
+
+void Call::startRecording()
+{
+    static std::atomic<uint64_t> sequence { 0 };
+    auto &config = AppConfig::getInstance();
+    const auto dir = config.get<std::string>("CALL_RECORD_DIR", "./recordings");
+    const auto maxSec = config.get<int>("CALL_RECORD_MAX_SEC", 1800);
+
+    const auto now = std::chrono::system_clock::now();
+    const auto t = std::chrono::system_clock::to_time_t(now);
+    std::tm tm {};
+    localtime_r(&t, &tm);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+    const auto agentId = m_account.getAgentId();
+    const auto name = (agentId.empty() ? std::string("call") : agentId) + "_" + stamp + "_" + std::to_string(sequence++) + ".pcmrec";
+
+    json header = {
+        { "agentId", agentId },
+        { "agent", CallRecorder::redact(m_agent->get_config()) },
+        { "startedAtMs", std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() },
+        { "sampleRate", 8000 },
+        { "frameMs", 20 },
+    };
+    m_recorder = std::make_shared<CallRecorder>(std::filesystem::path(dir) / name, std::move(header), std::chrono::seconds(maxSec));
+    mediaPort.setRecorder(m_recorder);
+}
@@ -1,6 +1,7 @@
 // Manager.cpp
 #include "sip/manager.h"
 #include "agent/agent.h"
+#include "core/configuration.h"
 #include "utils/logger.h"
 #include <iostream>
 #include <memory>
@@ -29,6 +30,12 @@ Manager::Manager()
         LOG_DEBUG << "PJSIP initialized";
         // Start worker thread
         m_workerThread = std::make_unique<std::thread>(&Manager::workerThreadMain, this);
+
+        m_statsInterval = std::chrono::milliseconds(
+            AppConfig::getInstance().get<int>("CALL_STATS_INTERVAL_MS", 1000));
+        if (m_statsInterval.count() > 0) {
+            m_statsThread = std::make_unique<std::thread>(&Manager::statsThreadMain, this);
+        }
     } catch (pj::Error &err) {
         std::cerr << "PJSIP Initialization Error: " << err.info() << std::endl;
         throw;
@@ -88,6 +95,12 @@ RegistrationStatus Manager::addAccount(const std::string &accountId,
                         registrationPromise->set_value(result);
                     }
                 });
+            account->registerIncomingCallCallback([this](Call *call) {
+                adoptCall(call);
+            });
+            account->registerCallEndedCallback([this](Call *call) {
+                retireCall(call);
+            });
             account->create(accountConfig);
             if (!agentId.empty()) {
                 account->setAgent(agentId);
@@ -95,6 +108,12 @@ RegistrationStatus Manager::addAccount(const std::string &accountId,
 
             m_accounts[accountId] = std::move(account);
 
+            // No registrar: a local account that takes calls sent straight to
+            // this host (e.g. from tools/sip_loadgen), so there's nothing to wait for
+            if (registrarUri.empty()) {
+                registrationPromise->set_value({ true, "Local account (no registration)", PJSIP_SC_OK });
+            }
+
         } catch (const pj::Error &err) {
             registrationPromise->set_value({ false, "PJSIP Error: " + std::string(err.info()), 500 });
         } catch (const std::exception &e) {
@@ -116,6 +135,34 @@ void Manager::removeAccount(const std::string &accountId)
 
             auto it = m_accounts.find(accountId);
             if (it != m_accounts.end()) {
+                // A call refers to its account until it is deleted, so hang
+                // up and delete this account's calls first. A retireCall()
+                // already queued for one of them only compares pointers, and
+                // runs before any newer call at the same address is adopted.
+                std::vector<std::unique_ptr<Call>> calls;
+                {
+                    std::lock_guard<std::mutex> callsLock(m_callsMutex);
+                    for (auto call = m_activeCalls.begin(); call != m_activeCalls.end();) {
+                        if (&call->second->getAccount() == it->second.get()) {
+                            calls.push_back(std::move(call->second));
+                            call = m_activeCalls.erase(call);
+                        } else {
+                            ++call;
+                        }
+                    }
+                }
+                for (auto &call: calls) {
+                    try {
+                        pj::CallOpParam callOpParam;
+                        callOpParam.statusCode = PJSIP_SC_DECLINE;
+                        call->hangup(callOpParam);
+                    } catch (const pj::Error &err) {
+                        LOG_DEBUG << "Hangup on account removal: " << err.info();
+                    }
+                }
+                // Destroyed outside m_callsMutex: ~Call takes pjsua's lock
+                calls.clear();
+
                 it->second->shutdown();
                 m_accounts.erase(it);
 
@@ -161,8 +208,8 @@ void Manager::hangupCall(int callId)
             if (it != m_activeCalls.end()) {
                 pj::CallOpParam callOpParam;
                 callOpParam.statusCode = PJSIP_SC_DECLINE;
+                // Deleted by retireCall() once pjsua reports the disconnect
                 it->second->hangup(callOpParam);
-                m_activeCalls.erase(it);
 
             } else {
             }
@@ -171,9 +218,114 @@ void Manager::hangupCall(int callId)
     });
 }
 
+std::vector<CallStats> Manager::getCallStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    std::vector<CallStats> result;
+    result.reserve(m_callStats.size());
+    for (const auto &[id, stats]: m_callStats) {
+        result.push_back(stats);
+    }
+    return result;
+}
+
+std::optional<CallStats> Manager::getCallStats(int callId) const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    auto it = m_callStats.find(callId);
+    if (it == m_callStats.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+void Manager::adoptCall(Call *call)
+{
+    // Called from the pjsip callback thread; take ownership on the worker so
+    // m_callsMutex is never acquired while pjsua holds its own lock.
+    try {
+        enqueueTask([this, call]() {
+            std::lock_guard<std::mutex> lock(m_callsMutex);
+            m_activeCalls[call->getId()].reset(call);
+        });
+    } catch (const std::exception &e) {
+        LOG_ERROR << "Failed to adopt incoming call: " << e.what();
+    }
+}
+
+void Manager::retireCall(Call *call)
+{
+    // Called from onCallState(DISCONNECTED). Deleting on the worker lets the
+    // callback return first. Matching by pointer rather than id, since pjsua
+    // may already have reused the id for a newer call.
+    try {
+        enqueueTask([this, call]() {
+            std::unique_ptr<Call> retired;
+            {
+                std::lock_guard<std::mutex> lock(m_callsMutex);
+                for (auto it = m_activeCalls.begin(); it != m_activeCalls.end(); ++it) {
+                    if (it->second.get() == call) {
+                        retired = std::move(it->second);
+                        m_activeCalls.erase(it);
+                        break;
+                    }
+                }
+            }
+            // Destroyed outside m_callsMutex: ~Call takes pjsua's lock
+        });
+    } catch (const std::exception &) {
+        // Shutting down; shutdownPjsip() clears the remaining calls
+    }
+}
+
+size_t Manager::activeCallCount() const
+{
+    std::lock_guard<std::mutex> lock(m_callsMutex);
+    return m_activeCalls.size();
+}
+
+void Manager::statsThreadMain()
+{
+    std::unique_lock<std::mutex> lock(m_statsWaitMutex);
+    while (m_running) {
+        m_statsCondition.wait_for(lock, m_statsInterval, [this] { return !m_running; });
+        if (!m_running) {
+            break;
+        }
+        try {
+            // Sampling runs on the pjsua worker thread, serialized with call control
+            enqueueTask([this]() { sampleCallStats(); });
+        } catch (const std::exception &) {
+            break;
+        }
+    }
+}
+
+void Manager::sampleCallStats()
+{
+    std::unordered_map<int, CallStats> sampled;
+    {
+        std::lock_guard<std::mutex> lock(m_callsMutex);
+        for (auto &[id, call]: m_activeCalls) {
+            try {
+                sampled[id] = call->sampleStats();
+            } catch (const pj::Error &err) {
+                LOG_DEBUG << "Stats unavailable for call " << id << ": " << err.info();
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    m_callStats = std::move(sampled);
+}
+
 void Manager::shutdown()
 {
     m_running = false;
+    m_statsCondition.notify_all();
+    if (m_statsThread && m_statsThread->joinable()) {
+        m_statsThread->join();
+    }
     m_taskQueue.stop();
 
     if (m_workerThread && m_workerThread->joinable()) {
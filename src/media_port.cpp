@@ -1,5 +1,6 @@
 // jMediaPort.cpp
 #include "sip/media_port.h"
+#include <algorithm>
 
 MediaPort::MediaPort() :
     AudioMediaPort() { }
@@ -42,6 +43,20 @@ void MediaPort::onFrameRequested(pj::MediaFrame &frame)
         pcmBufferIndex += samplesToCopy;
     }
 
+    m_framesPlayed.fetch_add(1, std::memory_order_relaxed);
+    // Audio ran out in the middle of a frame: the TTS stream is not keeping up
+    if (samplesCopied > 0 && samplesCopied < requiredSamples) {
+        m_playoutUnderruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (samplesCopied == 0) {
+        m_audible = false;
+    } else if (!m_audible && std::any_of(tempBuffer.begin(), tempBuffer.begin() + samplesCopied, [](int16_t s) { return s != 0; })) {
+        m_audible = true;
+        if (m_onPlayoutStarted) {
+            m_onPlayoutStarted();
+        }
+    }
+
     frame.buf.assign(
         reinterpret_cast<const uint8_t*>(tempBuffer.data()),
         reinterpret_cast<const uint8_t*>(tempBuffer.data() + requiredSamples));
@@ -50,6 +65,10 @@ void MediaPort::onFrameRequested(pj::MediaFrame &frame)
 
 void MediaPort::onFrameReceived(pj::MediaFrame &frame)
 {
+    m_framesReceived.fetch_add(1, std::memory_order_relaxed);
+    if (m_recorder) {
+        m_recorder->addFrame(frame);
+    }
     vad.processFrame(frame);
 }
 
@@ -58,4 +77,5 @@ void MediaPort::clearQueue()
     audioQueue = std::queue<std::vector<int16_t>>(); // Empty the audio queue
     pcmBuffer.clear();               // Clear current PCM buffer
     pcmBufferIndex = 0;              // Reset buffer index
+    m_audible = false;
 }
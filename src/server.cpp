@@ -1,8 +1,9 @@
 #include "server/server.h"
 #include "agent/agent.h"
 #include "sip/manager.h"
+#include "utils/process_stats.h"
 #include <deps/json.hpp>
-#include <httplib.h>
+#include "deps/httplib.h"
 #include <memory>
 
 using json = nlohmann::json;
@@ -120,6 +121,27 @@ void Server::setupRoutes()
 //-----------------------------------------------
 #pragma region Call
 
+    // GET /calls - Cached stats for every active call
+    m_server.Get("/calls", [this](const httplib::Request &req, httplib::Response &res) {
+        json response = json::array();
+        for (const auto &stats: m_manager->getCallStats()) {
+            response.push_back(stats);
+        }
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // GET /calls/:id/stats - Cached RTP/jitter-buffer stats for one call
+    m_server.Get(R"(/calls/(\d+)/stats)", [this](const httplib::Request &req, httplib::Response &res) {
+        int callId = std::stoi(req.matches[1]);
+        auto stats = m_manager->getCallStats(callId);
+        if (!stats) {
+            res.status = 404;
+            res.set_content(json { { "error", "Call not found" } }.dump(), "application/json");
+            return;
+        }
+        res.set_content(json(*stats).dump(), "application/json");
+    });
+
     m_server.Post("/calls/make", [this](const httplib::Request &req, httplib::Response &res) {
         try {
             auto data = json::parse(req.body);
@@ -230,7 +252,8 @@ void Server::setupRoutes()
 
         nlohmann::json response = {
             { "id", id },
-            { "config", agent->get_config() }
+            { "config", agent->get_config() },
+            { "idleSessions", agent->idle_sessions() }
         };
         res.set_content(response.dump(), "application/json");
     });
@@ -275,6 +298,105 @@ void Server::setupRoutes()
         res.status = 204;
     });
 
+#pragma endregion
+
+    //-----------------------------------------------
+    // PROVIDER
+    //-----------------------------------------------
+#pragma region Provider
+
+    // GET /providers - Registered providers, Lua state pool usage, routing health,
+    // load tiers and concurrency limits
+    m_server.Get("/providers", [](const httplib::Request &req, httplib::Response &res) {
+        auto &manager = ProviderManager::getInstance();
+        const auto pool = manager.pool_stats();
+        const auto loop = manager.event_loop_stats();
+        const auto http = HttpClientPool::getInstance().stats();
+
+        json response = {
+            { "providers", manager.provider_names() },
+            { "luaPool", {
+                { "size", pool.size },
+                { "maxSize", pool.max_size },
+                { "idle", pool.idle },
+                { "inUse", pool.in_use },
+                { "checkouts", pool.checkouts },
+                { "waits", pool.waits },
+                { "timeouts", pool.timeouts },
+                { "waitMsTotal", pool.wait_ms_total },
+                { "waitMsMax", pool.wait_ms_max } } },
+            { "eventLoop", nullptr },
+            { "httpPool", {
+                { "hosts", http.hosts },
+                { "idle", http.idle },
+                { "created", http.created },
+                { "reused", http.reused },
+                { "discarded", http.discarded } } }
+        };
+        if (loop) {
+            response["eventLoop"] = {
+                { "threads", loop->threads },
+                { "inFlight", loop->in_flight },
+                { "capacity", loop->capacity },
+                { "submitted", loop->submitted },
+                { "rejected", loop->rejected }
+            };
+        }
+        json routes = json::array();
+        for (const auto &backend : manager.router_stats()) {
+            routes.push_back({
+                { "backend", backend.key },
+                { "latencyMs", backend.latency_ms },
+                { "p95Ms", backend.p95_ms },
+                { "errorRate", backend.error_rate },
+                { "healthy", backend.healthy },
+                { "requests", backend.requests },
+                { "errors", backend.errors },
+                { "hedges", backend.hedges },
+                { "hedgeWins", backend.hedge_wins }
+            });
+        }
+        response["routes"] = routes;
+        json tiers = json::array();
+        for (const auto &tier : manager.tier_stats()) {
+            tiers.push_back({
+                { "provider", tier.provider },
+                { "level", tier.level },
+                { "inFlight", tier.in_flight },
+                { "p95Ms", tier.p95_ms },
+                { "escalations", tier.escalations },
+                { "recoveries", tier.recoveries }
+            });
+        }
+        response["tiers"] = tiers;
+        json limits = json::array();
+        for (const auto &limit : manager.limiter_stats()) {
+            limits.push_back({
+                { "provider", limit.provider },
+                { "maxConcurrency", limit.max_concurrency },
+                { "inUse", limit.in_use },
+                { "queued", limit.queued },
+                { "granted", limit.granted },
+                { "rejected", limit.rejected },
+                { "waitMs", {
+                    { "live", { { "total", limit.wait_ms_total[0] }, { "max", limit.wait_ms_max[0] } } },
+                    { "batch", { { "total", limit.wait_ms_total[1] }, { "max", limit.wait_ms_max[1] } } } } }
+            });
+        }
+        response["limits"] = limits;
+        response["cassette"] = nullptr;
+        if (const auto cassette = manager.cassette_stats()) {
+            response["cassette"] = {
+                { "mode", cassette->mode == Cassette::Mode::Record ? "record" : "replay" },
+                { "entries", cassette->entries },
+                { "recorded", cassette->recorded },
+                { "replayed", cassette->replayed },
+                { "misses", cassette->misses }
+            };
+        }
+        res.set_content(response.dump(), "application/json");
+    });
+
 #pragma endregion
 
 #pragma region Status
@@ -287,6 +409,30 @@ void Server::setupRoutes()
         res.set_content(response.dump(), "application/json");
     });
 
+    // GET /status/process - Resource usage, sampled by sip_loadgen --soak to catch leaks
+    m_server.Get("/status/process", [this](const httplib::Request &req, httplib::Response &res) {
+        const auto stats = ProcessStats::sample();
+        size_t idleSessions = 0;
+        for (const auto &agent: AgentManager::getInstance().get_agents()) {
+            idleSessions += agent->idle_sessions();
+        }
+        json response = {
+            { "rssKb", stats.rssKb },
+            { "heapBytes", stats.heapBytes },
+            { "openFds", stats.openFds },
+            { "threads", stats.threads },
+            { "activeCalls", m_manager->activeCallCount() },
+            { "idleSessions", idleSessions }
+        };
+        res.set_content(response.dump(), "application/json");
+    });
+
+    // GET /status/latency[?agentId=] - Per-stage turn latency histograms by agent and provider
+    m_server.Get("/status/latency", [](const httplib::Request &req, httplib::Response &res) {
+        const auto agentId = req.has_param("agentId") ? req.get_param_value("agentId") : "";
+        res.set_content(TurnLatencyStats::getInstance().snapshot(agentId).dump(), "application/json");
+    });
+
     m_server.Get("/events", [this](const httplib::Request &req, httplib::Response &res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_chunked_content_provider("text/event-stream", [this](size_t offset, httplib::DataSink &sink) {
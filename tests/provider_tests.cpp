@@ -0,0 +1,368 @@
+// Behavioural tests for the provider scheduling pieces that the HTTP tests
+// in test_server.py can only see the shape of: routing, tiering, the fair
+// queue and the cassette. Each drives the class directly with fake
+// attempts, so no backend or running server is needed.
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "provider/cassette.h"
+#include "provider/fair_limiter.h"
+#include "provider/provider_router.h"
+#include "provider/tier_controller.h"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+int failures = 0;
+
+#define CHECK(condition)                                                                      \
+    do                                                                                        \
+    {                                                                                         \
+        if (!(condition))                                                                     \
+        {                                                                                     \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            failures++;                                                                       \
+        }                                                                                     \
+    } while (0)
+
+double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+const ProviderRouter::BackendStats *find_backend(const std::vector<ProviderRouter::BackendStats> &stats, const std::string &key)
+{
+    for (const auto &backend : stats)
+    {
+        if (backend.key == key)
+            return &backend;
+    }
+    return nullptr;
+}
+
+// "slow" answers after two seconds unless cancelled, "fast" after 10 ms,
+// "bad" fails straight away
+ProviderResult fake_attempt(const ProviderRouter::Backend &backend, const ProviderRouter::ChunkCallback &on_chunk,
+                            const std::shared_ptr<CancelSignal> &cancel, std::atomic<int> &slow_cancelled)
+{
+    if (backend.provider == "bad")
+        return {false, "", {}, "boom"};
+    const auto delay = backend.provider == "slow" ? 2000ms : 10ms;
+    const auto until = std::chrono::steady_clock::now() + delay;
+    while (std::chrono::steady_clock::now() < until)
+    {
+        if (cancel->cancelled())
+        {
+            if (backend.provider == "slow")
+                slow_cancelled++;
+            return {false, "", {}, "Cancelled"};
+        }
+        std::this_thread::sleep_for(5ms);
+    }
+    if (on_chunk && !on_chunk(backend.provider))
+        return {false, "", {}, "Stopped"};
+    return {true, backend.provider, json::object(), ""};
+}
+
+void test_router_fails_over()
+{
+    ProviderRouter router;
+    std::atomic<int> slow_cancelled{0};
+    const std::vector<ProviderRouter::Backend> backends = {
+        {"bad", json::object(), "bad/m"},
+        {"fast", json::object(), "fast/m"}};
+
+    const auto result = router.route(backends, ProviderRouter::Policy{}, nullptr,
+                                     [&](const auto &backend, const auto &on_chunk, const auto &cancel)
+                                     { return fake_attempt(backend, on_chunk, cancel, slow_cancelled); });
+
+    CHECK(result.success);
+    CHECK(result.response == "fast");
+    CHECK(result.metadata["route"]["backend"] == "fast/m");
+    CHECK(result.metadata["route"]["errors"].size() == 1);
+    const auto stats = router.stats();
+    CHECK(find_backend(stats, "bad/m") && find_backend(stats, "bad/m")->errors == 1);
+}
+
+void test_router_hedges_and_cancels_the_loser()
+{
+    ProviderRouter router;
+    std::atomic<int> slow_cancelled{0};
+    ProviderRouter::Policy policy;
+    policy.hedge = true;
+    policy.max_hedge_delay = 100ms;
+    const std::vector<ProviderRouter::Backend> backends = {
+        {"slow", json::object(), "slow/m"},
+        {"fast", json::object(), "fast/m"}};
+    auto attempt = [&](const auto &backend, const auto &on_chunk, const auto &cancel)
+    { return fake_attempt(backend, on_chunk, cancel, slow_cancelled); };
+
+    std::string streamed;
+    const auto started = std::chrono::steady_clock::now();
+    const auto result = router.route(backends, policy, [&](const std::string &chunk)
+                                     { streamed += chunk; return true; }, attempt);
+
+    // The hedge answered, and route() didn't wait out the slow attempt
+    CHECK(result.success);
+    CHECK(result.response == "fast");
+    CHECK(streamed == "fast");
+    CHECK(result.metadata["route"]["hedged"] == true);
+    CHECK(elapsed_ms(started) < 1000);
+    CHECK(slow_cancelled == 1);
+
+    auto stats = router.stats();
+    CHECK(find_backend(stats, "fast/m") && find_backend(stats, "fast/m")->hedge_wins == 1);
+    // A cancelled loser counts as slow, not as failed, and its cut-short
+    // latency is no sample for the hedge delay
+    const auto *slow = find_backend(stats, "slow/m");
+    CHECK(slow && slow->errors == 0);
+    CHECK(slow && slow->error_rate == 0);
+    CHECK(slow && slow->latency_ms >= 100);
+    CHECK(slow && slow->p95_ms == 0);
+
+    // Now measured as faster, "fast" is tried first and nothing is hedged
+    const auto again = router.route(backends, policy, nullptr, attempt);
+    CHECK(again.metadata["route"]["backend"] == "fast/m");
+    CHECK(again.metadata["route"]["hedged"] == false);
+    CHECK(slow_cancelled == 1);
+}
+
+void test_router_cancelled_loser_stays_slow()
+{
+    ProviderRouter router;
+    ProviderRouter::Policy policy;
+    policy.hedge = true;
+    policy.max_hedge_delay = 50ms;
+    policy.failure_threshold = 2;
+    const ProviderRouter::Backend primary{"primary", json::object(), "primary/m"};
+    const ProviderRouter::Backend backup{"backup", json::object(), "backup/m"};
+
+    // "backup" always answers in 20 ms; "primary" as `mode` says
+    std::string mode = "fast";
+    auto attempt = [&](const ProviderRouter::Backend &backend, const ProviderRouter::ChunkCallback &,
+                       const std::shared_ptr<CancelSignal> &cancel) -> ProviderResult
+    {
+        if (backend.provider == "backup")
+        {
+            std::this_thread::sleep_for(20ms);
+            return {true, "backup", json::object(), ""};
+        }
+        if (mode == "fail")
+            return {false, "", {}, "boom"};
+        if (mode == "stall")
+        {
+            while (!cancel->cancelled())
+                std::this_thread::sleep_for(5ms);
+            return {false, "", {}, "Cancelled"};
+        }
+        std::this_thread::sleep_for(5ms);
+        return {true, "primary", json::object(), ""};
+    };
+
+    // Both measured, "primary" the faster
+    router.route({backup}, policy, nullptr, attempt);
+    CHECK(router.route({primary, backup}, policy, nullptr, attempt).response == "primary");
+    mode = "fail";
+    CHECK(router.route({primary, backup}, policy, nullptr, attempt).response == "backup");
+    // Stalls: the hedge wins and "primary" is cancelled at about 70 ms
+    mode = "stall";
+    CHECK(router.route({primary, backup}, policy, nullptr, attempt).response == "backup");
+
+    auto stats = router.stats();
+    const auto *slow = find_backend(stats, "primary/m");
+    // Known to be at least that slow now, while the window holds real samples only
+    CHECK(slow && slow->latency_ms >= 50);
+    CHECK(slow && slow->p95_ms < 50);
+    CHECK(slow && slow->healthy);
+
+    // Ranked behind "backup" from now on
+    mode = "fast";
+    CHECK(router.route({primary, backup}, policy, nullptr, attempt).response == "backup");
+
+    // The cancellation didn't reset the failure streak: one more failure
+    // reaches failure_threshold
+    mode = "fail";
+    router.route({primary}, policy, nullptr, attempt);
+    stats = router.stats();
+    slow = find_backend(stats, "primary/m");
+    CHECK(slow && !slow->healthy);
+}
+
+void test_tier_escalates_and_recovers()
+{
+    TierController tiers;
+    TierController::Thresholds thresholds;
+    thresholds.queue_high = 2;
+    thresholds.queue_low = 0;
+    thresholds.p95_high_ms = 100;
+    thresholds.p95_low_ms = 60;
+    thresholds.p95_window = 200ms;
+    thresholds.hold = 50ms;
+    thresholds.max_level = 1;
+    tiers.configure("ollama", thresholds);
+
+    {
+        // Two in flight is the high mark
+        auto first = tiers.begin("ollama");
+        CHECK(tiers.level("ollama") == 0);
+        auto second = tiers.begin("ollama");
+        CHECK(tiers.level("ollama") == 1);
+        // Still loaded: stays at the last level
+        std::this_thread::sleep_for(10ms);
+        CHECK(tiers.level("ollama") == 1);
+    }
+    // Idle and fast again, but not before the level has held for hold_ms
+    CHECK(tiers.level("ollama") == 1);
+    std::this_thread::sleep_for(60ms);
+    CHECK(tiers.level("ollama") == 0);
+
+    // A slow request escalates through p95 alone...
+    {
+        auto slow = tiers.begin("ollama");
+        std::this_thread::sleep_for(120ms);
+    }
+    CHECK(tiers.level("ollama") == 1);
+    // ...and once it ages out of p95_window the level comes back down
+    std::this_thread::sleep_for(250ms);
+    CHECK(tiers.level("ollama") == 0);
+
+    const auto stats = tiers.stats();
+    CHECK(stats.size() == 1);
+    CHECK(stats[0].escalations == 2);
+    CHECK(stats[0].recoveries == 2);
+    CHECK(stats[0].in_flight == 0);
+    CHECK(stats[0].p95_ms == 0);
+}
+
+void test_fair_queue_orders_tenants()
+{
+    FairLimiter limiter;
+    limiter.configure("ollama", {1, 16});
+    auto busy = limiter.acquire("ollama", "a", 1, FairLimiter::Priority::Live);
+    CHECK(busy.has_value());
+
+    // Granted one at a time: each permit is released as soon as it arrives
+    std::vector<std::string> order;
+    std::vector<FairLimiter::Permit> held;
+    auto queue = [&](const std::string &name, const std::string &tenant, double weight, FairLimiter::Priority priority)
+    {
+        CHECK(limiter.acquire_async("ollama", tenant, weight, priority, [&, name](FairLimiter::Permit permit)
+                                    {
+                                        order.push_back(name);
+                                        held.push_back(std::move(permit));
+                                    }));
+    };
+    // Tenant "a" bursts first; "b" and the batch job arrive behind it, and
+    // "c" has twice the weight
+    queue("a1", "a", 1, FairLimiter::Priority::Live);
+    queue("a2", "a", 1, FairLimiter::Priority::Live);
+    queue("a3", "a", 1, FairLimiter::Priority::Live);
+    queue("batch", "r", 1, FairLimiter::Priority::Batch);
+    queue("b1", "b", 1, FairLimiter::Priority::Live);
+    queue("c1", "c", 2, FairLimiter::Priority::Live);
+    queue("c2", "c", 2, FairLimiter::Priority::Live);
+    CHECK(limiter.stats()[0].queued == 7);
+
+    busy.reset();
+    while (!held.empty())
+    {
+        auto permit = std::move(held.front());
+        held.erase(held.begin());
+        permit.reset();
+    }
+
+    // FIFO would be a1 a2 a3 batch b1 c1 c2. By finish tag, "c" (half the
+    // cost per request) gets two slots in the time "a" and "b" get one each,
+    // the rest of a's burst waits behind them, and batch goes last.
+    const std::vector<std::string> expected = {"c1", "a1", "b1", "c2", "a2", "a3", "batch"};
+    CHECK(order == expected);
+    const auto stats = limiter.stats()[0];
+    CHECK(stats.in_use == 0);
+    CHECK(stats.queued == 0);
+    CHECK(stats.granted == 8);
+}
+
+void test_cassette_replays_recording()
+{
+    const auto path = std::filesystem::temp_directory_path() / ("provider_tests_" + std::to_string(::getpid()) + ".jsonl");
+    std::filesystem::remove(path);
+    const std::vector<std::string> sent = {"Hel", "lo", " there"};
+    const ProviderResult live_result{true, "Hello there", {{"model", "m"}}, ""};
+
+    std::vector<std::string> recorded_chunks;
+    {
+        Cassette cassette(Cassette::Mode::Record, path, 1.0);
+        const auto result = cassette.run("ollama", "hi", [&](const std::string &chunk)
+                                         { recorded_chunks.push_back(chunk); return true; }, std::nullopt,
+                                         [&](const Cassette::ChunkCallback &on_chunk)
+                                         {
+                                             for (const auto &chunk : sent)
+                                             {
+                                                 std::this_thread::sleep_for(20ms);
+                                                 on_chunk(chunk);
+                                             }
+                                             return live_result;
+                                         });
+        CHECK(result.response == live_result.response);
+        CHECK(recorded_chunks == sent);
+        CHECK(cassette.stats().recorded == 1);
+    }
+
+    Cassette cassette(Cassette::Mode::Replay, path, 1.0);
+    CHECK(cassette.stats().entries == 1);
+    auto never_live = [](const Cassette::ChunkCallback &) -> ProviderResult
+    {
+        CHECK(!"replay must not reach the provider");
+        return {false, "", {}, ""};
+    };
+
+    // Same chunks and result, on the recorded schedule
+    std::vector<std::string> replayed_chunks;
+    const auto started = std::chrono::steady_clock::now();
+    const auto result = cassette.run("ollama", "hi", [&](const std::string &chunk)
+                                     { replayed_chunks.push_back(chunk); return true; }, std::nullopt, never_live);
+    CHECK(replayed_chunks == sent);
+    CHECK(result.success);
+    CHECK(result.response == live_result.response);
+    CHECK(result.metadata == live_result.metadata);
+    CHECK(elapsed_ms(started) >= 55);
+
+    // Other input falls back to the provider's recordings; other providers miss
+    CHECK(cassette.run("ollama", "something else", nullptr, std::nullopt, never_live).response == live_result.response);
+    CHECK(!cassette.run("groq", "hi", nullptr, std::nullopt, never_live).success);
+    // A deadline shorter than the recording cuts the replay short
+    const auto expired = cassette.run("ollama", "hi", nullptr, std::chrono::steady_clock::now() + 10ms, never_live);
+    CHECK(expired.deadline_exceeded);
+
+    const auto stats = cassette.stats();
+    CHECK(stats.replayed == 3);
+    CHECK(stats.misses == 1);
+    std::filesystem::remove(path);
+}
+} // namespace
+
+int main()
+{
+    const std::vector<std::pair<const char *, std::function<void()>>> tests = {
+        {"router fails over", test_router_fails_over},
+        {"router hedges and cancels the loser", test_router_hedges_and_cancels_the_loser},
+        {"router keeps a cancelled loser slow", test_router_cancelled_loser_stays_slow},
+        {"tier escalates and recovers", test_tier_escalates_and_recovers},
+        {"fair queue orders tenants", test_fair_queue_orders_tenants},
+        {"cassette replays a recording", test_cassette_replays_recording},
+    };
+    for (const auto &[name, test] : tests)
+    {
+        const int before = failures;
+        test();
+        std::cout << (failures == before ? "ok   " : "FAIL ") << name << "\n";
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -2,9 +2,49 @@
 import unittest
 import requests
 import json
+import threading
 import time
+import uuid
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
 from typing import Optional
 
+
+class StubChatHandler(BaseHTTPRequestHandler):
+    """Minimal OpenAI-compatible /v1/chat/completions, records what it got"""
+
+    def do_POST(self):
+        body = json.loads(self.rfile.read(int(self.headers["Content-Length"])))
+        self.server.received.append({"path": self.path, "headers": dict(self.headers), "body": body})
+        time.sleep(self.server.delay)
+        if self.server.status != 200:
+            self.send_error(self.server.status)
+            return
+        reply = json.dumps({
+            "model": body["model"],
+            "choices": [{"message": {"role": "assistant", "content": "stub: " + body["messages"][-1]["content"]},
+                         "finish_reason": "stop"}],
+            "usage": {"prompt_tokens": 1, "completion_tokens": 1},
+        }).encode()
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(reply)))
+        self.end_headers()
+        self.wfile.write(reply)
+
+    def log_message(self, *args):
+        pass
+
+
+def start_stub_chat(delay=0.0, status=200):
+    stub = ThreadingHTTPServer(("127.0.0.1", 0), StubChatHandler)
+    stub.daemon_threads = True
+    stub.received = []
+    stub.delay = delay
+    stub.status = status
+    threading.Thread(target=stub.serve_forever, daemon=True).start()
+    return stub
+
+
 class TestSipServer(unittest.TestCase):
     @classmethod
     def setUpClass(cls):
@@ -19,6 +59,148 @@ class TestSipServer(unittest.TestCase):
         data = response.json()
         self.assertEqual(data["status"], "OK")
 
+    def test_process_status(self):
+        """Test process resource usage endpoint"""
+        response = requests.get(f"{self.base_url}/status/process")
+        self.assertEqual(response.status_code, 200)
+        data = response.json()
+        for key in ("rssKb", "heapBytes", "openFds", "threads", "activeCalls", "idleSessions"):
+            self.assertIn(key, data)
+        self.assertGreater(data["rssKb"], 0)
+        self.assertGreater(data["threads"], 0)
+
+    def test_call_stats(self):
+        """Test cached call stats endpoints"""
+        response = requests.get(f"{self.base_url}/calls")
+        self.assertEqual(response.status_code, 200)
+        calls = response.json()
+        self.assertIsInstance(calls, list)
+        for call in calls:
+            stats_response = requests.get(f"{self.base_url}/calls/{call['callId']}/stats")
+            self.assertEqual(stats_response.status_code, 200)
+            self.assertIn("jitterBuffer", stats_response.json())
+            self.assertIn("turns", stats_response.json())
+
+        missing = requests.get(f"{self.base_url}/calls/99999/stats")
+        self.assertEqual(missing.status_code, 404)
+
+    def test_turn_latency(self):
+        """Test per-agent/provider turn latency histograms"""
+        response = requests.get(f"{self.base_url}/status/latency")
+        self.assertEqual(response.status_code, 200)
+        entries = response.json()
+        self.assertIsInstance(entries, list)
+        for entry in entries:
+            self.assertIn("provider", entry)
+            self.assertLessEqual(entry["cancelled"], entry["turns"])
+            for stage in ("stt", "llmFirstToken", "tts", "playout", "total"):
+                self.assertIn("p95Ms", entry["stagesMs"][stage])
+
+        filtered = requests.get(f"{self.base_url}/status/latency", params={"agentId": "no-such-agent"})
+        self.assertEqual(filtered.json(), [])
+
+    def test_provider_pool(self):
+        """Test provider listing and Lua state pool stats"""
+        response = requests.get(f"{self.base_url}/providers")
+        self.assertEqual(response.status_code, 200)
+        data = response.json()
+        self.assertIsInstance(data["providers"], list)
+        pool = data["luaPool"]
+        self.assertGreaterEqual(pool["maxSize"], 1)
+        self.assertLessEqual(pool["size"], pool["maxSize"])
+        self.assertEqual(pool["idle"] + pool["inUse"], pool["size"])
+        self.assertIn("openai", data["providers"])
+        self.assertIn("reused", data["httpPool"])
+        for route in data["routes"]:
+            self.assertGreaterEqual(route["requests"], route["errors"])
+            self.assertGreaterEqual(route["hedges"], route["hedgeWins"])
+        for tier in data["tiers"]:
+            self.assertGreaterEqual(tier["escalations"], tier["recoveries"])
+            self.assertEqual(tier["level"], tier["escalations"] - tier["recoveries"])
+        for limit in data["limits"]:
+            if limit["maxConcurrency"] > 0:
+                self.assertLessEqual(limit["inUse"], limit["maxConcurrency"])
+            self.assertGreaterEqual(limit["waitMs"]["live"]["max"], 0)
+        if data["cassette"] is not None:
+            self.assertIn(data["cassette"]["mode"], ("record", "replay"))
+
+    def test_native_openai_provider(self):
+        """Test the native OpenAI-compatible provider against a stub API"""
+        stub = start_stub_chat()
+        self.addCleanup(stub.shutdown)
+        base_url = f"http://127.0.0.1:{stub.server_address[1]}/v1"
+        config = {"provider": "openai", "provider_options": {"base_url": base_url, "model": "stub-model", "api_key": "sk-test"}}
+        response = requests.post(f"{self.base_url}/agents", headers=self.headers,
+                                 json={"id": "test-native-openai", "config": config})
+        self.assertEqual(response.status_code, 201)
+        self.addCleanup(requests.delete, f"{self.base_url}/agents/test-native-openai")
+
+        think = requests.post(f"{self.base_url}/agents/test-native-openai/think", json={"text": "ping"})
+        self.assertEqual(think.status_code, 200)
+        self.assertEqual(think.text, "stub: ping")
+        self.assertEqual(len(stub.received), 1)
+        request = stub.received[0]
+        self.assertEqual(request["path"], "/v1/chat/completions")
+        self.assertEqual(request["headers"]["Authorization"], "Bearer sk-test")
+        self.assertEqual(request["body"]["model"], "stub-model")
+        self.assertEqual(request["body"]["messages"][-1], {"role": "user", "content": "ping"})
+
+        # An https client only exists when httplib was built with OpenSSL;
+        # without it the provider rejects the URL before connecting
+        config["provider_options"]["base_url"] = "https://127.0.0.1:1/v1"
+        requests.put(f"{self.base_url}/agents/test-native-openai", headers=self.headers, json=config)
+        think = requests.post(f"{self.base_url}/agents/test-native-openai/think", json={"text": "ping"})
+        self.assertIn("HTTP error", think.text)
+        self.assertNotIn("Invalid base_url", think.text)
+
+    def test_provider_routing(self):
+        """Test failover, hedging and latency ranking across stub backends"""
+        failing, slow, fast = start_stub_chat(status=500), start_stub_chat(delay=2.0), start_stub_chat()
+        for stub in (failing, slow, fast):
+            self.addCleanup(stub.shutdown)
+        # Fresh backend keys (provider/model), so earlier runs don't affect ranking
+        run = uuid.uuid4().hex[:8]
+
+        def backend(stub, name):
+            return {"provider": "openai", "options": {
+                "base_url": f"http://127.0.0.1:{stub.server_address[1]}/v1", "model": f"{name}-{run}"}}
+
+        def think(routing):
+            config = {"provider": "openai", "routing": routing}
+            if requests.get(f"{self.base_url}/agents/test-routing").status_code == 200:
+                requests.put(f"{self.base_url}/agents/test-routing", headers=self.headers, json=config)
+            else:
+                requests.post(f"{self.base_url}/agents", headers=self.headers, json={"id": "test-routing", "config": config})
+            started = time.monotonic()
+            response = requests.post(f"{self.base_url}/agents/test-routing/think", json={"text": "ping"})
+            self.assertEqual(response.status_code, 200)
+            return response.text, time.monotonic() - started
+
+        self.addCleanup(requests.delete, f"{self.base_url}/agents/test-routing")
+
+        # Failover: the first backend errors, the next one answers
+        text, _ = think({"providers": [backend(failing, "failing"), backend(fast, "fast")]})
+        self.assertEqual(text, "stub: ping")
+        self.assertEqual((len(failing.received), len(fast.received)), (1, 1))
+
+        # Hedging: the slow backend (listed first, no samples yet) gets no
+        # answer out within the hedge delay, so the fast one is raced and wins
+        hedged = {"providers": [backend(slow, "slow"), backend(fast, "hedge")],
+                  "hedge": True, "min_hedge_delay_ms": 200, "max_hedge_delay_ms": 200}
+        text, elapsed = think(hedged)
+        self.assertEqual(text, "stub: ping")
+        self.assertLess(elapsed, 1.5)
+        self.assertEqual((len(slow.received), len(fast.received)), (1, 2))
+        routes = {route["backend"]: route for route in requests.get(f"{self.base_url}/providers").json()["routes"]}
+        self.assertEqual(routes[f"openai/hedge-{run}"]["hedgeWins"], 1)
+        self.assertEqual(routes[f"openai/slow-{run}"]["errors"], 0)
+
+        # Ranking: the fast backend now has the lower latency and goes first,
+        # answering before a hedge to the slow one is due
+        text, _ = think(hedged)
+        self.assertEqual(text, "stub: ping")
+        self.assertEqual((len(slow.received), len(fast.received)), (1, 3))
+
     def account_lifecycle(self):
         """Test complete account lifecycle: create, update, delete"""
         # Create account
@@ -0,0 +1,371 @@
+// Replays a call recorded by CallRecorder ("record_calls": true) through the
+// server's own pipeline: MediaPort -> VAD -> AgentSession (STT, LLM, TTS) ->
+// MediaPort playout, with the same wiring as Call. Frames are fed on their
+// recorded schedule, optionally sped up, and playout is pulled every 20 ms
+// the way the conference bridge would. The result is a latency breakdown
+// per turn: end-to-end as seen from the port, and per stage (STT, LLM, TTS,
+// playout) from the session's TurnTracer, next to the same stages from the
+// live call when the recording carries them.
+//
+// Services come from .env (STT_URI, TTS_URI) and the provider configs, as
+// for the server. Point them at tools/stub_services, or use
+// PROVIDER_CASSETTE=replay, for a run that doesn't depend on live backends.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "agent/agent.h"
+#include "core/configuration.h"
+#include "provider/provider_manager.h"
+#include "sip/call_recorder.h"
+#include "sip/media_port.h"
+#include "sip/vad.h"
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr auto FRAME = std::chrono::milliseconds(20);
+
+double ms_between(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+json summarize(std::vector<double> values)
+{
+    if (values.empty()) {
+        return json { { "count", 0 } };
+    }
+    std::sort(values.begin(), values.end());
+    auto at = [&](double q) { return values[std::min(values.size() - 1, static_cast<size_t>(q * values.size()))]; };
+    return json {
+        { "count", values.size() },
+        { "p50", at(0.50) },
+        { "p95", at(0.95) },
+        { "max", values.back() },
+    };
+}
+
+// Per-stage summaries over TurnTrace JSON, from this run or a live call
+json summarizeStages(const json &traces)
+{
+    json result = json::object();
+    for (const auto &stage: TURN_STAGES) {
+        std::vector<double> values;
+        for (const auto &trace: traces) {
+            const auto &ms = trace["stagesMs"][stage.name];
+            if (ms.is_number()) {
+                values.push_back(ms.get<double>());
+            }
+        }
+        result[stage.name] = summarize(std::move(values));
+    }
+    return result;
+}
+
+struct Turn {
+    // Position in the recording, seconds
+    double recordedAt = 0;
+    double segmentMs = 0;
+    Clock::time_point speechEnd;
+    std::optional<Clock::time_point> firstAudio;
+    std::optional<Clock::time_point> firstPlayed;
+    bool interrupted = false;
+};
+
+// Drives one recording through a MediaPort and an AgentSession. MediaPort
+// isn't thread-safe: TTS audio arrives on the websocket thread while frames
+// are pulled here, so both go through m_portMutex.
+class Replay {
+public:
+    Replay(std::shared_ptr<Agent> agent, const std::string &agentId, double speed) :
+        m_agent(std::move(agent)),
+        m_speed(speed)
+    {
+        m_session = m_agent->acquire_session();
+        m_session->tracer().set_agent_id(agentId);
+        m_session->set_speech_callback([this](const std::vector<int16_t> &audio) {
+            std::lock_guard<std::mutex> lock(m_portMutex);
+            m_port.addToQueue(audio);
+            if (!m_turns.empty() && !m_turns.back().firstAudio) {
+                m_turns.back().firstAudio = Clock::now();
+            }
+        });
+        m_port.vad.setSpeechStartedCallback([this]() {
+            m_session->cancel_turn();
+            std::lock_guard<std::mutex> lock(m_portMutex);
+            m_port.clearQueue();
+            if (!m_turns.empty() && !m_turns.back().firstPlayed) {
+                m_turns.back().interrupted = true;
+            }
+        });
+        m_port.setPlayoutStartedCallback([this]() {
+            m_session->tracer().mark(TurnMark::FirstPlayed);
+        });
+        m_port.vad.setVoiceSegmentCallback([this](const std::vector<pj::MediaFrame> &frames) {
+            m_session->tracer().speech_ended();
+            auto audio = VAD::mergeFrames(frames);
+            {
+                std::lock_guard<std::mutex> lock(m_portMutex);
+                Turn turn;
+                turn.recordedAt = m_position;
+                turn.segmentMs = 1000.0 * audio.size() / 8000;
+                turn.speechEnd = Clock::now();
+                m_turns.push_back(turn);
+            }
+            m_session->process_audio(audio);
+        });
+    }
+
+    ~Replay()
+    {
+        m_agent->release_session(m_session);
+    }
+
+    void speak(const std::string &text) { m_session->speak(text); }
+
+    void run(const CallRecorder::Recording &recording, std::chrono::milliseconds drain)
+    {
+        const auto started = Clock::now();
+        auto next = started;
+        size_t index = 0;
+        const pj::MediaFrame silence = makeFrame(std::vector<int16_t>(160, 0));
+
+        auto scaled = [this](uint64_t offsetUs) {
+            return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(offsetUs / m_speed));
+        };
+
+        // Recorded frames on their schedule, then silence so the VAD closes
+        // the last segment, while the replies drain
+        const auto lastOffset = recording.frames.empty() ? Clock::duration::zero() : scaled(recording.frames.back().offsetUs);
+        const auto end = started + lastOffset + std::chrono::duration_cast<Clock::duration>(drain);
+        while (Clock::now() < end || (index < recording.frames.size())) {
+            const auto now = Clock::now();
+            while (index < recording.frames.size() && started + scaled(recording.frames[index].offsetUs) <= now) {
+                m_position = recording.frames[index].offsetUs / 1e6;
+                auto frame = makeFrame(recording.frames[index].samples);
+                m_port.onFrameReceived(frame);
+                index++;
+            }
+            if (index >= recording.frames.size()) {
+                auto frame = silence;
+                m_port.onFrameReceived(frame);
+            }
+            pullPlayout();
+            if (index >= recording.frames.size() && settled(now)) {
+                break;
+            }
+            next += std::chrono::duration_cast<Clock::duration>(FRAME / m_speed);
+            std::this_thread::sleep_until(next);
+        }
+    }
+
+    json report() const
+    {
+        std::lock_guard<std::mutex> lock(m_portMutex);
+        json turns = json::array();
+        std::vector<double> audio, played;
+        for (const auto &turn: m_turns) {
+            json entry = {
+                { "recordedAtSec", turn.recordedAt },
+                { "segmentMs", turn.segmentMs },
+                { "interrupted", turn.interrupted },
+                { "speechEndToTtsAudioMs", nullptr },
+                { "speechEndToPlayoutMs", nullptr },
+            };
+            if (turn.firstAudio) {
+                audio.push_back(ms_between(turn.speechEnd, *turn.firstAudio));
+                entry["speechEndToTtsAudioMs"] = audio.back();
+            }
+            if (turn.firstPlayed) {
+                played.push_back(ms_between(turn.speechEnd, *turn.firstPlayed));
+                entry["speechEndToPlayoutMs"] = played.back();
+            }
+            turns.push_back(std::move(entry));
+        }
+        const json stages = m_session->tracer().traces();
+        return json {
+            { "speed", m_speed },
+            { "turns", turns },
+            { "stages", stages },
+            { "summary", {
+                             { "speechEndToTtsAudioMs", summarize(audio) },
+                             { "speechEndToPlayoutMs", summarize(played) },
+                             { "stagesMs", summarizeStages(stages) },
+                         } },
+            { "playoutUnderruns", m_port.playoutUnderruns() },
+        };
+    }
+
+private:
+    static pj::MediaFrame makeFrame(const std::vector<int16_t> &samples)
+    {
+        pj::MediaFrame frame;
+        frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+        frame.buf.assign(reinterpret_cast<const uint8_t *>(samples.data()), reinterpret_cast<const uint8_t *>(samples.data() + samples.size()));
+        frame.size = static_cast<unsigned>(samples.size() * sizeof(int16_t));
+        return frame;
+    }
+
+    void pullPlayout()
+    {
+        pj::MediaFrame frame;
+        std::lock_guard<std::mutex> lock(m_portMutex);
+        m_port.onFrameRequested(frame);
+        const auto *samples = reinterpret_cast<const int16_t *>(frame.buf.data());
+        const bool audible = std::any_of(samples, samples + frame.size / sizeof(int16_t), [](int16_t s) { return s != 0; });
+        if (audible) {
+            m_lastPlayed = Clock::now();
+            if (!m_turns.empty() && !m_turns.back().firstPlayed) {
+                m_turns.back().firstPlayed = m_lastPlayed;
+            }
+        }
+    }
+
+    // Every turn has been answered and nothing has played for a second
+    bool settled(Clock::time_point now) const
+    {
+        std::lock_guard<std::mutex> lock(m_portMutex);
+        const bool answered = std::all_of(m_turns.begin(), m_turns.end(), [](const Turn &turn) { return turn.firstPlayed || turn.interrupted; });
+        return answered && m_lastPlayed && ms_between(*m_lastPlayed, now) > 1000;
+    }
+
+    std::shared_ptr<Agent> m_agent;
+    std::shared_ptr<AgentSession> m_session;
+    const double m_speed;
+
+    MediaPort m_port;
+    mutable std::mutex m_portMutex;
+    std::vector<Turn> m_turns;
+    std::optional<Clock::time_point> m_lastPlayed;
+    double m_position = 0;
+};
+
+void printTable(const json &report)
+{
+    std::cout << std::fixed << std::setprecision(0);
+    std::cout << " turn   at(s)  speech(ms)  ->tts audio(ms)  ->playout(ms)\n";
+    int n = 1;
+    for (const auto &turn: report["turns"]) {
+        auto cell = [](const json &value) { return value.is_null() ? std::string("-") : std::to_string(static_cast<int>(value.get<double>())); };
+        std::cout << std::setw(5) << n++ << std::setw(8) << std::setprecision(1) << turn["recordedAtSec"].get<double>()
+                  << std::setprecision(0) << std::setw(12) << turn["segmentMs"].get<double>()
+                  << std::setw(17) << cell(turn["speechEndToTtsAudioMs"])
+                  << std::setw(15) << cell(turn["speechEndToPlayoutMs"])
+                  << (turn["interrupted"].get<bool>() ? "  (interrupted)" : "") << '\n';
+    }
+    std::cout << "summary: " << report["summary"]["speechEndToTtsAudioMs"].dump() << " / "
+              << report["summary"]["speechEndToPlayoutMs"].dump() << "\n\n";
+
+    // Stage breakdown, one row per traced turn, then p50/p95 for this run and
+    // for the live call if it was recorded with its turns
+    std::cout << " turn";
+    for (const auto &stage: TURN_STAGES) {
+        std::cout << std::setw(14) << stage.name;
+    }
+    std::cout << '\n';
+    for (const auto &trace: report["stages"]) {
+        std::cout << std::setw(5) << trace["turn"].get<uint64_t>();
+        for (const auto &stage: TURN_STAGES) {
+            const auto &ms = trace["stagesMs"][stage.name];
+            std::cout << std::setw(14) << (ms.is_number() ? std::to_string(static_cast<int>(ms.get<double>())) : std::string("-"));
+        }
+        std::cout << (trace["cancelled"].get<bool>() ? "  (cancelled)" : "") << '\n';
+    }
+    auto summaryRow = [](const char *label, const json &summary, const char *quantile) {
+        std::cout << std::setw(5) << label;
+        for (const auto &stage: TURN_STAGES) {
+            const auto &entry = summary[stage.name];
+            std::cout << std::setw(14) << (entry.contains(quantile) ? std::to_string(static_cast<int>(entry[quantile].get<double>())) : std::string("-"));
+        }
+        std::cout << '\n';
+    };
+    summaryRow("p50", report["summary"]["stagesMs"], "p50");
+    summaryRow("p95", report["summary"]["stagesMs"], "p95");
+    if (report.contains("live")) {
+        summaryRow("live", report["live"]["stagesMs"], "p50");
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using Type = CLIParser::Type;
+    AppConfig &config = AppConfig::getInstance();
+    config.add_options({
+        { "help", "h", Type::Boolean, "Show help", "false" },
+        { "recording", "r", Type::String, "Call recording (.pcmrec) to replay", "" },
+        { "agent", "a", Type::String, "Agent config JSON (default: the one stored in the recording)", "" },
+        { "speed", "s", Type::Float, "Playback speed; 2 feeds the audio twice as fast", "1.0" },
+        { "drain-ms", "", Type::Integer, "How long to wait for replies after the audio ends", "15000" },
+        { "greeting", "", Type::String, "Spoken first, as a call does when answered", "" },
+        { "json", "", Type::Boolean, "Print the report as JSON instead of a table", "false" },
+    });
+    try {
+        config.initialize(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        config.print_help();
+        return 1;
+    }
+    const auto path = config.get<std::string>("recording", "");
+    if (config.get<bool>("help", false) || path.empty()) {
+        config.print_help();
+        return path.empty() ? 1 : 0;
+    }
+
+    auto recording = CallRecorder::load(path);
+    if (!recording) {
+        LOG_ERROR << "Not a call recording: " << path;
+        return 1;
+    }
+    json agentConfig = recording->header.value("agent", json::object());
+    if (const auto agentPath = config.get<std::string>("agent", ""); !agentPath.empty()) {
+        std::ifstream file(agentPath);
+        agentConfig = json::parse(file, nullptr, false);
+        if (!agentConfig.is_object()) {
+            LOG_ERROR << "Invalid agent config " << agentPath;
+            return 1;
+        }
+    }
+    const double speed = std::max(config.get<float>("speed", 1.0f), 0.1f);
+
+    ProviderManager::getInstance().load_providers_from_folder("./lua");
+    auto agent = std::make_shared<Agent>(agentConfig);
+    LOG_INFO << "Replaying " << recording->frames.size() << " frames from " << path << " at " << speed << "x";
+
+    json report;
+    {
+        Replay replay(agent, recording->header.value("agentId", ""), speed);
+        if (const auto greeting = config.get<std::string>("greeting", ""); !greeting.empty()) {
+            replay.speak(greeting);
+        }
+        replay.run(*recording, std::chrono::milliseconds(config.get<int>("drain-ms", 15000)));
+        report = replay.report();
+    }
+    report["recording"] = path;
+    report["agentId"] = recording->header.value("agentId", "");
+    // Stage latencies of the original call, saved with the recording
+    if (recording->header.contains("turns")) {
+        report["live"] = { { "stagesMs", summarizeStages(recording->header["turns"]) } };
+    }
+
+    if (config.get<bool>("json", false)) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        printTable(report);
+    }
+    return 0;
+}
@@ -0,0 +1,475 @@
+// Micro-benchmarks for the code on the per-frame and per-turn hot paths:
+// MediaPort playout, the VAD, json <-> Lua conversion for provider scripts,
+// the document store and the logger. Each benchmark reports ns/op and
+// allocs/op; allocations are counted by the global operator new below (and
+// by Lua's allocator for the Lua benchmarks), on the benchmarking thread
+// only.
+//
+//   ./server_bench                       # everything
+//   ./server_bench -f VAD --min-time-ms 2000
+//   ./server_bench --json > before.json  # for comparing two builds
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "core/configuration.h"
+#include "db/InMemoryDatabase.h"
+#include "provider/lua_bridge.h"
+#include "sip/media_port.h"
+#include "sip/vad.h"
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+thread_local uint64_t t_allocs = 0;
+thread_local uint64_t t_allocBytes = 0;
+
+void *countedAlloc(std::size_t size)
+{
+    t_allocs++;
+    t_allocBytes += size;
+    return std::malloc(size ? size : 1);
+}
+
+// lua_Alloc that goes through the same counters; a grow counts as an allocation
+void *countingLuaAlloc(void *, void *ptr, size_t oldSize, size_t newSize)
+{
+    if (newSize == 0) {
+        std::free(ptr);
+        return nullptr;
+    }
+    if (!ptr || newSize > oldSize) {
+        t_allocs++;
+        t_allocBytes += newSize;
+    }
+    return std::realloc(ptr, newSize);
+}
+
+} // namespace
+
+void *operator new(std::size_t size)
+{
+    if (void *ptr = countedAlloc(size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+// Keeps the compiler from discarding a result that is otherwise unused
+template<typename T>
+inline void keep(T &value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerOp;
+};
+
+// Runs body(n) with n growing until one run takes at least minTime; the last
+// run is the one reported. Setup done outside body isn't measured.
+class Bench {
+public:
+    Bench(std::chrono::milliseconds minTime, std::string filter) :
+        m_minTime(minTime),
+        m_filter(std::move(filter)) { }
+
+    template<typename Body>
+    void run(const std::string &name, Body &&body)
+    {
+        if (!m_filter.empty() && name.find(m_filter) == std::string::npos) {
+            return;
+        }
+        body(1); // warm caches and lazily built state
+        uint64_t n = 1;
+        while (true) {
+            const auto allocs = t_allocs;
+            const auto bytes = t_allocBytes;
+            const auto start = Clock::now();
+            body(n);
+            const auto elapsed = Clock::now() - start;
+            const auto allocated = t_allocs - allocs;
+            const auto allocatedBytes = t_allocBytes - bytes;
+
+            if (elapsed >= m_minTime || n >= 1'000'000'000) {
+                const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+                m_results.push_back({ name, n, ns / n, double(allocated) / n, double(allocatedBytes) / n });
+                LOG_DEBUG << name << ": " << n << " iterations";
+                return;
+            }
+            // Aim a little past the target, growing at most 10x per step
+            const double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 1e-6);
+            const double target = std::chrono::duration<double>(m_minTime).count() * 1.2;
+            n = std::min(n * 10, std::max(n + 1, static_cast<uint64_t>(n * target / seconds)));
+        }
+    }
+
+    const std::vector<Result> &results() const { return m_results; }
+
+private:
+    const std::chrono::milliseconds m_minTime;
+    const std::string m_filter;
+    std::vector<Result> m_results;
+};
+
+pj::MediaFrame makeFrame(const int16_t *samples, size_t count)
+{
+    pj::MediaFrame frame;
+    frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+    frame.buf.assign(reinterpret_cast<const uint8_t *>(samples), reinterpret_cast<const uint8_t *>(samples + count));
+    frame.size = static_cast<unsigned>(count * sizeof(int16_t));
+    return frame;
+}
+
+// 8 kHz audio alternating one second of voice-like signal (a few harmonics
+// plus noise) with one second of silence, so the VAD keeps opening and
+// closing segments
+std::vector<int16_t> speechPattern(size_t seconds)
+{
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 600.0f);
+    std::vector<int16_t> pcm(8000 * seconds);
+    for (size_t i = 0; i < pcm.size(); i++) {
+        const bool voiced = (i / 8000) % 2 == 0;
+        if (!voiced) {
+            continue;
+        }
+        const double t = double(i) / 8000;
+        const double pitch = 140 + 30 * std::sin(2 * M_PI * 3 * t);
+        const double sample = 5000 * std::sin(2 * M_PI * pitch * t) + 2500 * std::sin(2 * M_PI * 2 * pitch * t) +
+                              1200 * std::sin(2 * M_PI * 3 * pitch * t) + noise(rng);
+        pcm[i] = static_cast<int16_t>(std::clamp(sample, -32768.0, 32767.0));
+    }
+    return pcm;
+}
+
+std::vector<pj::MediaFrame> toFrames(const std::vector<int16_t> &pcm)
+{
+    std::vector<pj::MediaFrame> frames;
+    for (size_t i = 0; i + 160 <= pcm.size(); i += 160) {
+        frames.push_back(makeFrame(pcm.data() + i, 160));
+    }
+    return frames;
+}
+
+// A conversation the size of a long call, shaped like a provider request
+json chatRequest(size_t messages)
+{
+    json history = json::array();
+    for (size_t i = 0; i < messages; i++) {
+        history.push_back({
+            { "role", i % 2 ? "assistant" : "user" },
+            { "content", "Turn " + std::to_string(i) + ": " + std::string(180, 'a' + i % 26) },
+            { "metadata", { { "timestamp", 1735689600 + int64_t(i) * 7 }, { "tokens", 42 + i % 17 }, { "final", true } } },
+        });
+    }
+    return json {
+        { "model", "llama3.2" },
+        { "temperature", 0.7 },
+        { "stream", true },
+        { "messages", std::move(history) },
+    };
+}
+
+// Roughly what an agent or call record looks like in the store
+json sampleDocument(size_t id)
+{
+    json tools = json::array();
+    for (int i = 0; i < 8; i++) {
+        tools.push_back({ { "name", "tool_" + std::to_string(i) }, { "enabled", i % 3 != 0 }, { "timeoutMs", 1500 + i * 250 } });
+    }
+    return json {
+        { "id", "doc-" + std::to_string(id) },
+        { "name", "Support line " + std::to_string(id) },
+        { "language", "en-US" },
+        { "createdAt", 1735689600 + int64_t(id) },
+        { "temperature", 0.4 },
+        { "active", true },
+        { "prompt", std::string(400, 'p') },
+        { "voice", { { "provider", "tts" }, { "speaker", "alloy" }, { "rate", 1.05 } } },
+        { "tags", { "support", "billing", "priority" } },
+        { "tools", std::move(tools) },
+    };
+}
+
+// Swallows std::cerr while the logger's write path is measured
+class NullBuffer: public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char *, std::streamsize count) override { return count; }
+};
+
+void mediaPortBenchmarks(Bench &bench)
+{
+    // TTS hands over chunks of a few hundred ms; ten frames per chunk here
+    std::vector<int16_t> chunk(1600);
+    for (size_t i = 0; i < chunk.size(); i++) {
+        chunk[i] = static_cast<int16_t>(8000 * std::sin(2 * M_PI * 440 * i / 8000.0));
+    }
+
+    MediaPort playing;
+    bench.run("MediaPort::onFrameRequested/queued", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            if (i % 10 == 0) {
+                playing.addToQueue(chunk);
+            }
+            // A fresh frame per callback, as pjsua2 passes one
+            pj::MediaFrame frame;
+            playing.onFrameRequested(frame);
+            keep(frame);
+        }
+        playing.clearQueue();
+    });
+
+    MediaPort idle;
+    bench.run("MediaPort::onFrameRequested/idle", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            pj::MediaFrame frame;
+            idle.onFrameRequested(frame);
+            keep(frame);
+        }
+    });
+}
+
+void vadBenchmarks(Bench &bench)
+{
+    const auto frames = toFrames(speechPattern(10));
+
+    VAD vad;
+    size_t segments = 0;
+    vad.setVoiceSegmentCallback([&](const std::vector<pj::MediaFrame> &) { segments++; });
+    bench.run("VAD::processFrame", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            vad.processFrame(frames[i % frames.size()]);
+        }
+    });
+    keep(segments);
+
+    // A three second utterance
+    const std::vector<pj::MediaFrame> segment(frames.begin(), frames.begin() + 150);
+    bench.run("VAD::mergeFrames/3s", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            auto pcm = VAD::mergeFrames(segment);
+            keep(pcm);
+        }
+    });
+}
+
+void luaBridgeBenchmarks(Bench &bench)
+{
+    sol::state lua(sol::default_at_panic, countingLuaAlloc);
+    lua.open_libraries(sol::lib::base, sol::lib::table);
+
+    for (const size_t messages: { 20, 200 }) {
+        const auto suffix = "/history-" + std::to_string(messages);
+        const json request = chatRequest(messages);
+
+        bench.run("lua_bridge::json_to_lua" + suffix, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                auto object = lua_bridge::json_to_lua(lua, request);
+                keep(object);
+            }
+            lua.collect_garbage();
+        });
+
+        const sol::object table = lua_bridge::json_to_lua(lua, request);
+        bench.run("lua_bridge::lua_to_json" + suffix, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                auto converted = lua_bridge::lua_to_json(table);
+                keep(converted);
+            }
+        });
+
+        // What providers get handed instead of a converted table
+        const auto root = std::make_shared<const json>(request);
+        bench.run("lua_bridge::JsonView::wrap" + suffix, [&](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                auto view = lua_bridge::JsonView::wrap(lua, root, *root);
+                keep(view);
+            }
+            lua.collect_garbage();
+        });
+    }
+}
+
+void databaseBenchmarks(Bench &bench)
+{
+    const json document = sampleDocument(1);
+
+    bench.run("Value(json)", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            Value value(document);
+            keep(value);
+        }
+    });
+
+    bench.run("Document(json)", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            Document doc(document);
+            keep(doc);
+        }
+    });
+
+    const Document built(document);
+    bench.run("Document(const Document &)", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            Document copy(built);
+            keep(copy);
+        }
+    });
+
+    bench.run("Document::toJson", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            auto j = built.toJson();
+            keep(j);
+        }
+    });
+
+    constexpr size_t DOCUMENTS = 1000;
+    InMemoryDatabase db;
+    auto &table = db.createTable("agents");
+    for (size_t i = 0; i < DOCUMENTS; i++) {
+        table.insertDocument("doc-" + std::to_string(i), Document(sampleDocument(i)));
+    }
+    const auto path = (std::filesystem::temp_directory_path() / "server_bench.bson").string();
+    const auto suffix = "/" + std::to_string(DOCUMENTS) + "-docs";
+
+    bench.run("InMemoryDatabase::saveToFile" + suffix, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            db.saveToFile(path);
+        }
+    });
+
+    InMemoryDatabase loaded;
+    bench.run("InMemoryDatabase::loadFromFile" + suffix, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            loaded.loadFromFile(path);
+        }
+    });
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+void loggerBenchmarks(Bench &bench)
+{
+    const auto level = Logger::getMinLevel();
+    Logger::setMinLevel(Level::Info);
+
+    bench.run("LOG_DEBUG/filtered", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            LOG_DEBUG << "Frame " << i << " queued for call " << 42;
+        }
+    });
+
+    NullBuffer null;
+    auto *previous = std::cerr.rdbuf(&null);
+    bench.run("LOG_INFO/written", [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            LOG_INFO << "Frame " << i << " queued for call " << 42;
+        }
+    });
+    std::cerr.rdbuf(previous);
+
+    Logger::setMinLevel(level);
+}
+
+void printTable(const std::vector<Result> &results)
+{
+    size_t width = 4;
+    for (const auto &result: results) {
+        width = std::max(width, result.name.size());
+    }
+    std::cout << std::left << std::setw(width + 2) << "name" << std::right << std::setw(14) << "iterations" << std::setw(14)
+              << "ns/op" << std::setw(12) << "allocs/op" << std::setw(12) << "bytes/op" << '\n';
+    std::cout << std::fixed;
+    for (const auto &result: results) {
+        std::cout << std::left << std::setw(width + 2) << result.name << std::right << std::setw(14) << result.iterations
+                  << std::setprecision(1) << std::setw(14) << result.nsPerOp << std::setprecision(2) << std::setw(12)
+                  << result.allocsPerOp << std::setprecision(0) << std::setw(12) << result.bytesPerOp << '\n';
+    }
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using Type = CLIParser::Type;
+    AppConfig &config = AppConfig::getInstance();
+    config.add_options({
+        { "help", "h", Type::Boolean, "Show help", "false" },
+        { "filter", "f", Type::String, "Only run benchmarks whose name contains this", "" },
+        { "min-time-ms", "t", Type::Integer, "Minimum measured time per benchmark", "500" },
+        { "json", "", Type::Boolean, "Print results as JSON instead of a table", "false" },
+    });
+    try {
+        config.initialize(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        config.print_help();
+        return 1;
+    }
+    if (config.get<bool>("help", false)) {
+        config.print_help();
+        return 0;
+    }
+
+    Bench bench(std::chrono::milliseconds(std::max(config.get<int>("min-time-ms", 500), 1)), config.get<std::string>("filter", ""));
+    mediaPortBenchmarks(bench);
+    vadBenchmarks(bench);
+    luaBridgeBenchmarks(bench);
+    databaseBenchmarks(bench);
+    loggerBenchmarks(bench);
+
+    if (config.get<bool>("json", false)) {
+        json out = json::array();
+        for (const auto &result: bench.results()) {
+            out.push_back({
+                { "name", result.name },
+                { "iterations", result.iterations },
+                { "nsPerOp", result.nsPerOp },
+                { "allocsPerOp", result.allocsPerOp },
+                { "bytesPerOp", result.bytesPerOp },
+            });
+        }
+        std::cout << out.dump(2) << std::endl;
+    } else {
+        printTable(bench.results());
+    }
+    return 0;
+}
@@ -0,0 +1,945 @@
+// SIP load generator for capacity benchmarks. Places --calls calls at
+// --cps to the server (loopback by default), at most --concurrency at a
+// time. Each caller streams WAV prompts from a pjsua2 null-device endpoint.
+// The report is one JSON document, so capacity can be compared across builds:
+//
+//   answer_ms       INVITE to 200 OK
+//   greeting_ms     answer to the first agent audio
+//   response_ms     end of a prompt to the first agent audio after it
+//   gaps            silences inside an agent reply (client-side dropouts)
+//   underruns       playout underruns reported by the server's GET /calls
+//   server          CPU and RSS of the server process (from /proc)
+//   soak            with --soak: RSS, heap, fds and threads of the server
+//                   (GET /status/process) every --soak-every calls, their
+//                   growth per call, and whether it stayed under the limits
+//
+// Prompts must be 16-bit mono PCM WAV; the conference bridge resamples them.
+// Without prompts a synthetic voiced signal is used. Note that both ends are
+// capped at PJSUA_MAX_CALLS concurrent calls (32 unless pjproject is built
+// with a larger value).
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+#include <pjsua2.hpp>
+#include "core/configuration.h"
+#include "deps/httplib.h"
+#include "deps/json.hpp"
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+double ms_between(Clock::time_point from, Clock::time_point to)
+{
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+// Samples for one metric, summarized as count/mean/percentiles
+struct Series {
+    std::vector<double> values;
+
+    void add(double value) { values.push_back(value); }
+    void add(const Series &other) { values.insert(values.end(), other.values.begin(), other.values.end()); }
+
+    json summary() const
+    {
+        if (values.empty()) {
+            return json { { "count", 0 } };
+        }
+        auto sorted = values;
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&](double q) { return sorted[std::min(sorted.size() - 1, static_cast<size_t>(q * sorted.size()))]; };
+        double sum = 0;
+        for (double v: sorted) {
+            sum += v;
+        }
+        return json {
+            { "count", sorted.size() },
+            { "mean", sum / sorted.size() },
+            { "min", sorted.front() },
+            { "p50", at(0.50) },
+            { "p95", at(0.95) },
+            { "p99", at(0.99) },
+            { "max", sorted.back() },
+        };
+    }
+};
+
+struct Prompt {
+    unsigned sampleRate = 8000;
+    std::vector<int16_t> samples;
+};
+
+std::optional<Prompt> load_wav(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        LOG_ERROR << "Cannot open prompt " << path;
+        return std::nullopt;
+    }
+    auto read_u32 = [&file]() { uint32_t v = 0; file.read(reinterpret_cast<char *>(&v), 4); return v; };
+    auto read_u16 = [&file]() { uint16_t v = 0; file.read(reinterpret_cast<char *>(&v), 2); return v; };
+
+    char riff[4], wave[4];
+    file.read(riff, 4);
+    read_u32();
+    file.read(wave, 4);
+    if (!file || std::string(riff, 4) != "RIFF" || std::string(wave, 4) != "WAVE") {
+        LOG_ERROR << path << " is not a WAV file";
+        return std::nullopt;
+    }
+
+    Prompt prompt;
+    uint16_t format = 0, channels = 0, bits = 0;
+    while (file) {
+        char id[4];
+        file.read(id, 4);
+        const uint32_t size = read_u32();
+        if (!file) {
+            break;
+        }
+        const std::string chunk(id, 4);
+        if (chunk == "fmt ") {
+            format = read_u16();
+            channels = read_u16();
+            prompt.sampleRate = read_u32();
+            read_u32();
+            read_u16();
+            bits = read_u16();
+            file.seekg(size - 16 + (size & 1), std::ios::cur);
+        } else if (chunk == "data") {
+            prompt.samples.resize(size / sizeof(int16_t));
+            file.read(reinterpret_cast<char *>(prompt.samples.data()), prompt.samples.size() * sizeof(int16_t));
+            break;
+        } else {
+            file.seekg(size + (size & 1), std::ios::cur);
+        }
+    }
+    if (format != 1 || channels != 1 || bits != 16 || prompt.samples.empty()) {
+        LOG_ERROR << path << ": need 16-bit mono PCM (format " << format << ", " << channels << " channels, " << bits << " bits)";
+        return std::nullopt;
+    }
+    return prompt;
+}
+
+// ~1.2 s of syllable-like bursts, for runs without recorded prompts
+Prompt synthetic_prompt()
+{
+    Prompt prompt;
+    const unsigned rate = prompt.sampleRate;
+    for (int syllable = 0; syllable < 6; syllable++) {
+        const double pitch = syllable % 2 ? 180 : 140;
+        const size_t voiced = rate * 150 / 1000;
+        for (size_t i = 0; i < voiced; i++) {
+            const double t = double(i) / rate;
+            const double envelope = std::sin(M_PI * i / voiced);
+            double sample = 0;
+            for (int harmonic = 1; harmonic <= 8; harmonic++) {
+                sample += std::sin(2 * M_PI * pitch * harmonic * t) / harmonic;
+            }
+            prompt.samples.push_back(static_cast<int16_t>(5000 * envelope * sample));
+        }
+        prompt.samples.insert(prompt.samples.end(), rate * 50 / 1000, 0);
+    }
+    return prompt;
+}
+
+struct Options {
+    std::string target;
+    int calls;
+    int concurrency;
+    double cps;
+    int turns;
+    int sipPort;
+    int rtpPort;
+    int promptDelayMs;
+    int turnTimeoutMs;
+    int replyEndMs;
+    int maxCallMs;
+    double voiceRms;
+    std::string serverUrl;
+    int serverPid;
+    int sampleMs;
+};
+
+// One caller: speaks a prompt, waits for the agent's reply, repeats for
+// `turns` prompts and then asks to be hung up. Frame callbacks run on the
+// conference bridge clock; the main loop only reads results after the call
+// has disconnected.
+class LoadCall: public pj::Call {
+public:
+    class Port: public pj::AudioMediaPort {
+    public:
+        explicit Port(LoadCall &call) :
+            m_call(call) { }
+        void onFrameRequested(pj::MediaFrame &frame) override { m_call.onFrameRequested(frame); }
+        void onFrameReceived(pj::MediaFrame &frame) override { m_call.onFrameReceived(frame); }
+
+    private:
+        LoadCall &m_call;
+    };
+
+    LoadCall(pj::Account &account, const Options &options, const std::vector<Prompt> &prompts, unsigned clockRate) :
+        pj::Call(account),
+        m_options(options),
+        m_prompts(prompts),
+        m_port(*this),
+        m_frameSamples(clockRate / 50)
+    {
+        pj::MediaFormatAudio format;
+        format.type = PJMEDIA_TYPE_AUDIO;
+        format.clockRate = clockRate;
+        format.channelCount = 1;
+        format.bitsPerSample = 16;
+        format.frameTimeUsec = 20000;
+        format.avgBps = format.maxBps = clockRate * 16;
+        m_port.createPort("loadgen", format);
+    }
+
+    void onCallState(pj::OnCallStateParam &) override
+    {
+        pj::CallInfo ci = getInfo();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (ci.state == PJSIP_INV_STATE_CONFIRMED && !m_answeredAt) {
+            m_answeredAt = Clock::now();
+            m_nextSpeakAt = *m_answeredAt + std::chrono::milliseconds(m_options.promptDelayMs);
+        } else if (ci.state == PJSIP_INV_STATE_DISCONNECTED) {
+            m_lastStatus = ci.lastStatusCode;
+            m_disconnected = true;
+        }
+    }
+
+    void onCallMediaState(pj::OnCallMediaStateParam &) override
+    {
+        pj::CallInfo ci = getInfo();
+        for (unsigned i = 0; i < ci.media.size(); i++) {
+            if (ci.media[i].type == PJMEDIA_TYPE_AUDIO && ci.media[i].status == PJSUA_CALL_MEDIA_ACTIVE) {
+                auto *media = dynamic_cast<pj::AudioMedia *>(getMedia(i));
+                if (media) {
+                    media->startTransmit(m_port);
+                    m_port.startTransmit(*media);
+                }
+            }
+        }
+    }
+
+    void place()
+    {
+        m_placedAt = Clock::now();
+        pj::CallOpParam prm(true);
+        makeCall(m_options.target, prm);
+    }
+
+    bool disconnected() const { return m_disconnected; }
+    bool wantsHangup() const { return m_wantsHangup; }
+    Clock::time_point placedAt() const { return m_placedAt; }
+
+    void hangupOnce()
+    {
+        if (m_hungUp.exchange(true)) {
+            return;
+        }
+        try {
+            pj::CallOpParam prm;
+            prm.statusCode = PJSIP_SC_OK;
+            hangup(prm);
+        } catch (const pj::Error &) {
+            // Already gone
+        }
+    }
+
+    struct Results {
+        bool answered = false;
+        int lastStatus = 0;
+        Series answerMs;
+        Series greetingMs;
+        Series responseMs;
+        uint64_t turns = 0;
+        uint64_t timeouts = 0;
+        uint64_t gaps = 0;
+    };
+
+    Results results() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Results results;
+        results.answered = m_answeredAt.has_value();
+        results.lastStatus = m_lastStatus;
+        if (m_answeredAt) {
+            results.answerMs.add(ms_between(m_placedAt, *m_answeredAt));
+        }
+        if (m_greetingMs) {
+            results.greetingMs.add(*m_greetingMs);
+        }
+        results.responseMs = m_responseMs;
+        results.turns = m_turn;
+        results.timeouts = m_timeouts;
+        results.gaps = m_gaps;
+        return results;
+    }
+
+private:
+    enum class Phase {
+        Waiting,
+        Speaking,
+        Listening,
+        Done,
+    };
+
+    void onFrameRequested(pj::MediaFrame &frame)
+    {
+        std::vector<int16_t> out(m_frameSamples, 0);
+        const auto now = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_phase == Phase::Waiting && m_answeredAt && now >= m_nextSpeakAt) {
+                // Let the greeting (or the last reply) finish first, within reason
+                const bool quiet = !m_lastVoiced || ms_between(*m_lastVoiced, now) >= 400;
+                if (quiet || ms_between(m_nextSpeakAt, now) > 5000) {
+                    m_phase = Phase::Speaking;
+                    m_promptPos = 0;
+                }
+            }
+            if (m_phase == Phase::Speaking) {
+                const auto &prompt = m_prompts[m_turn % m_prompts.size()].samples;
+                const size_t count = std::min(out.size(), prompt.size() - m_promptPos);
+                std::copy_n(prompt.begin() + m_promptPos, count, out.begin());
+                m_promptPos += count;
+                if (m_promptPos >= prompt.size()) {
+                    m_phase = Phase::Listening;
+                    m_speechEnd = now;
+                    m_heard = false;
+                    m_silentFrames = 0;
+                }
+            } else if (m_phase == Phase::Listening && !m_heard && ms_between(m_speechEnd, now) > m_options.turnTimeoutMs) {
+                m_timeouts++;
+                finishTurn(now);
+            }
+        }
+        frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+        frame.buf.assign(reinterpret_cast<const uint8_t *>(out.data()), reinterpret_cast<const uint8_t *>(out.data() + out.size()));
+        frame.size = static_cast<unsigned>(out.size() * sizeof(int16_t));
+    }
+
+    void onFrameReceived(pj::MediaFrame &frame)
+    {
+        const size_t count = frame.buf.size() / sizeof(int16_t);
+        const auto *samples = reinterpret_cast<const int16_t *>(frame.buf.data());
+        double energy = 0;
+        for (size_t i = 0; i < count; i++) {
+            energy += double(samples[i]) * samples[i];
+        }
+        const bool voiced = count > 0 && std::sqrt(energy / count) >= m_options.voiceRms;
+        const auto now = Clock::now();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_answeredAt) {
+            return;
+        }
+        if (voiced) {
+            if (!m_greetingMs) {
+                m_greetingMs = ms_between(*m_answeredAt, now);
+            }
+            m_lastVoiced = now;
+        }
+        if (m_phase != Phase::Listening) {
+            return;
+        }
+        if (voiced) {
+            if (!m_heard) {
+                m_heard = true;
+                m_responseMs.add(ms_between(m_speechEnd, now));
+            } else if (m_silentFrames > 0) {
+                // Silence inside a reply: the agent's audio didn't keep up
+                m_gaps++;
+            }
+            m_silentFrames = 0;
+        } else if (m_heard) {
+            m_silentFrames++;
+            if (m_silentFrames * 20 >= m_options.replyEndMs) {
+                finishTurn(now);
+            }
+        }
+    }
+
+    // Called with m_mutex held
+    void finishTurn(Clock::time_point now)
+    {
+        m_turn++;
+        if (m_turn >= static_cast<uint64_t>(m_options.turns)) {
+            m_phase = Phase::Done;
+            m_wantsHangup = true;
+            return;
+        }
+        m_phase = Phase::Waiting;
+        m_nextSpeakAt = now;
+    }
+
+    const Options &m_options;
+    const std::vector<Prompt> &m_prompts;
+    Port m_port;
+    const size_t m_frameSamples;
+
+    mutable std::mutex m_mutex;
+    Clock::time_point m_placedAt;
+    std::optional<Clock::time_point> m_answeredAt;
+    Clock::time_point m_nextSpeakAt;
+    Clock::time_point m_speechEnd;
+    std::optional<Clock::time_point> m_lastVoiced;
+    std::optional<double> m_greetingMs;
+    Series m_responseMs;
+    Phase m_phase = Phase::Waiting;
+    size_t m_promptPos = 0;
+    bool m_heard = false;
+    int m_silentFrames = 0;
+    uint64_t m_turn = 0;
+    uint64_t m_timeouts = 0;
+    uint64_t m_gaps = 0;
+    int m_lastStatus = 0;
+
+    std::atomic<bool> m_disconnected { false };
+    std::atomic<bool> m_wantsHangup { false };
+    std::atomic<bool> m_hungUp { false };
+};
+
+// CPU and RSS of the server process, from /proc
+class ProcessSampler {
+public:
+    explicit ProcessSampler(int pid) :
+        m_pid(pid) { }
+
+    static int findByName(const std::string &name)
+    {
+        DIR *proc = opendir("/proc");
+        if (!proc) {
+            return 0;
+        }
+        int found = 0;
+        while (auto *entry = readdir(proc)) {
+            const int pid = std::atoi(entry->d_name);
+            if (pid <= 0 || pid == getpid()) {
+                continue;
+            }
+            std::ifstream comm("/proc/" + std::to_string(pid) + "/comm");
+            std::string command;
+            if (std::getline(comm, command) && command == name) {
+                found = pid;
+                break;
+            }
+        }
+        closedir(proc);
+        return found;
+    }
+
+    int pid() const { return m_pid; }
+
+    void sample()
+    {
+        if (m_pid <= 0) {
+            return;
+        }
+        const auto now = Clock::now();
+        std::ifstream stat("/proc/" + std::to_string(m_pid) + "/stat");
+        std::string line;
+        if (!std::getline(stat, line)) {
+            return;
+        }
+        // Fields after the parenthesised command name; utime and stime are 14 and 15
+        std::istringstream fields(line.substr(line.rfind(')') + 2));
+        std::string field;
+        uint64_t ticks = 0;
+        for (int i = 3; i <= 15 && fields >> field; i++) {
+            if (i >= 14) {
+                ticks += std::stoull(field);
+            }
+        }
+        if (m_lastTicks) {
+            const double seconds = double(ticks - *m_lastTicks) / sysconf(_SC_CLK_TCK);
+            m_cpu.add(100.0 * seconds / (ms_between(m_lastAt, now) / 1000.0));
+        }
+        m_lastTicks = ticks;
+        m_lastAt = now;
+
+        std::ifstream status("/proc/" + std::to_string(m_pid) + "/status");
+        while (std::getline(status, line)) {
+            if (line.rfind("VmRSS:", 0) == 0) {
+                const double rssMb = std::stod(line.substr(6)) / 1024.0;
+                m_rss.add(rssMb);
+                break;
+            }
+        }
+    }
+
+    json summary() const
+    {
+        return json {
+            { "pid", m_pid },
+            { "cpuPercent", m_cpu.summary() },
+            { "rssMb", {
+                           { "start", m_rss.values.empty() ? 0 : m_rss.values.front() },
+                           { "end", m_rss.values.empty() ? 0 : m_rss.values.back() },
+                           { "max", m_rss.values.empty() ? 0 : *std::max_element(m_rss.values.begin(), m_rss.values.end()) },
+                       } },
+        };
+    }
+
+private:
+    int m_pid;
+    std::optional<uint64_t> m_lastTicks;
+    Clock::time_point m_lastAt;
+    Series m_cpu;
+    Series m_rss;
+};
+
+// Sums the server's per-call playout underrun counters from GET /calls.
+// Call ids are reused, so a counter that goes down starts a new call.
+class UnderrunPoller {
+public:
+    explicit UnderrunPoller(const std::string &url)
+    {
+        if (!url.empty()) {
+            m_client = std::make_unique<httplib::Client>(url);
+            m_client->set_connection_timeout(1);
+            m_client->set_read_timeout(2);
+        }
+    }
+
+    void poll()
+    {
+        if (!m_client) {
+            return;
+        }
+        auto res = m_client->Get("/calls");
+        if (!res || res->status != 200) {
+            return;
+        }
+        auto calls = json::parse(res->body, nullptr, false);
+        if (!calls.is_array()) {
+            return;
+        }
+        for (const auto &call: calls) {
+            const int id = call.value("callId", -1);
+            const uint64_t underruns = call.contains("frames") ? call["frames"].value("playoutUnderruns", uint64_t(0)) : 0;
+            auto &last = m_last[id];
+            if (underruns < last) {
+                m_finished += last;
+            }
+            last = underruns;
+        }
+    }
+
+    json total() const
+    {
+        if (!m_client) {
+            return nullptr;
+        }
+        uint64_t total = m_finished;
+        for (const auto &[id, last]: m_last) {
+            total += last;
+        }
+        return total;
+    }
+
+private:
+    std::unique_ptr<httplib::Client> m_client;
+    std::unordered_map<int, uint64_t> m_last;
+    uint64_t m_finished = 0;
+};
+
+// Soak mode: samples the server's GET /status/process every `every`
+// finished calls and fits growth per call (least squares, after `warmup`
+// calls) for each resource. Any slope over its limit fails the run.
+class SoakMonitor {
+public:
+    struct Limits {
+        double rssKb;
+        double heapBytes;
+        double openFds;
+        double threads;
+    };
+
+    SoakMonitor(const std::string &url, uint64_t warmup, const Limits &limits) :
+        m_client(url),
+        m_warmup(warmup),
+        m_limits(limits)
+    {
+        m_client.set_connection_timeout(1);
+        m_client.set_read_timeout(5);
+    }
+
+    void sample(uint64_t calls)
+    {
+        auto res = m_client.Get("/status/process");
+        auto status = res && res->status == 200 ? json::parse(res->body, nullptr, false) : json();
+        if (!status.is_object()) {
+            LOG_WARNING << "Soak sample at " << calls << " calls failed: no /status/process";
+            return;
+        }
+        status["calls"] = calls;
+        LOG_INFO << "Soak sample: " << status.dump();
+        m_samples.push_back(std::move(status));
+    }
+
+    json report() const
+    {
+        const json growth = {
+            { "rssKb", slope("rssKb") },
+            { "heapBytes", slope("heapBytes") },
+            { "openFds", slope("openFds") },
+            { "threads", slope("threads") },
+        };
+        const json limits = {
+            { "rssKb", m_limits.rssKb },
+            { "heapBytes", m_limits.heapBytes },
+            { "openFds", m_limits.openFds },
+            { "threads", m_limits.threads },
+        };
+        json violations = json::array();
+        for (const auto &[key, limit]: limits.items()) {
+            if (!growth[key].is_null() && growth[key].get<double>() > limit.get<double>()) {
+                violations.push_back(key);
+            }
+        }
+        return json {
+            { "warmupCalls", m_warmup },
+            { "samples", m_samples },
+            { "growthPerCall", growth },
+            { "limitsPerCall", limits },
+            { "violations", violations },
+            { "passed", violations.empty() && fitted() },
+        };
+    }
+
+    bool passed() const { return report()["passed"].get<bool>(); }
+
+private:
+    bool fitted() const { return !slope("rssKb").is_null(); }
+
+    // Growth of `key` per finished call, or null with fewer than two samples past warmup
+    json slope(const std::string &key) const
+    {
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (const auto &sample: m_samples) {
+            const double x = sample["calls"].get<double>();
+            if (x < m_warmup || !sample.contains(key)) {
+                continue;
+            }
+            const double y = sample[key].get<double>();
+            n++;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        const double denominator = n * sxx - sx * sx;
+        if (n < 2 || denominator == 0) {
+            return nullptr;
+        }
+        return (n * sxy - sx * sy) / denominator;
+    }
+
+    httplib::Client m_client;
+    const uint64_t m_warmup;
+    const Limits m_limits;
+    std::vector<json> m_samples;
+};
+
+std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!utils::trim(item).empty()) {
+            items.push_back(utils::trim(item));
+        }
+    }
+    return items;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using Type = CLIParser::Type;
+    AppConfig &config = AppConfig::getInstance();
+    config.add_options({
+        { "help", "h", Type::Boolean, "Show help", "false" },
+        { "target", "", Type::String, "SIP URI to call", "sip:agent@127.0.0.1:18090" },
+        { "calls", "n", Type::Integer, "Calls to place in total", "100" },
+        { "concurrency", "c", Type::Integer, "Most calls up at once", "20" },
+        { "cps", "", Type::Float, "Calls placed per second", "2" },
+        { "turns", "", Type::Integer, "Prompts spoken per call", "3" },
+        { "prompts", "p", Type::String, "Comma-separated WAV files, spoken in turn", "" },
+        { "sip-port", "", Type::Integer, "Local SIP UDP port (0 = any)", "0" },
+        { "rtp-port", "", Type::Integer, "First local RTP port", "20000" },
+        { "prompt-delay-ms", "", Type::Integer, "Wait after answer before the first prompt", "1000" },
+        { "turn-timeout-ms", "", Type::Integer, "Give up on a reply after this long", "15000" },
+        { "reply-end-ms", "", Type::Integer, "Silence that ends an agent reply", "800" },
+        { "max-call-ms", "", Type::Integer, "Hang up any call after this long", "120000" },
+        { "voice-rms", "", Type::Float, "Frame RMS above which agent audio counts as speech", "300" },
+        { "server-url", "", Type::String, "Server REST base URL, for underruns (empty to skip)", "http://127.0.0.1:18080" },
+        { "server-pid", "", Type::Integer, "Server process id (0 = find a process named 'server')", "0" },
+        { "sample-ms", "", Type::Integer, "Server sampling interval", "1000" },
+        { "output", "o", Type::String, "Write the JSON report here instead of stdout", "" },
+        { "soak", "", Type::Boolean, "Track server resource growth per call and fail on leaks", "false" },
+        { "soak-every", "", Type::Integer, "Finished calls between soak samples", "1000" },
+        { "soak-warmup", "", Type::Integer, "Calls before growth is measured (pools fill up first)", "1000" },
+        { "max-rss-kb-per-call", "", Type::Float, "Soak limit on RSS growth", "2" },
+        { "max-heap-bytes-per-call", "", Type::Float, "Soak limit on malloc'd bytes growth", "512" },
+        { "max-fds-per-call", "", Type::Float, "Soak limit on open fd growth", "0.001" },
+        { "max-threads-per-call", "", Type::Float, "Soak limit on thread count growth", "0.001" },
+    });
+    try {
+        config.initialize(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        config.print_help();
+        return 1;
+    }
+    if (config.get<bool>("help", false)) {
+        config.print_help();
+        return 0;
+    }
+
+    const Options options {
+        .target = config.get<std::string>("target", "sip:agent@127.0.0.1:18090"),
+        .calls = std::max(config.get<int>("calls", 100), 1),
+        .concurrency = std::max(config.get<int>("concurrency", 20), 1),
+        .cps = std::max(config.get<float>("cps", 2.0f), 0.01f),
+        .turns = std::max(config.get<int>("turns", 3), 1),
+        .sipPort = config.get<int>("sip-port", 0),
+        .rtpPort = config.get<int>("rtp-port", 20000),
+        .promptDelayMs = config.get<int>("prompt-delay-ms", 1000),
+        .turnTimeoutMs = config.get<int>("turn-timeout-ms", 15000),
+        .replyEndMs = config.get<int>("reply-end-ms", 800),
+        .maxCallMs = config.get<int>("max-call-ms", 120000),
+        .voiceRms = config.get<float>("voice-rms", 300.0f),
+        .serverUrl = config.get<std::string>("server-url", "http://127.0.0.1:18080"),
+        .serverPid = config.get<int>("server-pid", 0),
+        .sampleMs = std::max(config.get<int>("sample-ms", 1000), 100),
+    };
+
+    std::vector<Prompt> prompts;
+    for (const auto &path: split(config.get<std::string>("prompts", ""))) {
+        auto prompt = load_wav(path);
+        if (!prompt) {
+            return 1;
+        }
+        prompts.push_back(std::move(*prompt));
+    }
+    for (const auto &prompt: prompts) {
+        if (prompt.sampleRate != prompts.front().sampleRate) {
+            LOG_ERROR << "All prompts must have the same sample rate";
+            return 1;
+        }
+    }
+    if (prompts.empty()) {
+        LOG_WARNING << "No --prompts given, callers will speak a synthetic signal";
+        prompts.push_back(synthetic_prompt());
+    }
+
+    pj::Endpoint endpoint;
+    try {
+        endpoint.libCreate();
+        pj::EpConfig epConfig;
+        epConfig.logConfig.level = 1;
+        epConfig.logConfig.consoleLevel = 1;
+        epConfig.uaConfig.maxCalls = std::min<unsigned>(options.concurrency, PJSUA_MAX_CALLS);
+        epConfig.medConfig.noVad = true;
+        epConfig.medConfig.clockRate = prompts.front().sampleRate;
+        epConfig.medConfig.maxMediaPorts = 2 * options.concurrency + 8;
+        endpoint.libInit(epConfig);
+
+        pj::TransportConfig transportConfig;
+        transportConfig.port = options.sipPort;
+        endpoint.transportCreate(PJSIP_TRANSPORT_UDP, transportConfig);
+        endpoint.audDevManager().setNullDev();
+        endpoint.libStart();
+    } catch (const pj::Error &err) {
+        LOG_ERROR << "PJSIP initialization failed: " << err.info();
+        return 1;
+    }
+    if (options.concurrency > PJSUA_MAX_CALLS) {
+        LOG_WARNING << "Concurrency capped at PJSUA_MAX_CALLS (" << PJSUA_MAX_CALLS << ")";
+    }
+    const size_t concurrency = std::min<size_t>(options.concurrency, PJSUA_MAX_CALLS);
+
+    pj::Account account;
+    pj::AccountConfig accountConfig;
+    accountConfig.idUri = "sip:loadgen@127.0.0.1";
+    accountConfig.mediaConfig.transportConfig.port = options.rtpPort;
+    accountConfig.mediaConfig.transportConfig.portRange = 2 * concurrency + 100;
+    account.create(accountConfig);
+
+    ProcessSampler server(options.serverPid > 0 ? options.serverPid : ProcessSampler::findByName("server"));
+    if (server.pid() <= 0) {
+        LOG_WARNING << "Server process not found, CPU/RSS won't be reported";
+    }
+    UnderrunPoller underruns(options.serverUrl);
+
+    std::unique_ptr<SoakMonitor> soak;
+    const uint64_t soakEvery = std::max(config.get<int>("soak-every", 1000), 1);
+    uint64_t nextSoakSample = 0;
+    if (config.get<bool>("soak", false)) {
+        if (options.serverUrl.empty()) {
+            LOG_ERROR << "--soak needs --server-url";
+            return 1;
+        }
+        soak = std::make_unique<SoakMonitor>(options.serverUrl, config.get<int>("soak-warmup", 1000),
+            SoakMonitor::Limits {
+                .rssKb = config.get<float>("max-rss-kb-per-call", 2.0f),
+                .heapBytes = config.get<float>("max-heap-bytes-per-call", 512.0f),
+                .openFds = config.get<float>("max-fds-per-call", 0.001f),
+                .threads = config.get<float>("max-threads-per-call", 0.001f),
+            });
+        soak->sample(0);
+        nextSoakSample = soakEvery;
+    }
+
+    std::vector<std::unique_ptr<LoadCall>> active;
+    // Disconnected calls are kept a moment before being deleted, so a pjsua
+    // callback still unwinding on another thread never sees a freed object
+    std::vector<std::pair<Clock::time_point, std::unique_ptr<LoadCall>>> retired;
+    LoadCall::Results totals;
+    uint64_t placed = 0, answered = 0, failed = 0;
+    size_t peak = 0;
+    std::unordered_map<int, uint64_t> failureCodes;
+
+    const auto started = Clock::now();
+    auto nextSample = started;
+    server.sample();
+    LOG_INFO << "Placing " << options.calls << " calls to " << options.target << " at " << options.cps
+             << " cps, up to " << concurrency << " at once";
+
+    while (placed < static_cast<uint64_t>(options.calls) || !active.empty() || !retired.empty()) {
+        const auto now = Clock::now();
+        while (placed < static_cast<uint64_t>(options.calls) && active.size() < concurrency &&
+               now >= started + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(placed / options.cps))) {
+            auto call = std::make_unique<LoadCall>(account, options, prompts, prompts.front().sampleRate);
+            placed++;
+            try {
+                call->place();
+                active.push_back(std::move(call));
+            } catch (const pj::Error &err) {
+                LOG_WARNING << "Call " << placed << " failed to start: " << err.info();
+                failed++;
+            }
+        }
+        peak = std::max(peak, active.size());
+
+        for (auto it = active.begin(); it != active.end();) {
+            auto &call = *it;
+            if (call->wantsHangup() || ms_between(call->placedAt(), now) > options.maxCallMs) {
+                call->hangupOnce();
+            }
+            if (!call->disconnected()) {
+                ++it;
+                continue;
+            }
+            const auto results = call->results();
+            if (results.answered) {
+                answered++;
+            } else {
+                failed++;
+                failureCodes[results.lastStatus]++;
+            }
+            totals.answerMs.add(results.answerMs);
+            totals.greetingMs.add(results.greetingMs);
+            totals.responseMs.add(results.responseMs);
+            totals.turns += results.turns;
+            totals.timeouts += results.timeouts;
+            totals.gaps += results.gaps;
+            retired.emplace_back(now + std::chrono::milliseconds(500), std::move(call));
+            it = active.erase(it);
+        }
+        retired.erase(std::remove_if(retired.begin(), retired.end(), [now](const auto &entry) { return entry.first <= now; }),
+            retired.end());
+
+        if (soak && answered + failed >= nextSoakSample) {
+            soak->sample(answered + failed);
+            nextSoakSample += soakEvery;
+        }
+
+        if (now >= nextSample) {
+            server.sample();
+            underruns.poll();
+            nextSample = now + std::chrono::milliseconds(options.sampleMs);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    server.sample();
+    if (soak) {
+        // Final sample once the server has torn the last calls down
+        std::this_thread::sleep_for(std::chrono::seconds(2));
+        soak->sample(answered + failed);
+    }
+    const double elapsedSec = ms_between(started, Clock::now()) / 1000.0;
+
+    json failures = json::object();
+    for (const auto &[code, count]: failureCodes) {
+        failures[std::to_string(code)] = count;
+    }
+    json report = {
+        { "target", options.target },
+        { "config", {
+                        { "calls", options.calls },
+                        { "concurrency", concurrency },
+                        { "cps", options.cps },
+                        { "turns", options.turns },
+                        { "prompts", prompts.size() },
+                    } },
+        { "durationSec", elapsedSec },
+        { "calls", {
+                       { "placed", placed },
+                       { "answered", answered },
+                       { "failed", failed },
+                       { "failureCodes", failures },
+                       { "peakConcurrent", peak },
+                       { "achievedCps", elapsedSec > 0 ? placed / elapsedSec : 0 },
+                   } },
+        { "answerMs", totals.answerMs.summary() },
+        { "greetingMs", totals.greetingMs.summary() },
+        { "responseMs", totals.responseMs.summary() },
+        { "turns", { { "completed", totals.turns - totals.timeouts }, { "timedOut", totals.timeouts } } },
+        { "gaps", totals.gaps },
+        { "underruns", underruns.total() },
+        { "server", server.summary() },
+    };
+    if (soak) {
+        report["soak"] = soak->report();
+    }
+
+    const auto output = config.get<std::string>("output", "");
+    if (output.empty()) {
+        std::cout << report.dump(2) << std::endl;
+    } else {
+        std::ofstream(output) << report.dump(2) << std::endl;
+        LOG_INFO << "Report written to " << output;
+    }
+
+    active.clear();
+    account.shutdown();
+    endpoint.libDestroy();
+    if (soak && !soak->passed()) {
+        LOG_ERROR << "Soak failed: " << report["soak"]["violations"].dump();
+        return 2;
+    }
+    return answered > 0 ? 0 : 1;
+}
@@ -0,0 +1,534 @@
+// Offline stand-ins for the services a call depends on, so the whole
+// pipeline can be exercised (and load-tested) on one machine:
+//
+//   STT  (WhisperClient protocol, ws)   binary PCM segment in, {"text": ...} out
+//   TTS  (AuralisClient protocol, ws)   {"type": "synthesize", "input": ...} in,
+//                                       binary PCM tone chunks + status out
+//   LLM  (http)                          Ollama /api/chat and OpenAI
+//                                       /v1/chat/completions, streamed or not
+//
+// Every service listens on its own port; a port of 0 disables it. Point the
+// server at them with STT_URI / TTS_URI in .env and "base_url" in the
+// provider config (config/ollama.json or config/openai.json).
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/server.hpp>
+#include "deps/httplib.h"
+#include "core/configuration.h"
+#include "deps/json.hpp"
+#include "utils/logger.h"
+
+using json = nlohmann::json;
+using WsServer = websocketpp::server<websocketpp::config::asio>;
+using MessagePtr = WsServer::message_ptr;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options
+{
+    std::string host;
+    // STT
+    int stt_port;
+    int stt_latency_ms;
+    int stt_sample_rate;
+    std::vector<std::string> transcripts;
+    // TTS
+    int tts_port;
+    int tts_latency_ms;
+    int tts_chunk_ms;
+    int tts_sample_rate;
+    float tts_ms_per_char;
+    float tts_pace;
+    float tts_tone_hz;
+    // LLM
+    int llm_port;
+    int llm_threads;
+    int llm_first_token_ms;
+    int llm_token_ms;
+    std::string llm_reply;
+};
+
+Options load_options()
+{
+    auto &config = AppConfig::getInstance();
+    Options options{
+        .host = config.get<std::string>("host", "0.0.0.0"),
+        .stt_port = config.get<int>("stt-port", 8765),
+        .stt_latency_ms = config.get<int>("stt-latency-ms", 150),
+        .stt_sample_rate = config.get<int>("stt-sample-rate", 8000),
+        .transcripts = {},
+        .tts_port = config.get<int>("tts-port", 8766),
+        .tts_latency_ms = config.get<int>("tts-latency-ms", 120),
+        .tts_chunk_ms = std::max(config.get<int>("tts-chunk-ms", 200), 10),
+        .tts_sample_rate = config.get<int>("tts-sample-rate", 8000),
+        .tts_ms_per_char = config.get<float>("tts-ms-per-char", 60.0f),
+        .tts_pace = config.get<float>("tts-pace", 1.0f),
+        .tts_tone_hz = config.get<float>("tts-tone-hz", 440.0f),
+        .llm_port = config.get<int>("llm-port", 11434),
+        .llm_threads = std::max(config.get<int>("llm-threads", 64), 1),
+        .llm_first_token_ms = config.get<int>("llm-first-token-ms", 200),
+        .llm_token_ms = config.get<int>("llm-token-ms", 25),
+        .llm_reply = config.get<std::string>("llm-reply", "")};
+
+    const auto transcripts = config.get<std::string>("stt-transcripts", "");
+    if (!transcripts.empty()) {
+        std::ifstream file(transcripts);
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!utils::trim(line).empty()) {
+                options.transcripts.push_back(utils::trim(line));
+            }
+        }
+        LOG_INFO << "Loaded " << options.transcripts.size() << " transcripts from " << transcripts;
+    }
+    return options;
+}
+
+void quiet(WsServer &server)
+{
+    server.clear_access_channels(websocketpp::log::alevel::all);
+    server.clear_error_channels(websocketpp::log::elevel::all);
+    server.set_reuse_addr(true);
+}
+
+// STT: every binary message is one voice segment (VAD::mergeFrames output).
+// After stt_latency_ms it is answered with the next line of the transcripts
+// file, cycling, or a sentence naming the segment's length. A text message
+// is echoed back as its own transcript.
+class SttStub
+{
+public:
+    SttStub(websocketpp::lib::asio::io_service *io, const Options &options) : options_(options)
+    {
+        quiet(server_);
+        server_.init_asio(io);
+        server_.set_message_handler([this](websocketpp::connection_hdl hdl, MessagePtr msg) { on_message(hdl, msg); });
+        server_.set_close_handler([this](websocketpp::connection_hdl hdl) { utterances_.erase(hdl); });
+        server_.listen(options.host, std::to_string(options.stt_port));
+        server_.start_accept();
+        LOG_INFO << "STT stub on ws://" << options.host << ":" << options.stt_port;
+    }
+
+private:
+    void on_message(websocketpp::connection_hdl hdl, MessagePtr msg)
+    {
+        std::string text;
+        if (msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            const auto &payload = msg->get_payload();
+            const size_t index = utterances_[hdl]++;
+            if (!options_.transcripts.empty()) {
+                text = options_.transcripts[index % options_.transcripts.size()];
+            } else {
+                const double ms = 1000.0 * (payload.size() / sizeof(int16_t)) / options_.stt_sample_rate;
+                text = "This is utterance " + std::to_string(index + 1) + ", " + std::to_string(static_cast<int>(ms)) +
+                       " milliseconds long.";
+            }
+        } else {
+            text = msg->get_payload();
+        }
+
+        server_.set_timer(options_.stt_latency_ms, [this, hdl, text](const websocketpp::lib::error_code &ec) {
+            if (ec) {
+                return;
+            }
+            websocketpp::lib::error_code send_ec;
+            server_.send(hdl, json{{"text", text}}.dump(), websocketpp::frame::opcode::text, send_ec);
+        });
+    }
+
+    const Options &options_;
+    WsServer server_;
+    std::map<websocketpp::connection_hdl, size_t, std::owner_less<websocketpp::connection_hdl>> utterances_;
+};
+
+// TTS: each synthesize request becomes a sine tone lasting tts_ms_per_char
+// per input character. The first chunk goes out tts_latency_ms after the
+// request reaches the front of the connection's queue, the rest every
+// tts_chunk_ms * tts_pace (1 = real time, 0 = as fast as possible).
+// Requests are served in order; "started" and "completed" carry the
+// request's "id" back.
+class TtsStub
+{
+public:
+    TtsStub(websocketpp::lib::asio::io_service *io, const Options &options) : options_(options)
+    {
+        quiet(server_);
+        server_.init_asio(io);
+        server_.set_message_handler([this](websocketpp::connection_hdl hdl, MessagePtr msg) { on_message(hdl, msg); });
+        server_.set_close_handler([this](websocketpp::connection_hdl hdl) { sessions_.erase(hdl); });
+        server_.listen(options.host, std::to_string(options.tts_port));
+        server_.start_accept();
+        LOG_INFO << "TTS stub on ws://" << options.host << ":" << options.tts_port;
+    }
+
+private:
+    struct Session
+    {
+        std::deque<std::pair<std::string, json>> queue;
+        json id;
+        bool speaking = false;
+        size_t remaining = 0;
+        size_t position = 0;
+    };
+
+    void on_message(websocketpp::connection_hdl hdl, MessagePtr msg)
+    {
+        auto request = json::parse(msg->get_payload(), nullptr, false);
+        if (request.is_discarded() || !request.is_object()) {
+            send_json(hdl, {{"error", "invalid request"}});
+            return;
+        }
+        auto &session = sessions_[hdl];
+        session.queue.emplace_back(request.value("input", ""), request.value("id", json()));
+        if (!session.speaking) {
+            start_next(hdl, session);
+        }
+    }
+
+    void start_next(websocketpp::connection_hdl hdl, Session &session)
+    {
+        if (session.queue.empty()) {
+            session.speaking = false;
+            return;
+        }
+        const auto text = std::move(session.queue.front().first);
+        session.id = std::move(session.queue.front().second);
+        session.queue.pop_front();
+        session.speaking = true;
+        session.position = 0;
+        session.remaining = std::max<size_t>(
+            static_cast<size_t>(text.size() * options_.tts_ms_per_char * options_.tts_sample_rate / 1000.0), 1);
+        send_json(hdl, {{"status", "started"}, {"id", session.id}});
+        schedule(hdl, options_.tts_latency_ms);
+    }
+
+    void schedule(websocketpp::connection_hdl hdl, long delay_ms)
+    {
+        server_.set_timer(delay_ms, [this, hdl](const websocketpp::lib::error_code &ec) {
+            auto it = sessions_.find(hdl);
+            if (ec || it == sessions_.end() || !it->second.speaking) {
+                return;
+            }
+            send_chunk(hdl, it->second);
+        });
+    }
+
+    void send_chunk(websocketpp::connection_hdl hdl, Session &session)
+    {
+        const size_t chunk_samples = static_cast<size_t>(options_.tts_chunk_ms) * options_.tts_sample_rate / 1000;
+        const size_t count = std::min(chunk_samples, session.remaining);
+        const size_t fade = options_.tts_sample_rate / 100;
+        const size_t total = session.position + session.remaining;
+        std::vector<int16_t> samples(count);
+        for (size_t i = 0; i < count; i++) {
+            const size_t n = session.position + i;
+            // 10 ms ramps at both ends so the tone doesn't click
+            const double envelope = std::min({1.0, double(n) / fade, double(total - n) / fade});
+            samples[i] = static_cast<int16_t>(
+                9000 * envelope * std::sin(2 * M_PI * options_.tts_tone_hz * n / options_.tts_sample_rate));
+        }
+        session.position += count;
+        session.remaining -= count;
+
+        websocketpp::lib::error_code ec;
+        server_.send(hdl, samples.data(), samples.size() * sizeof(int16_t), websocketpp::frame::opcode::binary, ec);
+        if (ec) {
+            sessions_.erase(hdl);
+            return;
+        }
+        if (session.remaining > 0) {
+            schedule(hdl, static_cast<long>(options_.tts_chunk_ms * options_.tts_pace));
+            return;
+        }
+        send_json(hdl, {{"status", "completed"}, {"id", session.id}});
+        start_next(hdl, session);
+    }
+
+    void send_json(websocketpp::connection_hdl hdl, const json &message)
+    {
+        websocketpp::lib::error_code ec;
+        server_.send(hdl, message.dump(), websocketpp::frame::opcode::text, ec);
+    }
+
+    const Options &options_;
+    WsServer server_;
+    std::map<websocketpp::connection_hdl, Session, std::owner_less<websocketpp::connection_hdl>> sessions_;
+};
+
+// LLM: answers with llm_reply, or "You said: <last user message>", one
+// word per token. The first token comes after llm_first_token_ms and the
+// rest every llm_token_ms, on both the Ollama and the OpenAI routes.
+class LlmStub
+{
+public:
+    explicit LlmStub(const Options &options) : options_(options)
+    {
+        const int threads = options.llm_threads;
+        server_.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+
+        server_.Post("/api/chat", [this](const httplib::Request &req, httplib::Response &res) { ollama_chat(req, res); });
+        server_.Get("/api/tags", [](const httplib::Request &, httplib::Response &res) {
+            res.set_content(json{{"models", json::array({{{"name", "stub"}, {"model", "stub"}}})}}.dump(), "application/json");
+        });
+        for (const auto *path : {"/v1/chat/completions", "/chat/completions"}) {
+            server_.Post(path, [this](const httplib::Request &req, httplib::Response &res) { openai_chat(req, res); });
+        }
+        server_.Get("/health", [](const httplib::Request &, httplib::Response &res) { res.set_content("ok", "text/plain"); });
+    }
+
+    void run()
+    {
+        LOG_INFO << "LLM stub on http://" << options_.host << ":" << options_.llm_port;
+        if (!server_.listen(options_.host, options_.llm_port)) {
+            LOG_ERROR << "LLM stub could not listen on port " << options_.llm_port;
+        }
+    }
+
+private:
+    struct Reply
+    {
+        std::string model;
+        std::vector<std::string> tokens;
+        size_t prompt_tokens = 0;
+    };
+
+    Reply make_reply(const json &body) const
+    {
+        Reply reply;
+        reply.model = body.value("model", "stub");
+        std::string last_user;
+        for (const auto &message : body.value("messages", json::array())) {
+            const auto content = message.value("content", "");
+            reply.prompt_tokens += std::count(content.begin(), content.end(), ' ') + 1;
+            if (message.value("role", "") == "user") {
+                last_user = content;
+            }
+        }
+        const auto text = options_.llm_reply.empty() ? "You said: " + last_user : options_.llm_reply;
+        std::istringstream words(text);
+        std::string word;
+        while (words >> word) {
+            reply.tokens.push_back(reply.tokens.empty() ? word : " " + word);
+        }
+        return reply;
+    }
+
+    // Sleeps until token i is due; false when the client has gone
+    bool wait_token(Clock::time_point started, size_t index, httplib::DataSink &sink) const
+    {
+        std::this_thread::sleep_until(started + std::chrono::milliseconds(options_.llm_first_token_ms) +
+                                      std::chrono::milliseconds(options_.llm_token_ms) * index);
+        return sink.is_writable();
+    }
+
+    void delay_all(size_t tokens) const
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(options_.llm_first_token_ms) +
+                                    std::chrono::milliseconds(options_.llm_token_ms) * (tokens ? tokens - 1 : 0));
+    }
+
+    static std::string join(const std::vector<std::string> &tokens)
+    {
+        std::string text;
+        for (const auto &token : tokens) {
+            text += token;
+        }
+        return text;
+    }
+
+    void ollama_chat(const httplib::Request &req, httplib::Response &res)
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (body.is_discarded()) {
+            res.status = 400;
+            res.set_content(json{{"error", "invalid JSON"}}.dump(), "application/json");
+            return;
+        }
+        auto reply = std::make_shared<Reply>(make_reply(body));
+        auto final_message = [reply](const std::string &content, int64_t total_ns) {
+            return json{
+                {"model", reply->model},
+                {"message", {{"role", "assistant"}, {"content", content}}},
+                {"done", true},
+                {"done_reason", "stop"},
+                {"total_duration", total_ns},
+                {"prompt_eval_count", reply->prompt_tokens},
+                {"eval_count", reply->tokens.size()}};
+        };
+
+        if (!body.value("stream", true)) {
+            const auto started = Clock::now();
+            delay_all(reply->tokens.size());
+            res.set_content(final_message(join(reply->tokens), (Clock::now() - started).count()).dump(), "application/json");
+            return;
+        }
+
+        const auto started = Clock::now();
+        res.set_chunked_content_provider("application/x-ndjson",
+            [this, reply, started, final_message, index = size_t(0)](size_t, httplib::DataSink &sink) mutable {
+                if (index < reply->tokens.size()) {
+                    if (!wait_token(started, index, sink)) {
+                        return false;
+                    }
+                    const auto line = json{
+                        {"model", reply->model},
+                        {"message", {{"role", "assistant"}, {"content", reply->tokens[index++]}}},
+                        {"done", false}}.dump() + "\n";
+                    sink.write(line.data(), line.size());
+                    return true;
+                }
+                const auto line = final_message("", (Clock::now() - started).count()).dump() + "\n";
+                sink.write(line.data(), line.size());
+                sink.done();
+                return true;
+            });
+    }
+
+    void openai_chat(const httplib::Request &req, httplib::Response &res)
+    {
+        auto body = json::parse(req.body, nullptr, false);
+        if (body.is_discarded()) {
+            res.status = 400;
+            res.set_content(json{{"error", {{"message", "invalid JSON"}}}}.dump(), "application/json");
+            return;
+        }
+        auto reply = std::make_shared<Reply>(make_reply(body));
+        const json usage = {
+            {"prompt_tokens", reply->prompt_tokens},
+            {"completion_tokens", reply->tokens.size()},
+            {"total_tokens", reply->prompt_tokens + reply->tokens.size()}};
+
+        if (!body.value("stream", false)) {
+            delay_all(reply->tokens.size());
+            res.set_content(json{
+                {"id", "chatcmpl-stub"},
+                {"object", "chat.completion"},
+                {"model", reply->model},
+                {"choices", json::array({{
+                    {"index", 0},
+                    {"message", {{"role", "assistant"}, {"content", join(reply->tokens)}}},
+                    {"finish_reason", "stop"}}})},
+                {"usage", usage}}.dump(), "application/json");
+            return;
+        }
+
+        const bool include_usage = body.contains("stream_options") && body["stream_options"].value("include_usage", false);
+        const auto started = Clock::now();
+        res.set_chunked_content_provider("text/event-stream",
+            [this, reply, started, usage, include_usage, index = size_t(0)](size_t, httplib::DataSink &sink) mutable {
+                auto event = [&](const json &data) {
+                    const auto line = "data: " + data.dump() + "\n\n";
+                    sink.write(line.data(), line.size());
+                };
+                auto chunk = [&](const json &delta, const json &finish_reason) {
+                    return json{
+                        {"id", "chatcmpl-stub"},
+                        {"object", "chat.completion.chunk"},
+                        {"model", reply->model},
+                        {"choices", json::array({{{"index", 0}, {"delta", delta}, {"finish_reason", finish_reason}}})}};
+                };
+                if (index < reply->tokens.size()) {
+                    if (!wait_token(started, index, sink)) {
+                        return false;
+                    }
+                    event(chunk({{"content", reply->tokens[index++]}}, nullptr));
+                    return true;
+                }
+                event(chunk(json::object(), "stop"));
+                if (include_usage) {
+                    event({{"id", "chatcmpl-stub"}, {"object", "chat.completion.chunk"}, {"choices", json::array()}, {"usage", usage}});
+                }
+                const std::string done = "data: [DONE]\n\n";
+                sink.write(done.data(), done.size());
+                sink.done();
+                return true;
+            });
+    }
+
+    const Options &options_;
+    httplib::Server server_;
+};
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    using Type = CLIParser::Type;
+    AppConfig &config = AppConfig::getInstance();
+    config.add_options({
+        {"help", "h", Type::Boolean, "Show help", "false"},
+        {"host", "", Type::String, "Address to listen on", "0.0.0.0"},
+        {"stt-port", "", Type::Integer, "STT websocket port, 0 to disable", "8765"},
+        {"stt-latency-ms", "", Type::Integer, "Delay before a transcript is sent", "150"},
+        {"stt-sample-rate", "", Type::Integer, "Sample rate of incoming audio", "8000"},
+        {"stt-transcripts", "", Type::String, "File with one transcript per line, sent in turn", ""},
+        {"tts-port", "", Type::Integer, "TTS websocket port, 0 to disable", "8766"},
+        {"tts-latency-ms", "", Type::Integer, "Delay before the first audio chunk", "120"},
+        {"tts-chunk-ms", "", Type::Integer, "Audio per chunk", "200"},
+        {"tts-sample-rate", "", Type::Integer, "Sample rate of synthesized audio", "8000"},
+        {"tts-ms-per-char", "", Type::Float, "Audio length per input character", "60"},
+        {"tts-pace", "", Type::Float, "Chunk interval as a fraction of real time", "1.0"},
+        {"tts-tone-hz", "", Type::Float, "Tone frequency", "440"},
+        {"llm-port", "", Type::Integer, "Chat completion HTTP port, 0 to disable", "11434"},
+        {"llm-threads", "", Type::Integer, "HTTP worker threads (concurrent streams)", "64"},
+        {"llm-first-token-ms", "", Type::Integer, "Time to first token", "200"},
+        {"llm-token-ms", "", Type::Integer, "Interval between tokens", "25"},
+        {"llm-reply", "", Type::String, "Fixed reply instead of echoing the user", ""},
+    });
+    try {
+        config.initialize(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        config.print_help();
+        return 1;
+    }
+    if (config.get<bool>("help", false)) {
+        config.print_help();
+        return 0;
+    }
+
+    const Options options = load_options();
+    try {
+        websocketpp::lib::asio::io_service io;
+        std::unique_ptr<SttStub> stt;
+        std::unique_ptr<TtsStub> tts;
+        if (options.stt_port > 0) {
+            stt = std::make_unique<SttStub>(&io, options);
+        }
+        if (options.tts_port > 0) {
+            tts = std::make_unique<TtsStub>(&io, options);
+        }
+
+        std::unique_ptr<LlmStub> llm;
+        std::thread llm_thread;
+        if (options.llm_port > 0) {
+            llm = std::make_unique<LlmStub>(options);
+            llm_thread = std::thread([&llm] { llm->run(); });
+        }
+
+        // Both websocket services share this thread; their work is timers
+        // and small sends
+        if (stt || tts) {
+            io.run();
+        }
+        if (llm_thread.joinable()) {
+            llm_thread.join();
+        }
+    } catch (const std::exception &e) {
+        LOG_ERROR << "Stub services failed: " << e.what();
+        return 1;
+    }
+    return 0;
+}